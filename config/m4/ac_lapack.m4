@@ -0,0 +1,55 @@
+# SYNOPSIS
+#
+#   AC_LAPACK([required], [can_build], [default_build])
+#
+# DESCRIPTION
+#
+# This looks for an optimized LAPACK/BLAS (e.g., OpenBLAS, MKL, or the
+# reference libraries). Unlike most of the libraries we look for, this
+# is only used if the user asks for it with --with-lapack, since the
+# code it replaces works without it. If we find it, we set the Makefile
+# conditional HAVE_LAPACK, define HAVE_LAPACK, and set LAPACK_LIBS.
+# LAPACK_LIBS always brings in a BLAS as well, so we also define
+# HAVE_BLAS, which routes the level-1 routines in cblas.c to it.
+#
+# With --with-lapack=DIR we link DIR/lib with -llapack -lblas. Otherwise
+# we try pkg-config "lapack" and then look for dgesdd_ in -llapack.
+# LAPACK_LIBS can also be given on the configure line to use some other
+# library (e.g., LAPACK_LIBS="-lopenblas").
+
+AC_DEFUN([AC_LAPACK],
+[
+# Guard against running twice
+if test "x$done_lapack" = "x"; then
+AC_HANDLE_WITH_ARG_DEFAULT_NO([lapack], [lapack], [LAPACK], $2, $3, $1)
+AC_ARG_VAR([LAPACK_LIBS], [linker flags for LAPACK/BLAS, used with --with-lapack])
+if test "x$want_lapack" = "xyes"; then
+        AC_MSG_CHECKING([for LAPACK library])
+        succeeded=no
+        if test "$LAPACK_LIBS" != ""; then
+            succeeded=yes
+        elif test "$ac_lapack_path" != ""; then
+            LAPACK_LIBS="-L$ac_lapack_path/lib -llapack -lblas"
+            succeeded=yes
+        else
+            PKG_CHECK_MODULES([LAPACK], [lapack], [succeeded=yes], [succeeded=no])
+        fi
+        AC_MSG_RESULT([$succeeded])
+        if test "$succeeded" != "yes" ; then
+            AC_CHECK_LIB([lapack], [dgesdd_], [LAPACK_LIBS="-llapack -lblas"; succeeded=yes], [], [-lblas])
+        fi
+
+        if test "$succeeded" = "yes" ; then
+                AC_SUBST(LAPACK_LIBS)
+                AC_DEFINE(HAVE_LAPACK,,[Defined if we have LAPACK])
+                AC_DEFINE(HAVE_BLAS,,[Defined if we have a BLAS])
+                have_lapack="yes"
+        fi
+fi
+AM_CONDITIONAL([HAVE_LAPACK], [test "$have_lapack" = "yes"])
+
+AC_CHECK_FOUND([lapack], [lapack],[LAPACK],$1,$2)
+
+done_lapack="yes"
+fi
+])
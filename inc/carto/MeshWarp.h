@@ -0,0 +1,96 @@
+#ifndef MESHWARP_UTILS
+#define MESHWARP_UTILS
+
+#include "carto/ImageUtils.h"
+
+#define MW_ROW_NL      16     /* output lines per row of triangle lists */
+#define MW_STRIP_NL    64     /* default output lines per thread per strip */
+#define MW_BUFFER_NL 2048     /* default bound on input lines held */
+
+/******************************************************************************/
+typedef struct
+{
+   int ntri;
+   double *ol, *os;      // output line, samp of the 3 vertices of each triangle
+   double *coef;         // 6 per triangle: input line = c0 + c1*l + c2*s,
+                         //                 input samp = c3 + c4*l + c5*s
+   double *lmin, *lmax, *smin, *smax;   // output bounding box of each triangle
+
+   int nl, nrow;         // output lines and rows of MW_ROW_NL lines covered
+   int *row_start;       // triangles crossing row r are
+   int *row_tri;         //    row_tri[row_start[r]..row_start[r+1]-1]
+}MESH_WARP;
+
+/******************************************************************************/
+// getMeshWarp: returns a MESH_WARP holding the affine map of each triangle
+//              of a control mesh, from output to input (line, samp)
+//
+// input:
+// ======
+// + npts
+//    - number of mesh points
+// + out_l, out_s
+//    - output (line, samp) of each mesh point, from 1 as in VICAR
+// + in_l, in_s
+//    - input (line, samp) of each mesh point
+// + ntri
+//    - number of triangles
+// + tcon1, tcon2, tcon3
+//    - triangle vertices (from 1), as returned by thiessen or delaunay
+//      run on the output coordinates
+// + nl
+//    - number of lines in the output image
+//
+// output:
+// =======
+// + mw
+//    - initialized MESH_WARP struct pointer (degenerate triangles are dropped)
+//    - memory will be allocated inside the function
+/******************************************************************************/
+MESH_WARP* getMeshWarp(int npts, double *out_l, double *out_s, double *in_l, double *in_s,
+                       int ntri, int *tcon1, int *tcon2, int *tcon3, int nl);
+
+/******************************************************************************/
+// deleteMeshWarp: deletes a MESH_WARP struct
+//
+// input:
+// ======
+// + mw
+//    - pointer to MESH_WARP to delete
+/******************************************************************************/
+void deleteMeshWarp(MESH_WARP **mw);
+
+/******************************************************************************/
+// warpVicarImage: writes every line of "to" by resampling "from" through mw
+//
+//    Each triangle is rasterized in scanline order (a pixel belongs to the
+//    triangle whose half-open span holds its center), so no triangle search
+//    or affine solve is done per pixel. The output is made a strip at a time;
+//    the input lines that the strip maps onto are read into a ring buffer of
+//    at most buffer_nl lines (more only if one output line needs them), and
+//    the lines of the strip are then resampled on nthreads threads. Output
+//    pixels outside the mesh or mapping outside the input are 0.
+//
+// input:
+// ======
+// + mw
+//    - MESH_WARP from getMeshWarp
+// + from
+//    - input image, opened for reading
+// + to
+//    - output image, opened for writing with mw->nl lines
+// + resample_mode
+//    - IU_NEAR_NEIGHBOR, IU_BILINEAR_INTERP or IU_BICUBIC_INTERP
+// + buffer_nl
+//    - bound on input lines buffered (0 for MW_BUFFER_NL)
+// + nthreads
+//    - number of threads (0 for get_thread_count())
+//
+// output:
+// =======
+// + to image
+/******************************************************************************/
+void warpVicarImage(MESH_WARP *mw, VICAR_IMAGE *from, VICAR_IMAGE *to,
+                    int resample_mode, int buffer_nl, int nthreads);
+
+#endif
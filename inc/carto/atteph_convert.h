@@ -1,7 +1,26 @@
 #ifndef __ATTEPH_CONVERT_H
 #define __ATTEPH_CONVERT_H
 
+/* Time series of ephemeris and attitude records (see atteph_table_create) */
+typedef struct
+{
+  int     neph;             /* number of ephemeris records */
+  int     order;            /* Lagrange order (records used) for position */
+  double  *et;              /* (neph) ephemeris times, increasing */
+  double  *ex, *ey, *ez;    /* (neph) positions */
+  double  *evx, *evy, *evz; /* (neph) velocities, or NULL if not given */
+  int     natt;             /* number of attitude records */
+  double  *at;              /* (natt) attitude times, increasing */
+  double  *aq;              /* (natt X 4) attitude quaternions */
+  double  *eph, *att;       /* storage behind the arrays above */
+} atteph_table_struct;
+
 int atteph_convert8(double *peph, double *patt, double *seph, double *satt, double t, double *v8);
 int atteph_convert6(double *peph, double *patt, double *seph, double *satt, double t, double *v6);
 
+int atteph_table_create(int neph, double *eph, double *evel, int natt, double *att, int order, atteph_table_struct **table_adr);
+int atteph_table_free(atteph_table_struct *T);
+int atteph_table_eval(atteph_table_struct *T, int n, double *t, double *x, double *y, double *z,
+    double *q0, double *q1, double *q2, double *q3);
+
 #endif
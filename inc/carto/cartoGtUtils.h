@@ -35,6 +35,46 @@ int gtgetlab( char * inp, int instance, char ** labelstr, int * nl, int * ns);
 
 /*================================================================
 
+GTLABEL gtparselab, gtfreelab, gtlabkey
+
+gtparselab tokenizes a label from gtgetlab once into a table of
+its "KEY=value" lines, hashed on the key (case insensitive), with
+the leading numbers of each value parsed into a vector.  The
+functions below that take a label string parse it for each call;
+their ...lab versions (geofixlab, gtrectlab, gtmapcomlab, gtgetrotlab
+and gtgetscllab) take a GTLABEL instead, so a label that is queried
+or compared many times is scanned only once.
+
+gtlabkey returns the first line with key, or NULL if none.
+In an entry, value is the text after the "=", and val[0..nval-1]
+the numbers of a vector "(a,b,...)" or the number before a
+comment as in "2(PIXELISPOINT)"; nval is 0 for other values.
+*/
+
+typedef struct
+{
+   char *key;
+   char *value;
+   int nval;
+   double *val;
+} GTLABENTRY;
+
+typedef struct
+{
+   char *text;
+   int nent,nhash;
+   GTLABENTRY *ent;
+   int *hash;
+} GTLABEL;
+
+GTLABEL * gtparselab( char * labelstr );
+
+void gtfreelab( GTLABEL * lab );
+
+GTLABENTRY * gtlabkey( GTLABEL * lab, char * key );
+
+/*================================================================
+
 int invertmap
 
 invertmap calculates the inverse of a six-vector double precision
@@ -91,6 +131,8 @@ arguments:
 
 int geofix( char * labelstr, double * map, double * invmap, int nl, int ns, double * corner);
 
+int geofixlab( GTLABEL * lab, double * map, double * invmap, int nl, int ns, double * corner);
+
 /*================================================================
 
 int gtrect
@@ -117,6 +159,8 @@ arguments:
 
 int gtrect( char * labelstr, double eps );
 
+int gtrectlab( GTLABEL * lab, double eps );
+
 int gtcompval( char * p1, char * p2 );
 
 /*================================================================
@@ -148,6 +192,8 @@ arguments:
 
 int gtmapcom( char * labelstr1, char * labelstr2 );
 
+int gtmapcomlab( GTLABEL * lab1, GTLABEL * lab2 );
+
 /*================================================================
 
 int gtgetrot
@@ -167,6 +213,8 @@ arguments:
 
 int gtgetrot( char * labelstr );
 
+int gtgetrotlab( GTLABEL * lab );
+
 /*================================================================
 
 gtreplab
@@ -245,4 +293,61 @@ arguments:
 
 void gtgetscl( char * labelstr, int * sctype, double * scale1, double * scale2 );
 
+void gtgetscllab( GTLABEL * lab, int * sctype, double * scale1, double * scale2 );
+
+/*================================================================
+
+gtapplymap, gtapplymapline, gtmapcompose, gtxformline
+
+batch versions of applying a six-vector map from geofix (or
+invertmap), u = map[0]*x+map[1]*y+map[2], v = map[3]*x+map[4]*y+map[5],
+so map takes (line,samp) to (East,North) and invmap the reverse.
+
+gtapplymap applies map to the n points (x[i],y[i]) into (u[i],v[i]);
+u and v may be x and y.
+
+gtapplymapline applies map to the n points of a line, (line,
+samp0+i*dsamp) for i = 0..n-1, by adding a constant step.
+
+gtmapcompose sets map to the map that applies first, then second,
+as for going from pixels of one image to pixels of another in the
+same projection (map of one composed with invmap of the other).
+map may be first or second.
+
+gtxformline chains map1, a batch transform xform (such as a
+projection or RPC step) that changes its n points in place, and
+map2 for the points of a line as in gtapplymapline, leaving the
+results in u and v.  map2 may be NULL to stop after xform.  If
+xform is NULL the maps are composed first, so each point costs
+one affine transform.
+
+arguments:
+      1. map, map1, map2: double[6];
+	 (input) coefficients from geofix or invertmap
+      2. x, y: double[n];
+	 (input) the points
+      3. u, v: double[n];
+	 (output) the transformed points
+      4. n: int n;
+	 (input) the number of points
+      5. line, samp0, dsamp: double;
+	 (input) the line, its first samp and the samp step
+      6. xform: gtxform xform;
+	 (input) xform(xdata,x,y,n) transforms x[0..n-1] and
+	 y[0..n-1] in place
+      7. xdata: void *xdata;
+	 (input) passed to xform
+*/
+
+typedef void (*gtxform)( void * xdata, double * x, double * y, int n );
+
+void gtapplymap( double * map, double * x, double * y, double * u, double * v, int n );
+
+void gtapplymapline( double * map, double line, double samp0, double dsamp, int n, double * u, double * v );
+
+void gtmapcompose( double * first, double * second, double * map );
+
+void gtxformline( double * map1, gtxform xform, void * xdata, double * map2,
+      double line, double samp0, double dsamp, int n, double * u, double * v );
+
 #endif
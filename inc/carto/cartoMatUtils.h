@@ -15,10 +15,59 @@ void lin2( double * a, double * b, double * x, double eps );
 
 void segxseg( double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4, double * w );
 
-void insert_seg( int jj, int * ccount, double * p4max, double xbig, double ybig, double xjbig, double yjbig, int wchcall );
+#define VORMAXPOLY      1000   /* MAX EDGES IN A SINGLE VORONOI POLYGON */
+
+/* working state for building one voronoi polygon; thiessen keeps one */
+/* per thread so that it can be called, and run, concurrently          */
+
+typedef struct
+{
+   int bgg,ccjj[VORMAXPOLY],ccgrp[VORMAXPOLY];
+   double cc1x[VORMAXPOLY],cc1y[VORMAXPOLY],
+      cc2x[VORMAXPOLY],cc2y[VORMAXPOLY],
+      ccrx[VORMAXPOLY],ccry[VORMAXPOLY];
+   short int *vgroup;
+} VoronoiCell;
+
+void insert_seg( VoronoiCell * cell, int jj, int * ccount, double * p4max, double xbig, double ybig, double xjbig, double yjbig, int wchcall );
 
 void thiessen( int npoints, int * nlinret, double reject, double skinny, int abendi, double * ptx, double * pty, int * ntriang, int ** tcon1, int ** tcon2, int ** tcon3 );
 
+/* same arguments and output as thiessen, but by delaunay triangulation */
+/* in O(n log n) expected time and with exact geometric tests; points   */
+/* are screened as by thiessen and triangles with area under skinny     */
+/* are dropped                                                          */
+
+void delaunay( int npoints, int * nlinret, double reject, double skinny, int abendi, double * ptx, double * pty, int * ntriang, int ** tcon1, int ** tcon2, int ** tcon3 );
+
 int insidetri( double x, double y, double x1, double y1, double x2, double y2, double x3, double y3 );
 
+/* point location in a triangulation from thiessen or delaunay: a      */
+/* uniform grid of buckets over the points, each listing the triangles */
+/* whose bounding boxes overlap it. triangles are numbered by their    */
+/* position in tcon1..3 (from 0); the points are not copied            */
+
+typedef struct
+{
+   int ntri,nx,ny;
+   double xlo,ylo,xscale,yscale;
+   double *ptx,*pty;
+   int *v;                      /* 3 per triangle, from 0, in insidetri order */
+   int *start,*list;            /* bucket c is list[start[c]..start[c+1]-1] */
+} TriLocator;
+
+TriLocator * trilocator_build( double * ptx, double * pty, int ntriang, int * tcon1, int * tcon2, int * tcon3 );
+
+void trilocator_free( TriLocator * loc );
+
+/* returns the triangle holding (x,y), or -1 if none does; *hint is the */
+/* triangle to try first (or -1) and is set to the result when found,   */
+/* so each caller (or thread) keeps its own                             */
+
+int trilocate( TriLocator * loc, double x, double y, int * hint );
+
+/* trilocate for n points, such as a full output line, into tri */
+
+void trilocate_line( TriLocator * loc, double * x, double * y, int n, int * tri );
+
 #endif
@@ -15,6 +15,8 @@
 
 void getSelectionSortIndices(void *unsorted, int *indices, int n, int type);
 
+void getSortIndices(void *unsorted, int *indices, int n, int type, int stable);
+
 void sort8( double * buf, int * ptr, int n );
 
 void sort88( double * buf, int * ptr, int n );
@@ -31,4 +33,12 @@ void sort4(int *buf, int *ptr, int n);
 
 void sort7( float *buf, int *ptr, int n );
 
+void sort8radix( double * buf, int * ptr, int n, int nthreads );
+
+void sort88radix( double * buf, int * ptr, int n, int nthreads );
+
+void sort4radix( int * buf, int * ptr, int n, int nthreads );
+
+void sort7radix( float * buf, int * ptr, int n, int nthreads );
+
 #endif
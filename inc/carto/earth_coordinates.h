@@ -29,6 +29,7 @@ extern "C" {
   int enu_from_geodetic(double *ENU, double *LLH0, int n_rows, double *LLH);
   int ecef_from_geodetic(double *XYZ, int n_rows, double *LLH);
   int geodetic_from_ecef(double *LLH, int n_rows, double *XYZ);
+  int geodetic_from_ecef_ellipsoid(ellipsoid_struct *ellipsoid, double *LLH, int n_rows, double *XYZ);
 
   int enu_T_ecef(double *T, double *LLH0);
 
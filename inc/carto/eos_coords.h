@@ -1,6 +1,16 @@
 #ifndef __EOS_COORDS_H
 #define __EOS_COORDS_H
 
+/* Interpolant for eos_coords over a window of TT (see eos_coords_cache_create) */
+typedef struct
+{
+  double    TT0, TT1;  /* TT window covered */
+  int       nseg;      /* number of equal-length segments */
+  int       ncoef;     /* Chebyshev coefficients per function per segment */
+  double    seglen;    /* segment length (seconds of TT) */
+  double    *coef;     /* (nseg X 10 X ncoef) coefficients */
+  double    max_err;   /* measured max error of the interpolant (radians) */
+} eos_coords_cache_struct;
 
 #ifdef __cplusplus
 extern "C" {
@@ -8,6 +18,10 @@ extern "C" {
 
   int eos_coords(double TDB, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD);
 
+  int eos_coords_cache_create(double TT0, double TT1, double tol, eos_coords_cache_struct **cache_adr);
+  int eos_coords_cache_eval(eos_coords_cache_struct *cache, double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD);
+  int eos_coords_cache_free(eos_coords_cache_struct *cache);
+
 #ifdef __cplusplus
 }
 #endif
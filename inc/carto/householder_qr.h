@@ -0,0 +1,10 @@
+#ifndef __HOUSEHOLDER_QR_H
+#define __HOUSEHOLDER_QR_H
+
+int householder_qr(int mr, int mc, double *M, double *QR, double *tau);
+int householder_qr_apply_qt(int mr, int mc, double *QR, double *tau, int nb, double *B);
+int householder_qr_apply_q(int mr, int mc, double *QR, double *tau, int nb, double *B);
+int householder_qr_r_copy(int mr, int mc, double *QR, double *R);
+int householder_qr_r_inv(int mr, int mc, double *QR, double *Rinv);
+
+#endif
@@ -47,9 +47,25 @@ typedef struct{
    int totRecSize;   // size of each record in bytes
    int totDataSize;  // size of row * col in bytes
    char **data;
+   double **colViews; // non-double columns converted by
+                      // IBISHELPER_getDoubleColumn, else NULL
 
 } IBISStruct;
 
+///////////////////////////////////////////////////
+#define IBISHELPER_CHUNK_ROWS 65536
+
+/* An open IBIS file accessed a range of rows at */
+/* a time.  The chunk holds file rows startRow   */
+/* to startRow+chunk->nr-1 as rows 0 on, so all  */
+/* the IBISHELPER_ accessors work on it.         */
+typedef struct{
+   IBISStruct *chunk;
+   int nr;          // rows in the file
+   int startRow;    // file row of chunk row 0
+   int chunkRows;   // rows the chunk can hold
+} IBISStream;
+
 ///////////////////////////////////////////////////
 typedef struct{
    int unit, handle;
@@ -110,6 +126,36 @@ void IBISHELPER_getString(IBISStruct *ibis, char *buf, int col, int index);
 /* col and index start offset at 0 not 1         */
 char* IBISHELPER_getBufPtr(IBISStruct *ibis, int col, int index);
 
+/* returns column col as nr contiguous doubles.  */
+/* A doub column is returned in place; others    */
+/* are converted once and kept until the column  */
+/* is set or the file is closed.  The caller     */
+/* must not free the pointer.  Not thread-safe:  */
+/* build the views before sharing ibis between   */
+/* threads.                                      */
+/*                                               */
+/* col starts offset at 0 not 1                  */
+double* IBISHELPER_getDoubleColumn(IBISStruct *ibis, int col);
+
+/* converts column col into the nr doubles of    */
+/* buf                                           */
+/*                                               */
+/* col starts offset at 0 not 1                  */
+void IBISHELPER_readDoubleColumn(IBISStruct *ibis, int col, double *buf);
+
+/* returns the data of column col to be cast to  */
+/* its C type, or NULL unless the column format  */
+/* starts with fmt ('b', 'h', 'f', 'r' or 'd')   */
+/*                                               */
+/* col starts offset at 0 not 1                  */
+void* IBISHELPER_getTypedColumn(IBISStruct *ibis, int col, char fmt);
+
+/* sets column col from the nr doubles of buf,   */
+/* as IBISHELPER_setDouble does for each row     */
+/*                                               */
+/* col starts offset at 0 not 1                  */
+void IBISHELPER_setDoubleColumn(IBISStruct *ibis, int col, double *buf);
+
 /* gets the formats                              */
 void IBISHELPER_getFormats(IBISStruct *ibis, char formats[MAXCOLS][30]);
 
@@ -129,6 +175,37 @@ void IBISHELPER_setDouble(IBISStruct *ibis, int col, int index, double data);
 /* col and index start offset at 0 not 1         */
 void IBISHELPER_setString(IBISStruct *ibis, int col, int index, char *str);
 
+/* opens the ibis file for read or update like  */
+/* IBISHELPER_openIBIS, but reads no data; rows  */
+/* are held chunkRows at a time                  */
+IBISStream* IBISHELPER_openIBISStream(char *name, int instance, char *mode, int chunkRows);
+
+/* creates and opens the nr row output ibis file */
+/* of the out parameter; rows are written        */
+/* chunkRows at a time                           */
+IBISStream* IBISHELPER_openIBISStream_out(char **format, int inst, int nr, int nc, int chunkRows);
+
+/* reads the rows from startRow on into the      */
+/* chunk and returns how many were read (0 past  */
+/* the end of the file)                          */
+/*                                               */
+/* startRow starts offset at 0 not 1             */
+int IBISHELPER_readIBISChunk(IBISStream *stream, int startRow);
+
+/* zeroes the chunk to be set as the rows from   */
+/* startRow on and returns how many it holds     */
+/*                                               */
+/* startRow starts offset at 0 not 1             */
+int IBISHELPER_newIBISChunk(IBISStream *stream, int startRow);
+
+/* writes the chunk back to its rows of the file */
+void IBISHELPER_writeIBISChunk(IBISStream *stream);
+
+/* closes the file and deletes the stream; a     */
+/* chunk not written with                        */
+/* IBISHELPER_writeIBISChunk is discarded        */
+void IBISHELPER_closeIBISStream(IBISStream **stream);
+
 /* creates an output ibis file based on the out  */
 /* parameter and returns an ibis struct          */
 /* creates a new file but does not IBISFileOpen  */
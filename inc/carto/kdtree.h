@@ -0,0 +1,43 @@
+#ifndef KDTREE
+#define KDTREE
+
+/*----------------*/
+/* Static k-d tree over n points of dimension dim, stored    */
+/* as an implicit balanced tree: node i of a range [lo,hi)   */
+/* is at mid = (lo+hi)/2, with [lo,mid) to its left and      */
+/* [mid+1,hi) to its right, split on splitDim[mid].          */
+typedef struct
+{
+   int dim, n;
+
+   // pts[i*dim+j] - coordinate j of the i'th point in tree order
+   // index[i]     - caller's index of the i'th point in tree order
+   // splitDim[i]  - dimension split at node i (-1 for leaves)
+   double *pts;
+   int *index, *splitDim;
+}KdTree;
+
+/* Optional filter for KDTREE_knn. Points for which skip     */
+/* returns nonzero are not reported.                         */
+typedef int (*KdTreeSkip)(void *arg, int index);
+
+/*----------------*/
+
+/* This builds a tree over the points pts[i*dim+j],         */
+/* i = 0..n-1. The points are copied, and the results of    */
+/* queries are in terms of i.                               */
+KdTree* KDTREE_build(double *pts, int n, int dim);
+
+/* This frees up the KdTree struct                          */
+void KDTREE_delete(KdTree *tree);
+
+/* This finds the k points nearest to query (Euclidean)     */
+/* that are not skipped, and stores their indices into      */
+/* idx and, if dist2 is not NULL, their squared distances   */
+/* into dist2, nearest first. Equal distances are ordered   */
+/* by index. skip may be NULL. Returns the number found,    */
+/* which is less than k only if fewer points qualify.       */
+int KDTREE_knn(KdTree *tree, double *query, int k, KdTreeSkip skip, void *skipArg,
+               int *idx, double *dist2);
+
+#endif
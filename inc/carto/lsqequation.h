@@ -3,15 +3,27 @@
 
 #include "carto/cartoLsqUtils.h"
 
+/* xpar holds the design matrix in one block, in the   */
+/* layout its solver takes: by column (column ix at     */
+/* xpar + ix*nRecs) for lsqfit, or by row (row i at     */
+/* xpar + i*xcnt) for the weighted GSL solve.           */
 typedef struct
 {
    double *ypar, *sol, *res;
-   double **xpar;
-   int lsqErr, xcnt, nRecs;
+   double *xpar;
+   int lsqErr, xcnt, nRecs, maxRecs;
+
+   /* workspace for lsqfit, which destroys its input */
+   double *xwork, *ywork;
 
    /* variables used by weighted fitting */
    int weight;
    double *weights, chisq, **cov;
+
+   /* GSL workspace, (re)allocated only when nRecs     */
+   /* changes (gsl types are opaque here)              */
+   void *gslWork;
+   int gslRecs;
 }LsqEquation;
 /*----------------*/
 
@@ -23,13 +35,22 @@ LsqEquation* LSQEQUATION_getEquation(int xcnt, int nRows, int weight);
 /* This funtion frees up the LsqEquation struct       */
 void LSQEQUATION_deleteEquation(LsqEquation* eq);
 
+/* This changes the number of records used, so that  */
+/* one LsqEquation can be reused as a workspace for   */
+/* problems of different sizes. nRecs must not exceed */
+/* the nRows it was created with. Since xpar is       */
+/* packed by nRecs, the x, y and weight data must be  */
+/* set again afterwards.                              */
+void LSQEQUATION_setNRecs(LsqEquation *eq, int nRecs);
+
 /* This copies the data in buf into eq->ypar          */
 void LSQEQUATION_setYPar(LsqEquation *eq, double *buf, int nRecs);
 
 /* This copies the data in buf into eq->weights       */
 void LSQEQUATION_setWeightPar(LsqEquation *eq, double *buf, int nRecs);
 
-/* This copies the data in buf into (eq->xpar)[ix]    */
+/* This copies the data in buf into column ix of the  */
+/* design matrix in eq->xpar                          */
 void LSQEQUATION_setXPar(LsqEquation *eq, double *buf, int ix, int nRecs);
 
 void LSQEQUATION_solve(LsqEquation *eq);
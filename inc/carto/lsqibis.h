@@ -3,6 +3,8 @@
 
 #include "carto/ibishelper.h"
 #include "carto/lsqequation.h"
+#include "carto/kdtree.h"
+#include "carto/lsqincremental.h"
 
 /*----------------*/
 typedef struct
@@ -35,6 +37,12 @@ typedef struct
    float *controlID;
    double ***controlSol;
 
+   // controlTrees - k-d tree over the x columns of each control, built
+   //      on first use by LSQIBIS_passesLocalFit; point i of
+   //      controlTrees[c] is control2IBIS[c][i]
+
+   KdTree **controlTrees;
+
    IBISStruct *ibisfile;
 }LsqIbis;
 
@@ -45,6 +53,20 @@ void LSQIBIS_deleteLsqIbis(LsqIbis *ibis);
 LsqEquation* LSQIBIS_getLsqEquation(LsqIbis *ibis, int icontrol, int iy, int includeOutliers);
 void LSQIBIS_solveControl(LsqIbis *ibis, int icontrol, int includeOutliers);
 void LSQIBIS_solveAll(LsqIbis *ibis, int includeOutliers);
+
+/* Solves the controls concurrently on nthreads threads      */
+/* (get_thread_count() if nthreads <= 0), with results equal */
+/* to LSQIBIS_solveAll.                                      */
+void LSQIBIS_solveAllThreaded(LsqIbis *ibis, int includeOutliers, int nthreads);
+/* Incremental alternative to calling LSQIBIS_solveControl  */
+/* after each throwout: build the fit of a control once,     */
+/* then each LSQIBIS_throwoutIncremental removes one row in  */
+/* O((xcnt+ycnt)^2) and LSQIBIS_solveControlIncremental      */
+/* stores the solution, residuals and distances.             */
+LsqIncremental* LSQIBIS_getIncremental(LsqIbis *ibis, int icontrol, int includeThrowout);
+void LSQIBIS_throwoutIncremental(LsqIbis *ibis, LsqIncremental *inc, int row);
+void LSQIBIS_solveControlIncremental(LsqIbis *ibis, LsqIncremental *inc, int icontrol, int includeThrowout);
+
 int LSQIBIS_passesLocalFit(LsqIbis *ibis, int row, int npts, int includeThrowout);
 void LSQIBIS_writeToIBIS(LsqIbis *ibis, int throwout);
 
@@ -0,0 +1,50 @@
+#ifndef LSQINCREMENTAL
+#define LSQINCREMENTAL
+
+/*----------------*/
+/* Least squares fit that can add, remove and reweight rows */
+/* without refitting. It keeps the upper triangular         */
+/* Cholesky factor r of [X Y]'W[X Y] (equivalently the R of */
+/* a QR factorization of sqrt(W)[X Y]), where X has xcnt    */
+/* columns and Y holds ycnt right hand sides. Each change   */
+/* of a row is a rank one update or downdate of r costing   */
+/* O((xcnt+ycnt)^2), and each solve is a back substitution. */
+typedef struct
+{
+   int xcnt, ycnt, n;   // n = xcnt + ycnt, the order of r
+   int nRecs;           // rows currently in the fit
+   double *r;           // r[i*n+j], upper triangle
+   double *work;        // 2*n scratch
+}LsqIncremental;
+
+/*----------------*/
+
+/* This returns a new LsqIncremental with no rows.          */
+LsqIncremental* LSQINCREMENTAL_get(int xcnt, int ycnt);
+
+/* This frees up the LsqIncremental struct                  */
+void LSQINCREMENTAL_delete(LsqIncremental *inc);
+
+/* This adds a row with xcnt x values, ycnt y values and    */
+/* weight w (1 for an unweighted fit).                      */
+void LSQINCREMENTAL_addRow(LsqIncremental *inc, double *x, double *y, double w);
+
+/* This removes a row previously added with the same x, y   */
+/* and w. Returns 0, or 1 if the downdate breaks down       */
+/* (the row was not in the fit, or the remaining rows are   */
+/* too close to rank deficient to downdate accurately), in  */
+/* which case inc is left unchanged and should be rebuilt.  */
+int LSQINCREMENTAL_removeRow(LsqIncremental *inc, double *x, double *y, double w);
+
+/* This changes the weight of a row in the fit from wOld to */
+/* wNew. Returns as LSQINCREMENTAL_removeRow.               */
+int LSQINCREMENTAL_reweightRow(LsqIncremental *inc, double *x, double *y, double wOld, double wNew);
+
+/* This solves for right hand side iy into sol (xcnt        */
+/* values) and returns 0, or 1 if the fit is singular to    */
+/* within eps relative to its largest pivot (as the eps of  */
+/* lsqfit). If chisq is not NULL it gets the weighted sum   */
+/* of squared residuals.                                    */
+int LSQINCREMENTAL_solve(LsqIncremental *inc, int iy, double eps, double *sol, double *chisq);
+
+#endif
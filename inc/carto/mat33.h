@@ -9,6 +9,7 @@ int mat33_transpose(double *A, double *B);
 double mat33_xtax(double *X, double *A);
 double mat33_xtay(double *X, double *A, double *Y);
 int mat33_vec31_mult(double *A, double *V, double *B);
+int mat33_vec31_mult_n(double *A, int n, double *V, double *B);
 int vec31_add(double *A, double *B, double *C);
 int vec31_assign(double *V, double v0, double v1, double v2);
 int vec31_copy(double *A, double *B);
@@ -5,5 +5,7 @@ int rodrigues_to_quaternion(double *v, double *q);
 int quaternion_to_rodrigues(double *q, double *v);
 int quaternion_to_mat(double *q, double *R);
 int mat_to_quaternion(double *R, double *q);
+int quaternion_to_mat_n(int n, double *Q, double *R);
+int mat_to_quaternion_n(int n, double *R, double *Q);
 
 #endif
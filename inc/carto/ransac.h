@@ -0,0 +1,53 @@
+#ifndef __RANSAC_H
+#define __RANSAC_H
+
+/* Fit a model to the n points idx[0..n-1] of data, storing it in model.
+   Called with n = sample_size for hypotheses and with larger n to refine
+   a consensus set, possibly from several threads at once. Return OK, or
+   ERR if the points do not determine a model. */
+typedef int (*ransac_fit_func)(void *data, int n, int *idx, double *model);
+
+/* Return the squared residual of point i under model. */
+typedef double (*ransac_residual_func)(void *data, int i, double *model);
+
+typedef struct {
+  void                 *data;
+  int                  n_points;
+  int                  sample_size;   /* points in a minimal sample      */
+  int                  model_size;    /* doubles in a model              */
+  ransac_fit_func      fit;
+  ransac_residual_func residual;
+} RANSAC_PROBLEM;
+
+typedef struct {
+  double        threshold;    /* inlier bound on the squared residual  */
+  double        confidence;   /* of having drawn an outlier-free sample */
+  int           max_iter;     /* upper bound on hypotheses             */
+  int           msac;         /* 1 = MSAC (truncated) cost, 0 = count  */
+  int           refine_iter;  /* refits of the consensus set           */
+  unsigned int  seed;
+  int           nthreads;     /* 0 = get_thread_count()                */
+} RANSAC_PARAMS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ransac_default_params(RANSAC_PARAMS *par);
+int ransac(RANSAC_PROBLEM *prob, RANSAC_PARAMS *par, double *model,
+           char *inlier, int *n_inlier_adr, int *n_iter_adr);
+
+int ransac_affine_projection(int n, double *xyz, double *uv, RANSAC_PARAMS *par,
+           double *P, char *inlier, int *n_inlier_adr);
+int ransac_lsqfit(int m, int n, double *a, double *r, RANSAC_PARAMS *par,
+           double *x, char *inlier, int *n_inlier_adr);
+int ransac_wpp_camera(int n, double *xyz, double *uv, RANSAC_PARAMS *par,
+           double *P, double *m_adr, double *q_adr, double *tau_adr,
+           double *theta_adr, double *phi_adr, double *psi_adr,
+           double *bu_adr, double *bv_adr, char *inlier, int *n_inlier_adr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __RAY_INTERSECT_DEM_H
+#define __RAY_INTERSECT_DEM_H
+
+#include "carto/earth_coordinates.h"
+
+typedef struct
+{
+  int               nr, nc;      /* number of posts (rows, columns) */
+  double            lat0, lon0;  /* geodetic lat, lon of post (0,0) in decimal degrees */
+  double            dlat, dlon;  /* post spacing in decimal degrees */
+  float             *h;          /* (nr X nc) heights above the ellipsoid (not owned) */
+  double            hmin_all;    /* min of h */
+  double            hmax_all;    /* max of h */
+  int               nlevels;     /* number of levels in the max-height pyramid */
+  int               *lnr, *lnc;  /* cells per level (rows, columns) */
+  float             **hmax;      /* per level, (lnr X lnc) max heights */
+  float             *slope;      /* per level 0 cell, max terrain slope (m/m) over it and its neighbors */
+  ellipsoid_struct  *ellipsoid;
+} dem_struct;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int define_dem(int nr, int nc, double lat0, double lon0, double dlat, double dlon, float *h, dem_struct **dem_adr);
+int free_dem(dem_struct *dem);
+double dem_height(dem_struct *dem, double lat, double lon);
+int ray_intersect_dem(dem_struct *dem, double *t, double *d, double *p, double *LLH);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
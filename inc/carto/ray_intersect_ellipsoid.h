@@ -3,5 +3,7 @@
 
 int ray_intersect_ellipsoid(double *t, double *d, double *p0, double *SigmaInv, double *p);
 int ray_intersect_ca_ellipsoid(double *t, double *d, double *s, double *p);
+int ray_intersect_ca_ellipsoid_n(int n, double *t, double *dx, double *dy, double *dz, double *s,
+    double *px, double *py, double *pz, int *status);
 
 #endif
@@ -3,5 +3,7 @@
 
 int rodrigues_vec2mat(double *wrot, double *R);
 int rodrigues_mat2vec(double *R, double *wrot);
+int rodrigues_vec2mat_n(int n, double *W, double *R);
+int rodrigues_mat2vec_n(int n, double *R, double *W);
 
 #endif
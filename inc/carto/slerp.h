@@ -3,5 +3,6 @@
 
 int qslerp(double *a, double *b, double t, double *c);
 int slerp(int n, double *a, double *b, double t, double *c);
+int qslerp_n(int n, double *A, double *B, double *t, double *C);
 
 #endif
@@ -0,0 +1,20 @@
+#ifndef __THREAD_MANAGER_H
+#define __THREAD_MANAGER_H
+
+#include <stddef.h>
+
+#define THREAD_MANAGER_MAX_THREADS 256
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int get_thread_count(void);
+void set_thread_count(int count);
+void run_threads(int nthreads, void *(*func)(void *), void *args, size_t argsize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __THREAD_MANAGER_H */
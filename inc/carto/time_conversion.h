@@ -18,12 +18,15 @@ int acs_to_tt_and_ut1(double ACS, double Delta_UT1, double *TT_adr, double *UT1_
 int acs_to_tt(double ACS_time, double *TT_adr);
 int acs_to_ut1(double ACS_time, double Delta_UT1, double *UT1_adr);
 int acs_to_utc_iso_time_string(double ACS, char **UTC_string_adr);
+int acs_to_tt_and_ut1_n(int n, double *ACS_time, double Delta_UT1, double *TT, double *UT1);
+int acs_to_tt_n(int n, double *ACS_time, double *TT);
 
 /* From SI */
 int si_to_tt_and_ut1(double SI, double Delta_UT1, double *TT_adr, double *UT1_adr);
 int si_to_tt(double SI, double *TT_adr);
 int si_to_ut1(double SI, double Delta_UT1, double *UT1_adr);
 int si_to_utc_iso_time_string(double SI, char **UTC_string_adr);
+int si_to_tt_n(int n, double *SI, double *TT);
 
 /* From TT_ISO_TIME_STRING */
 int tt_iso_time_string_to_tt(char *TT_string, double *TT_adr);
@@ -34,9 +37,12 @@ int tt_to_utc_iso_time_string(double UTC, char **UTC_string_adr);
 int tt_to_si(double TT, double *SI_adr);
 int tt_to_ut1(double TT, double Delta_UT1, double *UT1_adr);
 int tt_to_tdb(double TT, double *TDB_adr);
+int tt_to_tdb_n(int n, double *TT, double *TDB);
 
 /* Helper functions */
 int lookup_delta_ut1(char *fname, int yyyymmdd, double *Delta_UT1_adr);
+int interpolate_delta_ut1(char *fname, int yyyymmdd, double day_fraction, double *Delta_UT1_adr);
+int initialize_delta_ut1_table(char *fname);
 int initialize_leap_second_table(char *filename);
 
 #endif
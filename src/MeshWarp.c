@@ -0,0 +1,452 @@
+#include <zvproto.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "carto/MeshWarp.h"
+#include "carto/thread_manager.h"
+
+/******************************************************************************/
+/* input lines are held in a ring, line L in slot L % cap                     */
+/******************************************************************************/
+typedef struct
+{
+   MESH_WARP *mw;
+   double **ring;
+   int *tag;
+   int cap;
+   int in_nl, in_ns, out_ns, mode;
+
+   int l0, l1;           // output lines of the strip, from 1
+   int next;             // next line of the strip to warp
+   double *out;          // (l1-l0+1) lines of out_ns
+   pthread_mutex_t lock;
+}MW_STRIP;
+
+typedef struct
+{
+   MW_STRIP *strip;
+}MW_WORKER;
+
+/******************************************************************************/
+MESH_WARP* getMeshWarp(int npts, double *out_l, double *out_s, double *in_l, double *in_s,
+                       int ntri, int *tcon1, int *tcon2, int *tcon3, int nl)
+{
+   int i, j, k, t, r, r0, r1, v[3], *fill;
+   double d, dl2, ds2, dl3, ds3, *c;
+   MESH_WARP *mw;
+
+   assert(nl > 0);
+
+   mw = (MESH_WARP*)malloc(sizeof(MESH_WARP));
+   mw->ol = (double*)malloc(sizeof(double)*3*(ntri+1));
+   mw->os = (double*)malloc(sizeof(double)*3*(ntri+1));
+   mw->coef = (double*)malloc(sizeof(double)*6*(ntri+1));
+   mw->lmin = (double*)malloc(sizeof(double)*(ntri+1));
+   mw->lmax = (double*)malloc(sizeof(double)*(ntri+1));
+   mw->smin = (double*)malloc(sizeof(double)*(ntri+1));
+   mw->smax = (double*)malloc(sizeof(double)*(ntri+1));
+
+   // solve the affine map of each triangle from its vertices
+   t = 0;
+   for(i = 0; i < ntri; i++)
+   {
+      v[0] = tcon1[i]-1;
+      v[1] = tcon2[i]-1;
+      v[2] = tcon3[i]-1;
+      assert(v[0] >= 0 && v[0] < npts && v[1] >= 0 && v[1] < npts && v[2] >= 0 && v[2] < npts);
+
+      dl2 = out_l[v[1]] - out_l[v[0]];
+      ds2 = out_s[v[1]] - out_s[v[0]];
+      dl3 = out_l[v[2]] - out_l[v[0]];
+      ds3 = out_s[v[2]] - out_s[v[0]];
+      d = dl2*ds3 - dl3*ds2;
+      if(d == 0.0) continue;
+
+      c = mw->coef + 6*t;
+      c[1] = ((in_l[v[1]]-in_l[v[0]])*ds3 - (in_l[v[2]]-in_l[v[0]])*ds2)/d;
+      c[2] = (dl2*(in_l[v[2]]-in_l[v[0]]) - dl3*(in_l[v[1]]-in_l[v[0]]))/d;
+      c[0] = in_l[v[0]] - c[1]*out_l[v[0]] - c[2]*out_s[v[0]];
+      c[4] = ((in_s[v[1]]-in_s[v[0]])*ds3 - (in_s[v[2]]-in_s[v[0]])*ds2)/d;
+      c[5] = (dl2*(in_s[v[2]]-in_s[v[0]]) - dl3*(in_s[v[1]]-in_s[v[0]]))/d;
+      c[3] = in_s[v[0]] - c[4]*out_l[v[0]] - c[5]*out_s[v[0]];
+
+      mw->lmin[t] = mw->lmax[t] = out_l[v[0]];
+      mw->smin[t] = mw->smax[t] = out_s[v[0]];
+      for(j = 0; j < 3; j++)
+      {
+         mw->ol[3*t+j] = out_l[v[j]];
+         mw->os[3*t+j] = out_s[v[j]];
+         if(out_l[v[j]] < mw->lmin[t]) mw->lmin[t] = out_l[v[j]];
+         if(out_l[v[j]] > mw->lmax[t]) mw->lmax[t] = out_l[v[j]];
+         if(out_s[v[j]] < mw->smin[t]) mw->smin[t] = out_s[v[j]];
+         if(out_s[v[j]] > mw->smax[t]) mw->smax[t] = out_s[v[j]];
+      }
+      t++;
+   }
+   mw->ntri = t;
+
+   // list the triangles crossing each row of output lines (count, then fill)
+   mw->nl = nl;
+   mw->nrow = (nl + MW_ROW_NL - 1)/MW_ROW_NL;
+   mw->row_start = (int*)calloc(mw->nrow+1, sizeof(int));
+   fill = (int*)malloc(sizeof(int)*mw->nrow);
+   mw->row_tri = NULL;
+   for(k = 0; k < 2; k++)
+   {
+      for(t = 0; t < mw->ntri; t++)
+      {
+         if(mw->lmax[t] < 1.0 || mw->lmin[t] > (double)nl) continue;
+         r0 = mw->lmin[t] < 1.0 ? 0 : ((int)ceil(mw->lmin[t])-1)/MW_ROW_NL;
+         r1 = mw->lmax[t] > (double)nl ? mw->nrow-1 : ((int)floor(mw->lmax[t])-1)/MW_ROW_NL;
+         for(r = r0; r <= r1; r++)
+         {
+            if(k == 0) mw->row_start[r+1]++;
+            else mw->row_tri[fill[r]++] = t;
+         }
+      }
+
+      if(k == 0)
+      {
+         for(r = 0; r < mw->nrow; r++) mw->row_start[r+1] += mw->row_start[r];
+         for(r = 0; r < mw->nrow; r++) fill[r] = mw->row_start[r];
+         mw->row_tri = (int*)malloc(sizeof(int)*(mw->row_start[mw->nrow]+1));
+      }
+   }
+   free(fill);
+
+   return mw;
+}
+
+/******************************************************************************/
+void deleteMeshWarp(MESH_WARP **mw)
+{
+   if(*mw == NULL) return;
+
+   free((*mw)->ol);
+   free((*mw)->os);
+   free((*mw)->coef);
+   free((*mw)->lmin);
+   free((*mw)->lmax);
+   free((*mw)->smin);
+   free((*mw)->smax);
+   free((*mw)->row_start);
+   free((*mw)->row_tri);
+
+   free(*mw);
+   *mw = NULL;
+}
+
+/******************************************************************************/
+/* Input lines [*i0, *i1] (from 1) that output lines l0..l1 map onto, with    */
+/* the margin the resampling needs. *i0 > *i1 if nothing maps.                */
+/******************************************************************************/
+void getMeshWarpInputRange(MW_STRIP *st, int l0, int l1, int *i0, int *i1)
+{
+   int r, k, t, j;
+   double lo, hi, slo, shi, l, s, L, minL, maxL, *c;
+   MESH_WARP *mw;
+
+   mw = st->mw;
+   minL = 1.e300;
+   maxL = -1.e300;
+   for(r = (l0-1)/MW_ROW_NL; r <= (l1-1)/MW_ROW_NL; r++)
+      for(k = mw->row_start[r]; k < mw->row_start[r+1]; k++)
+      {
+         t = mw->row_tri[k];
+         lo = mw->lmin[t] > l0 ? mw->lmin[t] : l0;
+         hi = mw->lmax[t] < l1 ? mw->lmax[t] : l1;
+         slo = mw->smin[t] > 1.0 ? mw->smin[t] : 1.0;
+         shi = mw->smax[t] < st->out_ns ? mw->smax[t] : st->out_ns;
+         if(lo > hi || slo > shi) continue;
+
+         // the band of the triangle lies in this box, so the corners bound it
+         c = mw->coef + 6*t;
+         for(j = 0; j < 4; j++)
+         {
+            l = j < 2 ? lo : hi;
+            s = j%2 ? shi : slo;
+            L = c[0] + c[1]*l + c[2]*s;
+            if(L < minL) minL = L;
+            if(L > maxL) maxL = L;
+         }
+      }
+
+   if(minL > maxL || maxL < 0.0 || minL > st->in_nl + 1.0)
+   {
+      *i0 = 1;
+      *i1 = 0;
+      return;
+   }
+
+   *i0 = (int)floor(minL) - 1;
+   *i1 = (int)floor(maxL) + 2;
+   if(*i0 < 1) *i0 = 1;
+   if(*i1 > st->in_nl) *i1 = st->in_nl;
+}
+
+/******************************************************************************/
+/* Keys cubic convolution weights (a = -0.5) for offset f in [0,1)            */
+/******************************************************************************/
+void getMeshWarpCubicWeights(double f, double *w)
+{
+   double g;
+
+   g = 1.0 - f;
+   w[0] = -0.5*f*g*g;
+   w[1] = 1.0 + f*f*(1.5*f - 2.5);
+   w[2] = 1.0 + g*g*(1.5*g - 2.5);
+   w[3] = -0.5*g*f*f;
+}
+
+/******************************************************************************/
+/* Input pixel value at (L, S), from 1, or 0 outside the input                */
+/******************************************************************************/
+double getMeshWarpSamp(MW_STRIP *st, double L, double S)
+{
+   int i, j, li, si, ll, ss;
+   double fl, fs, wl[4], ws[4], val, rowval, *p;
+
+   if(L < 0.5 || S < 0.5 || L >= st->in_nl + 0.5 || S >= st->in_ns + 0.5) return 0.0;
+
+   if(st->mode == IU_NEAR_NEIGHBOR)
+   {
+      li = (int)(L + 0.5);
+      si = (int)(S + 0.5);
+      return st->ring[li%st->cap][si-1];
+   }
+
+   li = (int)floor(L);
+   si = (int)floor(S);
+   fl = L - li;
+   fs = S - si;
+
+   if(st->mode == IU_BICUBIC_INTERP)
+   {
+      getMeshWarpCubicWeights(fl, wl);
+      getMeshWarpCubicWeights(fs, ws);
+      val = 0.0;
+      for(i = 0; i < 4; i++)
+      {
+         ll = li - 1 + i;
+         if(ll < 1) ll = 1;
+         if(ll > st->in_nl) ll = st->in_nl;
+         p = st->ring[ll%st->cap];
+         rowval = 0.0;
+         for(j = 0; j < 4; j++)
+         {
+            ss = si - 1 + j;
+            if(ss < 1) ss = 1;
+            if(ss > st->in_ns) ss = st->in_ns;
+            rowval += ws[j]*p[ss-1];
+         }
+         val += wl[i]*rowval;
+      }
+      return val;
+   }
+
+   // bilinear, holding the edge pixels beyond the border
+   if(li < 1) li = 1, fl = 0.0;
+   if(si < 1) si = 1, fs = 0.0;
+   ll = li < st->in_nl ? li+1 : li;
+   ss = si < st->in_ns ? si+1 : si;
+   p = st->ring[li%st->cap];
+   val = (1.0-fl)*((1.0-fs)*p[si-1] + fs*p[ss-1]);
+   p = st->ring[ll%st->cap];
+   val += fl*((1.0-fs)*p[si-1] + fs*p[ss-1]);
+
+   return val;
+}
+
+/******************************************************************************/
+/* Warps output line l (from 1) into buf, a span per triangle: a pixel is in  */
+/* the triangle if lmin <= l < lmax and its samp is in [sa, sb), so pixels on */
+/* a shared edge go to one triangle. A closing edge on the last output line   */
+/* or samp has no triangle past it, so it is kept (l == lmax, s == sb).      */
+/******************************************************************************/
+void warpMeshLine(MW_STRIP *st, int l, double *buf)
+{
+   int k, t, j, s, s0, s1;
+   double sa, sb, la, lb, x, bl, bs, *c, *ol, *os;
+   MESH_WARP *mw;
+
+   mw = st->mw;
+   memset(buf, 0, sizeof(double)*st->out_ns);
+
+   for(k = mw->row_start[(l-1)/MW_ROW_NL]; k < mw->row_start[(l-1)/MW_ROW_NL+1]; k++)
+   {
+      t = mw->row_tri[k];
+      if(l < mw->lmin[t] || l > mw->lmax[t]) continue;
+      if(l == mw->lmax[t] && l != mw->nl) continue;
+
+      ol = mw->ol + 3*t;
+      os = mw->os + 3*t;
+      sa = 1.e300;
+      sb = -1.e300;
+      for(j = 0; j < 3; j++)
+      {
+         la = ol[j];
+         lb = ol[(j+1)%3];
+         if(la == lb || (l < la && l < lb) || (l > la && l > lb)) continue;
+         x = os[j] + (l - la)*(os[(j+1)%3] - os[j])/(lb - la);
+         if(x < sa) sa = x;
+         if(x > sb) sb = x;
+      }
+      if(sa > sb) continue;
+
+      s0 = sa < 1.0 ? 1 : (int)ceil(sa);
+      s1 = sb >= st->out_ns ? st->out_ns : (int)ceil(sb) - 1;
+
+      c = mw->coef + 6*t;
+      bl = c[0] + c[1]*l;
+      bs = c[3] + c[4]*l;
+      for(s = s0; s <= s1; s++)
+         buf[s-1] = getMeshWarpSamp(st, bl + c[2]*s, bs + c[5]*s);
+   }
+}
+
+/******************************************************************************/
+void* warpMeshWorker(void *arg)
+{
+   int l;
+   MW_STRIP *st;
+
+   st = ((MW_WORKER*)arg)->strip;
+   while(1)
+   {
+      pthread_mutex_lock(&(st->lock));
+      l = st->next++;
+      pthread_mutex_unlock(&(st->lock));
+      if(l > st->l1) break;
+
+      warpMeshLine(st, l, st->out + (long)(l - st->l0)*st->out_ns);
+   }
+
+   return NULL;
+}
+
+/******************************************************************************/
+/* Enlarges the ring to at least cap lines (with a quarter more, as a single  */
+/* line needing more is likely to be followed by others), keeping the lines   */
+/* it holds where their new slots allow.                                      */
+/******************************************************************************/
+void growMeshWarpRing(MW_STRIP *st, int cap)
+{
+   int i, slot, newcap, *tag;
+   double **ring;
+
+   newcap = cap + cap/4;
+   if(newcap > st->in_nl) newcap = st->in_nl;
+
+   ring = (double**)calloc(newcap, sizeof(double*));
+   tag = (int*)malloc(sizeof(int)*newcap);
+   for(i = 0; i < newcap; i++) tag[i] = -1;
+   for(i = 0; i < st->cap; i++)
+   {
+      slot = st->tag[i] < 0 ? -1 : st->tag[i]%newcap;
+      if(slot >= 0 && ring[slot] == NULL)
+      {
+         ring[slot] = st->ring[i];
+         tag[slot] = st->tag[i];
+      }
+      else free(st->ring[i]);
+   }
+   for(i = 0; i < newcap; i++)
+      if(ring[i] == NULL) ring[i] = (double*)malloc(sizeof(double)*st->in_ns);
+
+   free(st->ring);
+   free(st->tag);
+   st->ring = ring;
+   st->tag = tag;
+   st->cap = newcap;
+}
+
+/******************************************************************************/
+void warpVicarImage(MESH_WARP *mw, VICAR_IMAGE *from, VICAR_IMAGE *to,
+                    int resample_mode, int buffer_nl, int nthreads)
+{
+   int i, n, l, L, strip_nl, i0, i1, status;
+   MW_STRIP st;
+   MW_WORKER *workers;
+
+   assert(to->nl == mw->nl);
+   if(resample_mode != IU_NEAR_NEIGHBOR && resample_mode != IU_BILINEAR_INTERP &&
+      resample_mode != IU_BICUBIC_INTERP)
+   {
+      printf("\n!!!WARPING FROM %s TO %s: INVALID RESAMPLE MODE SPECIFIED!!!\n",
+             from->fname, to->fname);
+      zabend();
+   }
+
+   if(nthreads < 1) nthreads = get_thread_count();
+   if(buffer_nl < 1) buffer_nl = MW_BUFFER_NL;
+   strip_nl = MW_STRIP_NL*nthreads;
+
+   st.mw = mw;
+   st.in_nl = from->nl;
+   st.in_ns = from->ns;
+   st.out_ns = to->ns;
+   st.mode = resample_mode;
+   st.cap = buffer_nl < from->nl ? buffer_nl : from->nl;
+   st.ring = (double**)malloc(sizeof(double*)*st.cap);
+   st.tag = (int*)malloc(sizeof(int)*st.cap);
+   for(i = 0; i < st.cap; i++)
+   {
+      st.ring[i] = (double*)malloc(sizeof(double)*from->ns);
+      st.tag[i] = -1;
+   }
+   st.out = (double*)malloc(sizeof(double)*strip_nl*to->ns);
+   pthread_mutex_init(&(st.lock), NULL);
+
+   workers = (MW_WORKER*)malloc(sizeof(MW_WORKER)*nthreads);
+   for(i = 0; i < nthreads; i++) workers[i].strip = &st;
+
+   for(l = 1; l <= to->nl; l = st.l1 + 1)
+   {
+      // halve the strip until its input fits the buffer
+      n = strip_nl;
+      while(1)
+      {
+         st.l0 = l;
+         st.l1 = l + n - 1 < to->nl ? l + n - 1 : to->nl;
+         getMeshWarpInputRange(&st, st.l0, st.l1, &i0, &i1);
+         if(i1 - i0 < st.cap || n == 1) break;
+         n /= 2;
+      }
+
+      // one output line may need more than the bound
+      if(i1 - i0 >= st.cap) growMeshWarpRing(&st, i1 - i0 + 1);
+
+      for(L = i0; L <= i1; L++)
+      {
+         if(st.tag[L%st.cap] == L) continue;
+         status = zvread(from->unit, st.ring[L%st.cap], "LINE", L, NULL);
+         if(status != 1)
+         {
+            printf("Problem reading line %d in file %s -- error status: %d.\n",
+                   L, from->fname, status);
+            zabend();
+         }
+         st.tag[L%st.cap] = L;
+      }
+
+      st.next = st.l0;
+      run_threads(nthreads, warpMeshWorker, (void*)workers, sizeof(MW_WORKER));
+
+      for(i = st.l0; i <= st.l1; i++)
+      {
+         memcpy(to->buffer, st.out + (long)(i - st.l0)*to->ns, sizeof(double)*to->ns);
+         writeVicarImageLine(to, i-1);
+      }
+   }
+
+   pthread_mutex_destroy(&(st.lock));
+   free(workers);
+   free(st.out);
+   for(i = 0; i < st.cap; i++) free(st.ring[i]);
+   free(st.ring);
+   free(st.tag);
+}
@@ -15,19 +15,33 @@
                 peph[4] <= t <= seph[4]
                 patt[4] <= t <= satt[4] 
 
+             The atteph_table functions hold a whole time series of ephemeris
+               and attitude records (same 5-element layout as above) and
+               evaluate it at many times at once, finding the bracketing
+               samples themselves. Results are returned as separate arrays
+               per component.
+
   History:  
 
 *******************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "carto/burl.h"
+#include "carto/qmalloc.h"
 #include "carto/slerp.h"
 #include "carto/quaternion.h"
 #include "carto/atteph_convert.h"
 
 #define ATTEPH_EPS 1e-12
 
+/* A cursor this many samples or fewer from the answer is walked; farther */
+/*   than that, the bracket is found by binary search */
+#define ATTEPH_WALK 8
+
+static int atteph_bracket(double *tt, int n, double t, int cursor);
+
 /***********************/
 /* ATTEPH_CONVERT8     */
 /***********************/
@@ -107,3 +121,235 @@ int atteph_convert6(double *peph, double *patt, double *seph, double *satt, doub
   
   return(OK);
 }
+
+/***********************/
+/* ATTEPH_TABLE_CREATE */
+/***********************/
+/* Build a table from neph ephemeris records eph (neph X 5) and natt attitude
+   records att (natt X 5), each in the layout used by atteph_convert8, with
+   the times (element 4) strictly increasing. If evel is not NULL it holds
+   (neph X 3) velocities, and position is interpolated by a cubic Hermite
+   polynomial between the bracketing records; otherwise it is interpolated by
+   a Lagrange polynomial through order (>= 2) records around t, so order = 2
+   gives the linear interpolation of atteph_convert8. Attitude is always
+   interpolated with qslerp between the bracketing records. The records are
+   copied into the table. */
+
+int atteph_table_create(int neph, double *eph, double *evel, int natt, double *att, int order, atteph_table_struct **table_adr)
+{
+  atteph_table_struct  *T;
+  int                  k;
+  char                 infunc[] = "atteph_table_create";
+
+  *table_adr = NULL;
+  if ((neph < 2) || (natt < 2)) {
+    fprintf(stderr, "ERROR (%s): need at least 2 ephemeris and 2 attitude records\n", infunc);
+    return(ERR);
+  }
+  if ((order < 2) || (order > neph)) {
+    fprintf(stderr, "ERROR (%s): bad interpolation order %d (have %d records)\n", infunc, order, neph);
+    return(ERR);
+  }
+  for (k = 1; k < neph; k++) {
+    if (eph[k*5+4] <= eph[(k-1)*5+4]) {
+      fprintf(stderr, "ERROR (%s): ephemeris times not increasing at record %d\n", infunc, k);
+      return(ERR);
+    }
+  }
+  for (k = 1; k < natt; k++) {
+    if (att[k*5+4] <= att[(k-1)*5+4]) {
+      fprintf(stderr, "ERROR (%s): attitude times not increasing at record %d\n", infunc, k);
+      return(ERR);
+    }
+  }
+
+  T = (atteph_table_struct *) qmalloc(1, sizeof(atteph_table_struct), 1, infunc, "T");
+  if (T == NULL) {
+    return(ERR);
+  }
+  T->neph = neph;
+  T->natt = natt;
+  T->order = order;
+  T->eph = (double *) qmalloc((size_t) neph * ((evel != NULL) ? 7 : 4), sizeof(double), 0, infunc, "T->eph");
+  T->att = (double *) qmalloc((size_t) natt * 5, sizeof(double), 0, infunc, "T->att");
+  if ((T->eph == NULL) || (T->att == NULL)) {
+    atteph_table_free(T);
+    return(ERR);
+  }
+
+  /* Store component-wise (one array per component) */
+  T->et = T->eph;
+  T->ex = T->et + neph;
+  T->ey = T->ex + neph;
+  T->ez = T->ey + neph;
+  for (k = 0; k < neph; k++) {
+    T->ex[k] = eph[k*5+1];
+    T->ey[k] = eph[k*5+2];
+    T->ez[k] = eph[k*5+3];
+    T->et[k] = eph[k*5+4];
+  }
+  if (evel != NULL) {
+    T->evx = T->ez + neph;
+    T->evy = T->evx + neph;
+    T->evz = T->evy + neph;
+    for (k = 0; k < neph; k++) {
+      T->evx[k] = evel[k*3];
+      T->evy[k] = evel[k*3+1];
+      T->evz[k] = evel[k*3+2];
+    }
+  }
+
+  T->at = T->att;
+  T->aq = T->at + natt;
+  for (k = 0; k < natt; k++) {
+    memcpy(T->aq + k*4, att + k*5, 4*sizeof(double));
+    T->at[k] = att[k*5+4];
+  }
+
+  *table_adr = T;
+  return(OK);
+}
+
+/***********************/
+/* ATTEPH_TABLE_FREE   */
+/***********************/
+int atteph_table_free(atteph_table_struct *T)
+{
+  if (T != NULL) {
+    free((void *) T->eph);
+    free((void *) T->att);
+    free((void *) T);
+  }
+
+  return(OK);
+}
+
+/***********************/
+/* ATTEPH_TABLE_EVAL   */
+/***********************/
+/* Evaluate the table at the n times t. The position at t[k] is returned in
+   (x[k], y[k], z[k]) and the attitude quaternion in (q0[k], q1[k], q2[k],
+   q3[k]). Any of the output arrays may be NULL if not wanted. The search
+   for the bracketing records starts from where the previous time was found,
+   so sorted (or nearly sorted) times, such as the line times of a push-broom
+   scene, cost O(1) each. Returns ERR if any time is outside the table (the
+   outputs for the other times are still filled in). */
+
+int atteph_table_eval(atteph_table_struct *T, int n, double *t, double *x, double *y, double *z,
+    double *q0, double *q1, double *q2, double *q3)
+{
+  int                  k, i, j, m, i0, ce, ca, status;
+  double               tk, r, h, h00, h10, h01, h11, w, px, py, pz;
+  double               q[4];
+  double               *aq;
+  char                 infunc[] = "atteph_table_eval";
+
+  status = OK;
+  ce = 0;
+  ca = 0;
+  for (k = 0; k < n; k++) {
+    tk = t[k];
+    if ((tk < T->et[0]) || (tk > T->et[T->neph-1]) || (tk < T->at[0]) || (tk > T->at[T->natt-1])) {
+      fprintf(stderr, "ERROR (%s): time %lf outside table\n", infunc, tk);
+      status = ERR;
+      continue;
+    }
+
+    /* Position */
+    ce = i = atteph_bracket(T->et, T->neph, tk, ce);
+    if ((x != NULL) || (y != NULL) || (z != NULL)) {
+      if (T->evx != NULL) {
+        /* Cubic Hermite between records i and i+1 */
+        h = T->et[i+1] - T->et[i];
+        r = (tk - T->et[i])/h;
+        h00 = (D_ONE + D_TWO*r)*(D_ONE-r)*(D_ONE-r);
+        h10 = r*(D_ONE-r)*(D_ONE-r)*h;
+        h01 = r*r*(D_THREE - D_TWO*r);
+        h11 = r*r*(r - D_ONE)*h;
+        px = h00*T->ex[i] + h10*T->evx[i] + h01*T->ex[i+1] + h11*T->evx[i+1];
+        py = h00*T->ey[i] + h10*T->evy[i] + h01*T->ey[i+1] + h11*T->evy[i+1];
+        pz = h00*T->ez[i] + h10*T->evz[i] + h01*T->ez[i+1] + h11*T->evz[i+1];
+      }
+      else {
+        /* Lagrange through order records, centered on the bracket */
+        i0 = i - (T->order/2 - 1);
+        i0 = CLIP(i0, 0, T->neph - T->order);
+        px = py = pz = D_ZERO;
+        for (j = i0; j < i0 + T->order; j++) {
+          w = D_ONE;
+          for (m = i0; m < i0 + T->order; m++) {
+            if (m != j) {
+              w *= (tk - T->et[m])/(T->et[j] - T->et[m]);
+            }
+          }
+          px += w*T->ex[j];
+          py += w*T->ey[j];
+          pz += w*T->ez[j];
+        }
+      }
+      if (x != NULL) x[k] = px;
+      if (y != NULL) y[k] = py;
+      if (z != NULL) z[k] = pz;
+    }
+
+    /* Attitude */
+    if ((q0 != NULL) || (q1 != NULL) || (q2 != NULL) || (q3 != NULL)) {
+      ca = i = atteph_bracket(T->at, T->natt, tk, ca);
+      aq = T->aq + i*4;
+      h = T->at[i+1] - T->at[i];
+      if (h > ATTEPH_EPS) {
+        qslerp(aq, aq+4, (tk - T->at[i])/h, q);
+      }
+      else {
+        memcpy(q, aq, 4*sizeof(double));
+      }
+      if (q0 != NULL) q0[k] = q[0];
+      if (q1 != NULL) q1[k] = q[1];
+      if (q2 != NULL) q2[k] = q[2];
+      if (q3 != NULL) q3[k] = q[3];
+    }
+  }
+
+  return(status);
+}
+
+/***********************/
+/* ATTEPH_BRACKET      */
+/***********************/
+/* Index i (0 <= i <= n-2) with tt[i] <= t <= tt[i+1], for tt increasing and
+   t within [tt[0], tt[n-1]]. The search starts at cursor. */
+
+static int atteph_bracket(double *tt, int n, double t, int cursor)
+{
+  int     i, lo, hi, mid, steps;
+
+  i = CLIP(cursor, 0, n-2);
+  for (steps = 0; steps < ATTEPH_WALK; steps++) {
+    if (t < tt[i]) {
+      i--;
+    }
+    else if (t > tt[i+1]) {
+      i++;
+    }
+    else {
+      return(i);
+    }
+    if ((i < 0) || (i > n-2)) {
+      break;
+    }
+  }
+
+  /* Too far from the cursor; binary search */
+  lo = 0;
+  hi = n-1;
+  while (hi - lo > 1) {
+    mid = (lo + hi)/2;
+    if (tt[mid] <= t) {
+      lo = mid;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return(MIN(lo, n-2));
+}
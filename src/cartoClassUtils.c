@@ -401,7 +401,7 @@ CLASS** CARTOCLASS_loadClassesFromIBIS(IBISStruct *ibis)
       for(j = 0; j < nDim; j++)
       {
          // printf("loadClassesFromIBIS j: %d\n", j);
-         gsl_vector_set(means, j, IBISHELPER_getDouble(ibis, j+3, i));
+         gsl_vector_set(means, j, IBISHELPER_getDoubleColumn(ibis, j+3)[i]);
       }
 
       colIndex = 3 + nDim;
@@ -410,7 +410,7 @@ CLASS** CARTOCLASS_loadClassesFromIBIS(IBISStruct *ibis)
          {
             double cov;
             //            printf("1. ndim: %d colIndex: %d %d %d\n", nDim, colIndex, j, k);
-            cov = IBISHELPER_getDouble(ibis, colIndex++, i);
+            cov = IBISHELPER_getDoubleColumn(ibis, colIndex++)[i];
             //            printf("2. colIndex: %d %d %d\n", colIndex, j, k);
 
             //            printf("cov: %.9lf j: %d k: %d\n", cov, j, k);
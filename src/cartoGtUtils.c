@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <math.h>
 
@@ -49,13 +50,15 @@ arguments:
 int gtgetlab( char * inp, int instance, char ** labelstr, int * nl, int * ns )
 {
    int i,status,geounit;
-   int maxlen,nelement,len;
+   int maxlen,nelement,len,cap,klen,vlen;
    char *buf,valformat[9],vformat[9];
    char svalue[133],key[33];
    
-   /* malloc large temporary buffer for reading the string */
+   /* buffer for the string, doubled as needed; len is kept so
+   each line is appended in place */
    
-   mz_alloc1((unsigned char **)&buf,1000001,1);
+   cap = 4096; len = 0;
+   mz_alloc1((unsigned char **)&buf,cap,1);
    
    /* open file */
    
@@ -63,7 +66,7 @@ int gtgetlab( char * inp, int instance, char ** labelstr, int * nl, int * ns )
    status = zvopen(geounit,"OP","READ","OPEN_ACT","SA",
          "LAB_ACT","SA",NULL);
       
-   strcpy(buf,"");
+   buf[0] = (char)0;
    do
       {
       status=zlninfo(geounit,key,valformat,&maxlen,
@@ -97,10 +100,18 @@ int gtgetlab( char * inp, int instance, char ** labelstr, int * nl, int * ns )
             status=zlget(geounit,"PROPERTY",key,svalue,"ELEMENT",i,
                "ERR_ACT","SA","FORMAT","STRING","NELEMENT",1,
                "PROPERTY","GEOTIFF","ULEN",133,NULL);
-         strcat(buf,key);
-         strcat(buf,"=");
-         strcat(buf,svalue);
-         strcat(buf,"\n");
+         klen = strlen(key);
+         vlen = strlen(svalue);
+         if (len+klen+vlen+3>cap)
+            {
+            while (len+klen+vlen+3>cap) cap *= 2;
+            if ((buf=(char *)realloc(buf,cap))==NULL) zmabend("malloc failed");
+            }
+         memcpy(&buf[len],key,klen); len += klen;
+         buf[len++] = '=';
+         memcpy(&buf[len],svalue,vlen); len += vlen;
+         buf[len++] = '\n';
+         buf[len] = (char)0;
          }
       }
    while (1);
@@ -108,12 +119,171 @@ int gtgetlab( char * inp, int instance, char ** labelstr, int * nl, int * ns )
    
    /* resave in smaller buffer */
    
-   len = strlen(buf);
    if (((*labelstr)=(char *)malloc(len+1))==NULL) zmabend("malloc failed");
-   strcpy(*labelstr,buf);
+   memcpy(*labelstr,buf,len+1);
    
    free(buf);
-   if (strlen(*labelstr)<1) return 0; else return 1;
+   if (len<1) return 0; else return 1;
+}
+
+/*================================================================
+
+gtparselab, gtfreelab, gtlabkey
+
+see cartoGtUtils.h.  The label is copied and split into its
+"KEY=value" lines; keys are uppercased (ms_find, which the
+string versions of the gt* functions used, is case insensitive)
+and hashed to the first line that has them.
+*/
+
+static unsigned int gtlabhash( char * key )
+{
+   unsigned int h;
+   
+   h = 5381;
+   while (*key) h = h*33+(unsigned char)toupper(*key++);
+   return h;
+}
+
+GTLABEL * gtparselab( char * labelstr )
+{
+   int i,nline,h;
+   char *p,*q,*eq;
+   GTLABEL *lab;
+   GTLABENTRY *e;
+   
+   if ((lab=(GTLABEL *)malloc(sizeof(GTLABEL)))==NULL) zmabend("malloc failed");
+   if ((lab->text=(char *)malloc(strlen(labelstr)+1))==NULL) zmabend("malloc failed");
+   strcpy(lab->text,labelstr);
+   
+   nline = 1;
+   for (p=lab->text;*p;p++) if (*p=='\n') nline++;
+   if ((lab->ent=(GTLABENTRY *)malloc(nline*sizeof(GTLABENTRY)))==NULL)
+      zmabend("malloc failed");
+   for (lab->nhash=16;lab->nhash<2*nline;lab->nhash *= 2);
+   if ((lab->hash=(int *)malloc(lab->nhash*sizeof(int)))==NULL)
+      zmabend("malloc failed");
+   for (i=0;i<lab->nhash;i++) lab->hash[i] = -1;
+   
+   /* split the lines, then parse the leading numbers of each value,
+   either a vector "(a,b,...)" or a number before a comment "2(...)" */
+   
+   lab->nent = 0;
+   for (p=lab->text;*p;p=q)
+      {
+      for (q=p;*q&&*q!='\n';q++);
+      if (*q) *q++ = (char)0;
+      if ((eq=strchr(p,'='))==NULL||eq==p) continue;
+      *eq = (char)0;
+      
+      e = &lab->ent[lab->nent];
+      e->key = p;
+      for (;*p;p++) *p = toupper(*p);
+      e->value = eq+1;
+      e->nval = 0;
+      e->val = NULL;
+      for (p=e->value;*p==' '||*p=='\t'||*p=='(';p++);
+      while (isdigit(*p)||*p=='.'||*p=='-'||*p=='+')
+         {
+         if ((e->nval&(e->nval-1))==0 &&
+               (e->val=(double *)realloc(e->val,MAX(2*e->nval,1)*sizeof(double)))==NULL)
+            zmabend("malloc failed");
+         e->val[e->nval++] = ms_dnum(&p);
+         while (*p==' '||*p=='\t') p++;
+         if (*p!=',') break;
+         for (p++;*p==' '||*p=='\t';p++);
+         }
+      
+      h = gtlabhash(e->key)&(lab->nhash-1);
+      while (lab->hash[h]>=0&&strcmp(lab->ent[lab->hash[h]].key,e->key)!=0)
+         h = (h+1)&(lab->nhash-1);
+      if (lab->hash[h]<0) lab->hash[h] = lab->nent;
+      lab->nent++;
+      }
+   
+   return lab;
+}
+
+void gtfreelab( GTLABEL * lab )
+{
+   int i;
+   
+   for (i=0;i<lab->nent;i++) free(lab->ent[i].val);
+   free(lab->ent);
+   free(lab->hash);
+   free(lab->text);
+   free(lab);
+   return;
+}
+
+GTLABENTRY * gtlabkey( GTLABEL * lab, char * key )
+{
+   int h,k;
+   
+   h = gtlabhash(key)&(lab->nhash-1);
+   while ((k=lab->hash[h])>=0)
+      {
+      if (strcasecmp(lab->ent[k].key,key)==0) return &lab->ent[k];
+      h = (h+1)&(lab->nhash-1);
+      }
+   return NULL;
+}
+
+/* element i of a numeric vector, 0 past its end as ms_dnum
+would read from a short one */
+
+static double gtlabval( GTLABENTRY * e, int i )
+{
+   if (i<e->nval) return e->val[i];
+   return 0.0;
+}
+
+/* key whose value is a vector "(...)" */
+
+static GTLABENTRY * gtlabvec( GTLABEL * lab, char * key )
+{
+   GTLABENTRY *e;
+   
+   e = gtlabkey(lab,key);
+   if (e==NULL||e->value[0]!='(') return NULL;
+   return e;
+}
+
+/* the (line,samp) -> (East,North) map of the label, 0 if the label
+has neither a transformation nor a tiepoint and scale.  Note
+reversal of matrix from samp-line to line-samp */
+
+static int gtlabmap( GTLABEL * lab, double * map )
+{
+   GTLABENTRY *e,*etie,*escl;
+   double voff;
+   
+   e = gtlabkey(lab,"GTRASTERTYPEGEOKEY");
+   if (e!=NULL&&e->value[0]=='2') voff = 1.0;
+   else voff = 0.5;     /* 0.5 is the default also */
+   e = gtlabvec(lab,"MODELTRANSFORMATIONTAG");
+   if (e!=NULL)
+      {
+      map[1] = gtlabval(e,0);
+      map[0] = gtlabval(e,1);
+      map[2] = gtlabval(e,3)-(map[0]+map[1])*voff;
+      map[4] = gtlabval(e,4);
+      map[3] = gtlabval(e,5);
+      map[5] = gtlabval(e,7)-(map[3]+map[4])*voff;
+      return 1;
+      }
+   etie = gtlabvec(lab,"MODELTIEPOINTTAG");
+   if (etie==NULL) return 0;
+   escl = gtlabvec(lab,"MODELPIXELSCALETAG");
+   if (escl==NULL) return 0;
+   
+   map[0] = 0.0;
+   map[1] = gtlabval(escl,0);
+   map[2] = gtlabval(etie,3)-map[1]*(gtlabval(etie,0)+voff);
+   map[3] = -gtlabval(escl,1);
+   map[4] = 0.0;
+   map[5] = gtlabval(etie,4)-map[3]*(gtlabval(etie,1)+voff);
+   return 1;
 }
 
 /*================================================================
@@ -205,11 +375,20 @@ arguments:
 */
 
 int geofix( char * labelstr, double * map, double * invmap, int nl, int ns, double * corner)
+{
+   int ireturn;
+   GTLABEL *lab;
+   
+   lab = gtparselab(labelstr);
+   ireturn = geofixlab(lab,map,invmap,nl,ns,corner);
+   gtfreelab(lab);
+   return ireturn;
+}
+
+int geofixlab( GTLABEL * lab, double * map, double * invmap, int nl, int ns, double * corner)
 {
    int i,vtype;
    int ireturn;
-   char *p;
-   double tie[4],voff,ddummy,scale[2];
    
    for (i=0;i<6;i++) { map[i] = 0.; invmap[i] = 0.; }
    map[0] = 1.; map[5] = 1.;
@@ -218,44 +397,9 @@ int geofix( char * labelstr, double * map, double * invmap, int nl, int ns, doub
    
    vtype = nl!=(-1);
       
-   /* read the model transformation or get the scale, etc.  Note
-   reversal of matrix from samp-line to line-samp */
+   /* read the model transformation or get the scale, etc. */
    
-   p = ms_find(labelstr,"GTRASTERTYPEGEOKEY=2");
-   if (p!=0) voff = 1.0; else voff = 0.5;     /* 0.5 is the default also */
-   p = ms_find(labelstr,"MODELTRANSFORMATIONTAG=(");
-   if (p!=0)
-      {
-      map[1] = ms_dnum(&p); p++;
-      map[0] = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      map[2] = ms_dnum(&p)-(map[0]+map[1])*voff; p++;
-      map[4] = ms_dnum(&p); p++;
-      map[3] = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      map[5] = ms_dnum(&p)-(map[3]+map[4])*voff;
-      }
-   else
-      {
-      p = ms_find(labelstr,"MODELTIEPOINTTAG=(");
-      if (p==0) { ireturn = 0; goto closem; }
-      tie[0] = ms_dnum(&p); p++;
-      tie[1] = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      tie[2] = ms_dnum(&p); p++;
-      tie[3] = ms_dnum(&p);
-      p = ms_find(labelstr,"MODELPIXELSCALETAG=(");
-      if (p==0) { ireturn = 0; goto closem; }
-      scale[0] = ms_dnum(&p); p++;
-      scale[1] = ms_dnum(&p);
-     
-      map[0] = 0.0;
-      map[1] = scale[0];
-      map[2] = tie[2]-map[1]*(tie[0]+voff);
-      map[3] = -scale[1];
-      map[4] = 0.0;
-      map[5] = tie[3]-map[3]*(tie[1]+voff);
-      }
+   if (!gtlabmap(lab,map)) { ireturn = 0; goto closem; }
    
    if (vtype)
       {
@@ -302,27 +446,35 @@ arguments:
 
 int gtrect( char * labelstr, double eps )
 {
-   char *p;
-   double map[4],ddummy,largest,thresh;
+   int ireturn;
+   GTLABEL *lab;
+   
+   lab = gtparselab(labelstr);
+   ireturn = gtrectlab(lab,eps);
+   gtfreelab(lab);
+   return ireturn;
+}
+
+int gtrectlab( GTLABEL * lab, double eps )
+{
+   GTLABENTRY *e;
+   double map[4],largest,thresh;
    
    /* read the model transformation or read if scale */
    
-   p = ms_find(labelstr,"MODELPIXELSCALETAG=(");
-   if (p!=0)
+   if (gtlabvec(lab,"MODELPIXELSCALETAG")!=NULL)
       {
-      p = ms_find(labelstr,"MODELTIEPOINTTAG=(");
-      if (p==0) zmabend("Problem with GeoTIFF label");
+      if (gtlabvec(lab,"MODELTIEPOINTTAG")==NULL)
+         zmabend("Problem with GeoTIFF label");
       return 1;
       }
-   p = ms_find(labelstr,"MODELTRANSFORMATIONTAG=(");
-   if (p!=0)
+   e = gtlabvec(lab,"MODELTRANSFORMATIONTAG");
+   if (e!=NULL)
       {
-      map[0] = fabs(ms_dnum(&p)); p++;
-      map[1] = fabs(ms_dnum(&p)); p++;
-      ddummy = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      map[2] = fabs(ms_dnum(&p)); p++;
-      map[3] = fabs(ms_dnum(&p));
+      map[0] = fabs(gtlabval(e,0));
+      map[1] = fabs(gtlabval(e,1));
+      map[2] = fabs(gtlabval(e,4));
+      map[3] = fabs(gtlabval(e,5));
       largest = MAX(map[0],map[1]);
       largest = MAX(largest,map[2]);
       largest = MAX(largest,map[3]);
@@ -405,10 +557,23 @@ arguments:
 */
 
 int gtmapcom( char * labelstr1, char * labelstr2 )
+{
+   int ireturn;
+   GTLABEL *lab1,*lab2;
+   
+   lab1 = gtparselab(labelstr1);
+   lab2 = gtparselab(labelstr2);
+   ireturn = gtmapcomlab(lab1,lab2);
+   gtfreelab(lab1);
+   gtfreelab(lab2);
+   return ireturn;
+}
+
+int gtmapcomlab( GTLABEL * lab1, GTLABEL * lab2 )
 {
 #define numattrib 45
    int iattrib,status;
-   char *p1,*p2;
+   GTLABENTRY *p1,*p2;
    char attrib[numattrib][34] = {"GTRASTERTYPEGEOKEY","GTMODELTYPEGEOKEY",
      "GEOGRAPHICTXGEOKEY","GEOGGEODETICDATUMGEOKEY","GEOGPRIMEMERIDIANGEOKEY",
      "GEOGLINEARUNITSGEOKEY","GEOGLINEARUNITSIZEGEOKEY","GEOGANGULARUNITSGEOKEY",
@@ -427,37 +592,38 @@ int gtmapcom( char * labelstr1, char * labelstr2 )
      "VERTICALUNITSGEOKEY"};
    /*int numattrib = 45;*/
    
-   /* loop over attributes in string 1, finding match in string 2,
-   the second part of the loop does the reverse check */
+   /* loop over attributes in label 1, finding match in label 2,
+   the second part of the loop does the reverse check; the values
+   are compared as text, from after the "=" */
    
    for (iattrib=0;iattrib<numattrib;iattrib++)
       {
-      p1 = ms_find(labelstr1,attrib[iattrib]);
+      p1 = gtlabkey(lab1,attrib[iattrib]);
       if (p1!=0)
          {
-         p2 = ms_find(labelstr2,attrib[iattrib]);
+         p2 = gtlabkey(lab2,attrib[iattrib]);
          if (p2==0)
             {
             printf("Missing attribute in label 2: %s\n",attrib[iattrib]);
             return 0;
             }
-         status = gtcompval(p1,p2);
+         status = gtcompval(p1->value,p2->value);
          if (status!=1)
             {
             printf("Disagreement in labels for: %s\n",attrib[iattrib]);
             return 0;
             }
          }
-      p2 = ms_find(labelstr2,attrib[iattrib]);
+      p2 = gtlabkey(lab2,attrib[iattrib]);
       if (p2!=0)
          {
-         p1 = ms_find(labelstr1,attrib[iattrib]);
+         p1 = gtlabkey(lab1,attrib[iattrib]);
          if (p1==0)
             {
             printf("Missing attribute in label 1: %s\n",attrib[iattrib]);
             return 0;
             }
-         status = gtcompval(p1,p2);
+         status = gtcompval(p1->value,p2->value);
          if (status!=1)
             {
             printf("Disagreement in labels for: %s\n",attrib[iattrib]);
@@ -487,46 +653,22 @@ arguments:
 */
 
 int gtgetrot( char * labelstr )
+{
+   int rot;
+   GTLABEL *lab;
+   
+   lab = gtparselab(labelstr);
+   rot = gtgetrotlab(lab);
+   gtfreelab(lab);
+   return rot;
+}
+
+int gtgetrotlab( GTLABEL * lab )
 {
    int rot=0;
-   char *p;
-   double map[6],tie[4],scale[2],ddummy,xmain,xcross,xtot,voff;
+   double map[6],xmain,xcross,xtot;
    
-   p = ms_find(labelstr,"GTRASTERTYPEGEOKEY=2");
-   if (p!=0) voff = 1.0; else voff = 0.5;     /* 0.5 is the default also */
-   p = ms_find(labelstr,"MODELTRANSFORMATIONTAG=(");
-   if (p!=0)
-      {
-      map[1] = ms_dnum(&p); p++;
-      map[0] = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      map[2] = ms_dnum(&p)-(map[0]+map[1])*voff; p++;
-      map[4] = ms_dnum(&p); p++;
-      map[3] = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      map[5] = ms_dnum(&p)-(map[3]+map[4])*voff;
-      }
-   else
-      {
-      p = ms_find(labelstr,"MODELTIEPOINTTAG=(");
-      if (p==0) zmabend("Problem with GeoTIFF label");
-      tie[0] = ms_dnum(&p); p++;
-      tie[1] = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      tie[2] = ms_dnum(&p); p++;
-      tie[3] = ms_dnum(&p);
-      p = ms_find(labelstr,"MODELPIXELSCALETAG=(");
-      if (p==0) zmabend("Problem with GeoTIFF label");
-      scale[0] = ms_dnum(&p); p++;
-      scale[1] = ms_dnum(&p);
-      
-      map[0] = 0.0;
-      map[1] = scale[0];
-      map[2] = tie[2]-map[1]*(tie[0]+voff);
-      map[3] = -scale[1];
-      map[4] = 0.0;
-      map[5] = tie[3]-map[3]*(tie[1]+voff);
-      }
+   if (!gtlabmap(lab,map)) zmabend("Problem with GeoTIFF label");
    
    xmain = fabs(map[0])+fabs(map[4]);
    xcross = fabs(map[1])+fabs(map[3]);
@@ -740,27 +882,107 @@ arguments:
 
 void gtgetscl( char * labelstr, int * sctype, double * scale1, double * scale2 )
 {
-   char *p;
-   double ddummy;
+   GTLABEL *lab;
+   
+   lab = gtparselab(labelstr);
+   gtgetscllab(lab,sctype,scale1,scale2);
+   gtfreelab(lab);
+   return;
+}
+
+void gtgetscllab( GTLABEL * lab, int * sctype, double * scale1, double * scale2 )
+{
+   GTLABENTRY *e;
    
-   p = ms_find(labelstr,"MODELTRANSFORMATIONTAG=(");
-   if (p!=0)
+   e = gtlabvec(lab,"MODELTRANSFORMATIONTAG");
+   if (e!=NULL)
       {
       *sctype = 2;
-      ddummy = ms_dnum(&p); p++;
-      *scale1 = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      ddummy = ms_dnum(&p); p++;
-      *scale2 = ms_dnum(&p); p++;
-     }
+      *scale1 = gtlabval(e,1);
+      *scale2 = gtlabval(e,4);
+      }
    else
       {
-      p = ms_find(labelstr,"MODELPIXELSCALETAG=(");
-      if (p==0) zmabend("Problem with GeoTIFF label");
+      e = gtlabvec(lab,"MODELPIXELSCALETAG");
+      if (e==NULL) zmabend("Problem with GeoTIFF label");
       *sctype = 1;
-      *scale1 = ms_dnum(&p); p++;
-      *scale2 = ms_dnum(&p);
+      *scale1 = gtlabval(e,0);
+      *scale2 = gtlabval(e,1);
       }
     
    return;
 }
+
+/*================================================================
+
+gtapplymap, gtapplymapline, gtmapcompose, gtxformline
+
+see cartoGtUtils.h.  The loops keep the coefficients in locals and
+store each output after both are computed, so the compiler can
+vectorize them and the outputs may overwrite the inputs.
+*/
+
+void gtapplymap( double * map, double * x, double * y, double * u, double * v, int n )
+{
+   int i;
+   double a0,a1,a2,a3,a4,a5,xi,yi;
+   
+   a0 = map[0]; a1 = map[1]; a2 = map[2];
+   a3 = map[3]; a4 = map[4]; a5 = map[5];
+   for (i=0;i<n;i++)
+      {
+      xi = x[i]; yi = y[i];
+      u[i] = a0*xi+a1*yi+a2;
+      v[i] = a3*xi+a4*yi+a5;
+      }
+   return;
+}
+
+void gtapplymapline( double * map, double line, double samp0, double dsamp, int n, double * u, double * v )
+{
+   int i;
+   double u0,v0,du,dv;
+   
+   u0 = map[0]*line+map[1]*samp0+map[2];
+   v0 = map[3]*line+map[4]*samp0+map[5];
+   du = map[1]*dsamp;
+   dv = map[4]*dsamp;
+   for (i=0;i<n;i++)
+      {
+      u[i] = u0+du*(double)i;
+      v[i] = v0+dv*(double)i;
+      }
+   return;
+}
+
+void gtmapcompose( double * first, double * second, double * map )
+{
+   double t[6];
+   
+   t[0] = second[0]*first[0]+second[1]*first[3];
+   t[1] = second[0]*first[1]+second[1]*first[4];
+   t[2] = second[0]*first[2]+second[1]*first[5]+second[2];
+   t[3] = second[3]*first[0]+second[4]*first[3];
+   t[4] = second[3]*first[1]+second[4]*first[4];
+   t[5] = second[3]*first[2]+second[4]*first[5]+second[5];
+   memcpy(map,t,6*sizeof(double));
+   return;
+}
+
+void gtxformline( double * map1, gtxform xform, void * xdata, double * map2,
+      double line, double samp0, double dsamp, int n, double * u, double * v )
+{
+   double map[6];
+   
+   if (xform==NULL)
+      {
+      if (map2!=NULL) gtmapcompose(map1,map2,map);
+      else memcpy(map,map1,6*sizeof(double));
+      gtapplymapline(map,line,samp0,dsamp,n,u,v);
+      return;
+      }
+   gtapplymapline(map1,line,samp0,dsamp,n,u,v);
+   xform(xdata,u,v,n);
+   if (map2!=NULL) gtapplymap(map2,u,v,u,v,n);
+   return;
+}
@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <float.h>
+#include <pthread.h>
 
 #include "zvproto.h"
 
@@ -8,6 +11,7 @@
 #include "carto/cartoMemUtils.h"
 #include "carto/cartoSortUtils.h"
 #include "carto/cartoVicarProtos.h"
+#include "carto/thread_manager.h"
 
 #ifndef MAX
 #define MAX(a,b)	(((a)>(b))?(a):(b))
@@ -17,12 +21,7 @@
 #define MIN(a,b)	(((a)<(b))?(a):(b))
 #endif
 
-#define VORMAXPOLY      1000   /* MAX EDGES IN A SINGLE VORONOI POLYGON */
-static int bggset,bgg,ccjj[VORMAXPOLY],ccgrp[VORMAXPOLY];
-static double cc1x[VORMAXPOLY],cc1y[VORMAXPOLY],
-  cc2x[VORMAXPOLY],cc2y[VORMAXPOLY],
-  ccrx[VORMAXPOLY],ccry[VORMAXPOLY];
-static short int *vgroup;
+#define THIESSEN_CHUNK  4096   /* POINTS PER UNIT OF THREADED WORK */
 
 int dceiling( double x )
 {
@@ -102,7 +101,7 @@ void segxseg( double x1, double y1, double x2, double y2, double x3, double y3,
 }
 
 
-void insert_seg( int jj, int * ccount, double * p4max, double xbig, double ybig, double xjbig, double yjbig, int wchcall )
+void insert_seg( VoronoiCell * cell, int jj, int * ccount, double * p4max, double xbig, double ybig, double xjbig, double yjbig, int wchcall )
 {
    int ccdel[VORMAXPOLY];
    int i,k,tcross,tdelete,srong,niter,iter,kmin=0,kc,kcmin=0,whch,irep;
@@ -123,14 +122,14 @@ void insert_seg( int jj, int * ccount, double * p4max, double xbig, double ybig,
    tcross = 0; tdelete = 0;
    for (k=0;k<*ccount;k++)
       {
-      segxseg(xm,ym,xbis,ybis,cc1x[k],cc1y[k],cc2x[k],cc2y[k],tw);
+      segxseg(xm,ym,xbis,ybis,cell->cc1x[k],cell->cc1y[k],cell->cc2x[k],cell->cc2y[k],tw);
       /*if(bgg)printf("tw %f %f\n",tw[0],tw[1]);*/
       if (tw[1]>=0. && tw[1]<=1.) lcross = 1; else lcross = 0.;
       xcr = xbisv*tw[0]+xm;
       ycr = ybisv*tw[0]+ym;
       /*if(bgg)printf("xcr,ycr %f %f\n",xcr,ycr);*/
-      z1 = xzprod(cc1x[k]-xm,cc1y[k]-ym,xbisv,ybisv);
-      z2 = xzprod(cc2x[k]-xm,cc2y[k]-ym,xbisv,ybisv);
+      z1 = xzprod(cell->cc1x[k]-xm,cell->cc1y[k]-ym,xbisv,ybisv);
+      z2 = xzprod(cell->cc2x[k]-xm,cell->cc2y[k]-ym,xbisv,ybisv);
       /*if(bgg)printf("z1,z2 %f %f\n",z1,z2);*/
       srong = 0; z12 = 1;
       if (z1<0.) srong++;
@@ -166,12 +165,12 @@ void insert_seg( int jj, int * ccount, double * p4max, double xbig, double ybig,
 	 for (k=0;k<*ccount;k++)
 	    {
 	    if (ccdel[k]==1) continue;
-	    px = cc1x[k]-xbis;
-	    py = cc1y[k]-ybis;
+	    px = cell->cc1x[k]-xbis;
+	    py = cell->cc1y[k]-ybis;
 	    dist = fabs(px)+fabs(py);
 	    if (dist>1.e-7)
 	       {
-	       z2 = xzprod(cc2x[k]-px,cc2y[k]-py,xbisv,ybisv);
+	       z2 = xzprod(cell->cc2x[k]-px,cell->cc2y[k]-py,xbisv,ybisv);
 	       dot = px*xbisv+py*ybisv;
 	       hyp = sqrt((double)(px*px+py*py))*
 		     sqrt((double)(xbisv*xbisv+ybisv*ybisv));
@@ -183,8 +182,8 @@ void insert_seg( int jj, int * ccount, double * p4max, double xbig, double ybig,
 	    dmin = dist; kmin = k; z2min = z2;
 	    }
 	 ccdel[kmin] = 1;
-	 sx[tcross] = cc1x[kmin];
-	 sy[tcross] = cc1y[kmin];
+	 sx[tcross] = cell->cc1x[kmin];
+	 sy[tcross] = cell->cc1y[kmin];
 	 sccx[tcross] = kmin;
 	 if (z2min<0) srl[tcross] = 2; else srl[tcross] = 1;
 	 tcross++;
@@ -202,9 +201,9 @@ void insert_seg( int jj, int * ccount, double * p4max, double xbig, double ybig,
 	    k = sccx[kc];
 	    whch = srl[kc];
 	    if (whch==1)
-	       { px = cc1x[k]-xbis; py = cc1y[k]-ybis; }
+	       { px = cell->cc1x[k]-xbis; py = cell->cc1y[k]-ybis; }
 	    else
-	       { px = cc2x[k]-xbis; py = cc2y[k]-ybis; }
+	       { px = cell->cc2x[k]-xbis; py = cell->cc2y[k]-ybis; }
 	    dist = fabs(px)+fabs(py);
 	    if (dist>1.e-7)
 	       {
@@ -237,45 +236,45 @@ void insert_seg( int jj, int * ccount, double * p4max, double xbig, double ybig,
       ptr = sccx[irep];
       if (whch==1)
 	 {
-	 cc1x[ptr] = sx[irep];
-	 cc1y[ptr] = sy[irep];
+	 cell->cc1x[ptr] = sx[irep];
+	 cell->cc1y[ptr] = sy[irep];
 	 }
       else
 	 {
-	 cc2x[ptr] = sx[irep];
-	 cc2y[ptr] = sy[irep];
+	 cell->cc2x[ptr] = sx[irep];
+	 cell->cc2y[ptr] = sy[irep];
 	 }
       }
    ptr = 0;
    for (k=0;k<*ccount;k++)
       {
-      cc1x[ptr] = cc1x[k]; cc1y[ptr] = cc1y[k];
-      cc2x[ptr] = cc2x[k]; cc2y[ptr] = cc2y[k];
+      cell->cc1x[ptr] = cell->cc1x[k]; cell->cc1y[ptr] = cell->cc1y[k];
+      cell->cc2x[ptr] = cell->cc2x[k]; cell->cc2y[ptr] = cell->cc2y[k];
       ccdel[ptr] = ccdel[k];
       switch(wchcall)
 	 {
-	 case 3: ccrx[ptr] = ccrx[k]; ccry[ptr] = ccry[k];
-		 ccgrp[ptr] = ccgrp[k];
-	 case 2: ccjj[ptr] = ccjj[k]; break;
+	 case 3: cell->ccrx[ptr] = cell->ccrx[k]; cell->ccry[ptr] = cell->ccry[k];
+		 cell->ccgrp[ptr] = cell->ccgrp[k];
+	 case 2: cell->ccjj[ptr] = cell->ccjj[k]; break;
 	 /*case 1: break;*/
 	 }
       if (ccdel[k]<2) ptr++;
       }
    z1 = xzprod(sx[0]-xbig,sy[0]-ybig,sx[1]-xbig,sy[1]-ybig);
    if (z1<0) whch = 0; else whch = 1;
-   cc1x[ptr] = sx[whch]; cc1y[ptr] = sy[whch];
-   cc2x[ptr] = sx[1-whch]; cc2y[ptr] = sy[1-whch];
+   cell->cc1x[ptr] = sx[whch]; cell->cc1y[ptr] = sy[whch];
+   cell->cc2x[ptr] = sx[1-whch]; cell->cc2y[ptr] = sy[1-whch];
    switch(wchcall)
       {
-      case 3: ccrx[ptr] = xjbig; ccry[ptr] = yjbig; ccgrp[ptr] = vgroup[jj];
-      case 2: ccjj[ptr] = jj; break;
+      case 3: cell->ccrx[ptr] = xjbig; cell->ccry[ptr] = yjbig; cell->ccgrp[ptr] = cell->vgroup[jj];
+      case 2: cell->ccjj[ptr] = jj; break;
       /*case 1: break;*/
       }
    *ccount = ptr+1;
    pmax = 0.;
    for (i=0;i<*ccount;i++)
       {
-      dx = cc1x[i]-xbig; dy = cc1y[i]-ybig;
+      dx = cell->cc1x[i]-xbig; dy = cell->cc1y[i]-ybig;
       ccrad = dx*dx+dy*dy;
       if (ccrad>pmax) pmax = ccrad;
       }
@@ -283,41 +282,180 @@ void insert_seg( int jj, int * ccount, double * p4max, double xbig, double ybig,
    return;
 }
 
-void thiessen( int npoints, int * nlinret, double reject, double skinny, int abendi, double * ptx, double * pty, int * ntriang, int ** tcon1, int ** tcon2, int ** tcon3 )
+/* build the voronoi polygon of point ibig of the sorted points buf and */
+/* store the triangles it forms with its neighbors into tri (three      */
+/* sorted original point numbers each); returns the triangle count      */
+
+static int thiessen_cell( VoronoiCell * cell, double * buf, int * bptr, int npts, int ibig, double low1, double low2, double upp1, double upp2, double skinny, int * tri )
 {
+   int bjj[VORMAXPOLY],blink[VORMAXPOLY];
+   int i,j,jj,ptr,jsave,jdup,ip1,topstop,botstop,dirj,ccount,ntri;
+   int t1,t2,t3,tt,bggset;
+   double dx,dy,dx2,dist2,xlink,ylink,tstarea,p4max,xbig,ybig,xjbig,yjbig;
 
-   int *bptr,**hash1,**hash2,**tc,bjj[VORMAXPOLY],blink[VORMAXPOLY];
-   double *bufio,*buf;
+   bggset = -1; ntri = 0;
+   xbig = buf[ibig*2];
+   ybig = buf[ibig*2+1];
+   /*if (bggset>=0) printf("xbig,ybig %f %f\n",xbig,ybig);*/
+   if (ibig==bggset) cell->bgg = 1; else cell->bgg = 0;
+   cell->cc1x[0] = upp1; cell->cc1y[0] = upp2; cell->cc2x[0] = low1; cell->cc2y[0] = upp2;
+   cell->cc1x[1] = upp1; cell->cc1y[1] = low2; cell->cc2x[1] = upp1; cell->cc2y[1] = upp2;
+   cell->cc1x[2] = low1; cell->cc1y[2] = low2; cell->cc2x[2] = upp1; cell->cc2y[2] = low2;
+   cell->cc1x[3] = low1; cell->cc1y[3] = upp2; cell->cc2x[3] = low1; cell->cc2y[3] = low2;
+   cell->ccjj[0] = ibig; cell->ccjj[1] = ibig;
+   cell->ccjj[2] = ibig; cell->ccjj[3] = ibig;
+   p4max = upp1+upp2-low1-low2; p4max = p4max*p4max; ccount = 4;
+   topstop = 0; botstop = 0;
+   for (j=0;j<2*npts;j++)
+      {
+      dirj = j%2;
+      jj = ibig+(dirj*2-1)*((j+2)/2);
+      /*if(bgg)printf("a-ibig,j,jj %d %d %d\n",ibig,j,jj);
+      if(bgg)printf("dirj,tops,bots %d %d %d\n",dirj,topstop,botstop);*/
+      if (jj<0 || jj>=npts) continue;
+      if (dirj==0 && topstop) continue;
+      if (dirj==1 && botstop) continue;
+      xjbig = buf[jj*2];
+      yjbig = buf[jj*2+1];
+      dx = xjbig-xbig; dy = yjbig-ybig; dx2 = dx*dx;
+      dist2 = dx2+dy*dy;
+      /*if(bgg)printf("xjbig,yjbig,dist2 %f %f %f\n",xjbig,yjbig,dist2);*/
+      if (dist2<p4max)
+         insert_seg(cell,jj,&ccount,&p4max,xbig,ybig,xjbig,yjbig,2);
+      /*if(bgg)printf("set-stop %f %f %f\n",xbig,xjbig,p4max);*/
+      if (dx2>p4max)
+         { if (dirj==0) topstop = 1; else botstop = 1; }
+      if (topstop&&botstop) break;
+      }
 
-   int np,i,j,npts,linct,ip1,hlen1,hlen2;
-   int topstop,botstop,dirj,jj,k,ptr,jsave,jdup,trict,ibig;
-   int t0,t1,t2,t3,tt3,tt,h12,h123,l,triptr,ttptr,ccount,temp;
-   double dx,dy,dx2,dist2,xlink,ylink,low1,low2,upp1,upp2,tstarea,diam;
-   double tw[2],p4max,xbig,ybig,xjbig,yjbig;
-   double triarea();
+/* output the polygon in chain order, zero length edges are kept
+   but can be thinned by user proc */
 
-   bgg = 0; bggset = -1;
-   
-   
-   /* read the data */
+   for (i=0;i<ccount;i++) blink[i] = 0;
+   ptr = 0;
+   xlink = cell->cc2x[0]; ylink = cell->cc2y[0]; jsave = 0;
+   for (i=0;i<ccount;i++)
+      {
+      jdup = 0;
+      for (j=0;j<ccount;j++)
+         {
+         if (blink[j]) continue;
+         if (cell->cc1x[j]!=xlink || cell->cc1y[j]!=ylink) continue;
+         if (j==jsave) continue;
+         jdup++;
+         if (jdup>1&&cell->cc1x[jsave]==cell->cc2x[jsave]&&
+			cell->cc1y[jsave]==cell->cc2y[jsave]) break;
+         jsave = j;
+         }
+      if (cell->ccjj[jsave]!=ibig) bjj[ptr++] = cell->ccjj[jsave];
+      xlink = cell->cc2x[jsave]; ylink = cell->cc2y[jsave];
+      blink[jsave] = 1;
+      }
+   for (i=0;i<ptr;i++)
+      {
+      if (i==(ptr-1)) ip1 = 0; else ip1 = i+1;
+      if (bjj[i]!=ibig && bjj[ip1]!=ibig)
+         {
+         if (bjj[i]==bjj[ip1]) continue;
+         tstarea = triarea((double)(buf[ibig*2]),(double)(buf[ibig*2+1]),
+		       (double)(buf[bjj[i]*2]),(double)(buf[bjj[i]*2+1]),
+		       (double)(buf[bjj[ip1]*2]),(double)(buf[bjj[ip1]*2+1]));
+         if (tstarea<skinny) continue;
+         /*if (bgg) printf("***************saved\n");*/
+         t1 = bptr[ibig];
+         t2 = bptr[bjj[i]];
+         t3 = bptr[bjj[ip1]];
+         if (t1>t2) { tt=t1; t1=t2; t2=tt; }
+         if (t1>t3) { tt=t1; t1=t3; t3=tt; }
+         if (t2>t3) { tt=t2; t2=t3; t3=tt; }
+         tri[ntri*3] = t1;
+         tri[ntri*3+1] = t2;
+         tri[ntri*3+2] = t3;
+         ntri++;
+         }
+      }
+   return(ntri);
+}
 
-   np = npoints*2;
-   mz_alloc1((unsigned char **)&bufio,np,8);
-   mz_alloc1((unsigned char **)&buf,np,8);
-   mz_alloc1((unsigned char **)&bptr,npoints,4);
-   for (i=0;i<10000;i++)
+/* the points are split into chunks of THIESSEN_CHUNK that the threads */
+/* take in turn; each chunk keeps its triangles, and where each point's */
+/* start, so they can be merged in point order afterwards               */
+
+typedef struct
+{
+   int start,end,ntri,cap;
+   int *tri,*off;
+} ThiessenChunk;
+
+typedef struct
+{
+   double *buf,low1,low2,upp1,upp2,skinny;
+   int *bptr,npts,nchunk,next;
+   ThiessenChunk *chunk;
+   pthread_mutex_t lock;
+} ThiessenState;
+
+typedef struct
+{
+   ThiessenState *state;
+} ThiessenWorker;
+
+static void * thiessen_worker( void * arg )
+{
+   ThiessenState *st;
+   ThiessenChunk *ck;
+   VoronoiCell *cell;
+   int ic,ibig,ntri;
+
+   st = ((ThiessenWorker *)arg)->state;
+   if ((cell=(VoronoiCell *)malloc(sizeof(VoronoiCell)))==NULL) zmabend("malloc failed");
+   cell->vgroup = NULL;
+   for (;;)
       {
-      hlen1 = (npoints*4+1000)+i;
-      if (hlen1%2==0) continue;
-      for (j=3;j<=37;j+=2)
+      pthread_mutex_lock(&st->lock);
+      ic = st->next++;
+      pthread_mutex_unlock(&st->lock);
+      if (ic>=st->nchunk) break;
+
+      ck = &st->chunk[ic];
+      ck->ntri = 0;
+      for (ibig=ck->start;ibig<ck->end;ibig++)
 	 {
-	 if (hlen1%j==0) break;
-	 if (j==37) goto rnd1;
+	 ck->off[ibig-ck->start] = ck->ntri;
+	 if (ck->cap-ck->ntri<VORMAXPOLY)
+	    {
+	    ck->cap = 2*ck->cap+VORMAXPOLY;
+	    if ((ck->tri=(int *)realloc(ck->tri,ck->cap*3*sizeof(int)))==NULL)
+	       zmabend("malloc failed");
+	    }
+	 ntri = thiessen_cell(cell,st->buf,st->bptr,st->npts,ibig,
+		   st->low1,st->low2,st->upp1,st->upp2,st->skinny,
+		   &ck->tri[ck->ntri*3]);
+	 ck->ntri += ntri;
 	 }
+      ck->off[ck->end-ck->start] = ck->ntri;
       }
-   rnd1: /*if(bgg)printf("hash length = %d\n",hlen1);*/
-   mz_alloc2((unsigned char ***)&hash1,4,hlen1,4);
-   for (i=0;i<hlen1;i++) hash1[0][i] = 0;
+   free(cell);
+   return(NULL);
+}
+
+/* screen the points for thiessen and delaunay: sort them by x into buf */
+/* (x,y pairs) with their original numbers (from 1) in bptr, dropping  */
+/* duplicate and close points; bounds gets the enlarged bounding box   */
+/* low1,low2,upp1,upp2; returns the number of points kept              */
+
+static int tri_points( int npoints, double reject, int abendi, double * ptx, double * pty, double ** buf, int ** bptr, double * bounds )
+{
+   double *bufio;
+   int np,i,j,npts,ptr,runstart;
+   double low1,low2,upp1,upp2,diam;
+
+   /* read the data */
+
+   np = npoints*2;
+   mz_alloc1((unsigned char **)&bufio,np,8);
+   mz_alloc1((unsigned char **)buf,np,8);
+   mz_alloc1((unsigned char **)bptr,npoints,4);
 
    low1 = 1.e20; low2 = 1.e20; upp1 = -1.e20; upp2 = -1.e20;
    for (i=0;i<npoints;i++)
@@ -335,23 +473,26 @@ void thiessen( int npoints, int * nlinret, double reject, double skinny, int abe
    upp1 = upp1+diam;
    upp2 = upp2+diam;
 
-   /* apply the voronoi routine */
-
-   npts = np/2; ccount = 0; linct = 0; trict = 0;
-   for (i=0;i<np;i++) buf[i] = bufio[i];
-   for (i=0;i<npts;i++) bptr[i] = i+1;
+   npts = np/2;
+   for (i=0;i<np;i++) (*buf)[i] = bufio[i];
+   for (i=0;i<npts;i++) (*bptr)[i] = i+1;
    
-   sort88(buf,bptr,npts);
-   sortrec88(bufio,bptr,npts);
+   sort88(*buf,*bptr,npts);
+   sortrec88(bufio,*bptr,npts);
    
-   ptr = 0;
+   /* the points are sorted on x then y, so within a run of equal x */
+   /* (a grid column) the search can stop at the first point at least */
+   /* reject below, instead of scanning the whole column               */
+
+   ptr = 0; runstart = 0;
    for (i=0;i<npts;i++)
       {
       if (bufio[i*2]<low1 || bufio[i*2]>upp1 ||
 	 bufio[i*2+1]<low2 || bufio[i*2+1]>upp2)
 	 { printf("outside point removed\n"); continue; }
-      if (i!=0) if (bufio[i*2]==buf[ptr*2-2] &&
-	 bufio[i*2+1]==buf[ptr*2-1])
+      if (ptr==0 || bufio[i*2]!=(*buf)[ptr*2-2]) runstart = ptr;
+      if (i!=0) if (bufio[i*2]==(*buf)[ptr*2-2] &&
+	 bufio[i*2+1]==(*buf)[ptr*2-1])
 	    {
 	    if (abendi) zmabend("duplicate point abend");
 	    printf("duplicate point rejected\n");
@@ -359,142 +500,165 @@ void thiessen( int npoints, int * nlinret, double reject, double skinny, int abe
 	    }
        for (j=1;ptr-j>=0;j++)
 	 {
-	 if (fabs(bufio[i*2]-buf[(ptr-j)*2])>reject) break;
-	 if ((fabs(bufio[i*2]-buf[(ptr-j)*2])+
-	    fabs(bufio[i*2+1]-buf[(ptr-j)*2+1]))<reject)
+	 if (fabs(bufio[i*2]-(*buf)[(ptr-j)*2])>reject) break;
+	 if (ptr-j>=runstart && bufio[i*2+1]-(*buf)[(ptr-j)*2+1]>=reject)
+	    { j = ptr-runstart; continue; }
+	 if ((fabs(bufio[i*2]-(*buf)[(ptr-j)*2])+
+	    fabs(bufio[i*2+1]-(*buf)[(ptr-j)*2+1]))<reject)
 	    {
 	    printf("i,j,ptr %d %d %d\n",i,j,ptr);
 	    printf("bufio[i*2],buf[(ptr-j)*2] %12.3f %12.3f\n",
-	                 bufio[i*2],buf[(ptr-j)*2]);
+	                 bufio[i*2],(*buf)[(ptr-j)*2]);
 	    printf("bufio[i*2+1],buf[(ptr-j)*2+1] %12.3f %12.3f\n",
-	                 bufio[i*2+1],buf[(ptr-j)*2+1]);
+	                 bufio[i*2+1],(*buf)[(ptr-j)*2+1]);
 	                 
 	    if (abendi) zmabend("close point abend");
 	    printf("close point rejected\n");
 	    goto clpt;
 	    }
 	 }
-      buf[ptr*2] = bufio[i*2];
-      buf[ptr*2+1] = bufio[i*2+1]; bptr[ptr++] = bptr[i];
+      (*buf)[ptr*2] = bufio[i*2];
+      (*buf)[ptr*2+1] = bufio[i*2+1]; (*bptr)[ptr++] = (*bptr)[i];
       clpt: continue;
       }
    free(bufio);
-   if (ptr==0) return; npts = ptr;
-   for (ibig=0;ibig<npts;ibig++)
+   bounds[0] = low1; bounds[1] = low2; bounds[2] = upp1; bounds[3] = upp2;
+   return(ptr);
+}
+
+/* put the triangles in vertical order, as required by tiegrid, and */
+/* make them clockwise; reports the counts as thiessen always has   */
+
+static void tri_finish( int npoints, double * ptx, double * pty, int trict, int * tcon1, int * tcon2, int * tcon3, int * ntriang, int * nlinret )
+{
+   int i,temp,*bptr;
+   double *buf,tstarea;
+
+   mz_alloc1((unsigned char **)&buf,trict,8);
+   mz_alloc1((unsigned char **)&bptr,trict,4);
+   for (i=0;i<trict;i++)
       {
-      if (ibig%10000==9999) printf("%d pts processed\n",ibig);
-      xbig = buf[ibig*2];
-      ybig = buf[ibig*2+1];
-      /*if (bggset>=0) printf("xbig,ybig %f %f\n",xbig,ybig);*/
-      if (ibig==bggset) bgg = 1; else bgg = 0;
-      cc1x[0] = upp1; cc1y[0] = upp2; cc2x[0] = low1; cc2y[0] = upp2;
-      cc1x[1] = upp1; cc1y[1] = low2; cc2x[1] = upp1; cc2y[1] = upp2;
-      cc1x[2] = low1; cc1y[2] = low2; cc2x[2] = upp1; cc2y[2] = low2;
-      cc1x[3] = low1; cc1y[3] = upp2; cc2x[3] = low1; cc2y[3] = low2;
-      ccjj[0] = ibig; ccjj[1] = ibig;
-      ccjj[2] = ibig; ccjj[3] = ibig;
-      p4max = upp1+upp2-low1-low2; p4max = p4max*p4max; ccount = 4;
-      topstop = 0; botstop = 0;
-      for (j=0;j<2*npts;j++)
-	 {
-	 dirj = j%2;
-	 jj = ibig+(dirj*2-1)*((j+2)/2);
-	 /*if(bgg)printf("a-ibig,j,jj %d %d %d\n",ibig,j,jj);
-	 if(bgg)printf("dirj,tops,bots %d %d %d\n",dirj,topstop,botstop);*/
-	 if (jj<0 || jj>=npts) continue;
-	 if (dirj==0 && topstop) continue;
-	 if (dirj==1 && botstop) continue;
-	 xjbig = buf[jj*2];
-	 yjbig = buf[jj*2+1];
-	 dx = xjbig-xbig; dy = yjbig-ybig; dx2 = dx*dx;
-	 dist2 = dx2+dy*dy;
-	 /*if(bgg)printf("xjbig,yjbig,dist2 %f %f %f\n",xjbig,yjbig,dist2);*/
-	 if (dist2<p4max)
-	    insert_seg(jj,&ccount,&p4max,xbig,ybig,xjbig,yjbig,2);
-	 /*if(bgg)printf("set-stop %f %f %f\n",xbig,xjbig,p4max);*/
-	 if (dx2>p4max)
-	    { if (dirj==0) topstop = 1; else botstop = 1; }
-	 if (topstop&&botstop) break;
-	 }
+      buf[i] = ptx[tcon1[i]-1]+ptx[tcon2[i]-1]+ptx[tcon3[i]-1];
+      bptr[i] = i+1;
+      }
+   sort8(buf,bptr,trict);
+   sortrec4(tcon1,bptr,trict);
+   sortrec4(tcon2,bptr,trict);
+   sortrec4(tcon3,bptr,trict);
 
-/* output the polygon in chain order, zero length edges are kept
-   but can be thinned by user proc */
+   /* triangles also have to be clockwise */
+
+   for (i=0;i<trict;i++)
+      {
+      tstarea = triarea((double)(ptx[tcon1[i]-1]),(double)(pty[tcon1[i]-1]),
+		 (double)(ptx[tcon2[i]-1]),(double)(pty[tcon2[i]-1]),
+		 (double)(ptx[tcon3[i]-1]),(double)(pty[tcon3[i]-1]));
+      if (tstarea>0.0) continue;
+      temp = tcon3[i]; tcon3[i] = tcon1[i]; tcon1[i] = temp;
+      }
+
+   *ntriang = trict;             /* can check this with Euler 2P-2-CVXHULL*/
+   *nlinret = npoints+trict-1;   /* using Euler */
+   printf("%d points %d lines %d triangles\n",npoints,*nlinret,trict);
+   free(buf); free(bptr);
+   return;
+}
 
-      for (i=0;i<ccount;i++) blink[i] = 0;
-      ptr = 0;
-      xlink = cc2x[0]; ylink = cc2y[0]; jsave = 0;
-      for (i=0;i<ccount;i++)
+void thiessen( int npoints, int * nlinret, double reject, double skinny, int abendi, double * ptx, double * pty, int * ntriang, int ** tcon1, int ** tcon2, int ** tcon3 )
+{
+
+   int *bptr,**hash1,**hash2,**tc;
+   double *buf;
+
+   int i,j,npts,linct,hlen1,hlen2;
+   int k,trict,ibig,ic,nthreads;
+   int t0,t1,t2,t3,tt3,h12,h123,l,triptr,ttptr;
+   double low1,low2,upp1,upp2,bounds[4];
+   double tw[2];
+   double triarea();
+   ThiessenState st;
+   ThiessenWorker *workers;
+   ThiessenChunk *ck;
+   
+   
+   npts = tri_points(npoints,reject,abendi,ptx,pty,&buf,&bptr,bounds);
+   if (npts==0) { free(buf); free(bptr); return; }
+   low1 = bounds[0]; low2 = bounds[1]; upp1 = bounds[2]; upp2 = bounds[3];
+   for (i=0;i<10000;i++)
+      {
+      hlen1 = (npoints*4+1000)+i;
+      if (hlen1%2==0) continue;
+      for (j=3;j<=37;j+=2)
 	 {
-	 jdup = 0;
-	 for (j=0;j<ccount;j++)
-	    {
-	    if (blink[j]) continue;
-	    if (cc1x[j]!=xlink || cc1y[j]!=ylink) continue;
-	    if (j==jsave) continue;
-	    jdup++;
-	    if (jdup>1&&cc1x[jsave]==cc2x[jsave]&&
-			cc1y[jsave]==cc2y[jsave]) break;
-	    jsave = j;
-	    }
-	 if (ccjj[jsave]!=ibig) bjj[ptr++] = ccjj[jsave];
-	 xlink = cc2x[jsave]; ylink = cc2y[jsave];
-	 blink[jsave] = 1;
+	 if (hlen1%j==0) break;
+	 if (j==37) goto rnd1;
 	 }
-      for (i=0;i<ptr;i++)
+      }
+   rnd1: /*if(bgg)printf("hash length = %d\n",hlen1);*/
+   mz_alloc2((unsigned char ***)&hash1,4,hlen1,4);
+   for (i=0;i<hlen1;i++) hash1[0][i] = 0;
+
+   /* apply the voronoi routine */
+
+   linct = 0; trict = 0;
+   /* build the polygons in parallel, then enter the triangles into the
+      hash table in point order, so the result does not depend on the
+      number of threads */
+
+   st.buf = buf; st.bptr = bptr; st.npts = npts; st.skinny = skinny;
+   st.low1 = low1; st.low2 = low2; st.upp1 = upp1; st.upp2 = upp2;
+   st.nchunk = (npts+THIESSEN_CHUNK-1)/THIESSEN_CHUNK; st.next = 0;
+   if ((st.chunk=(ThiessenChunk *)calloc(st.nchunk,sizeof(ThiessenChunk)))==NULL)
+      zmabend("malloc failed");
+   for (ic=0;ic<st.nchunk;ic++)
+      {
+      st.chunk[ic].start = ic*THIESSEN_CHUNK;
+      st.chunk[ic].end = MIN(npts,(ic+1)*THIESSEN_CHUNK);
+      mz_alloc1((unsigned char **)&st.chunk[ic].off,THIESSEN_CHUNK+1,4);
+      }
+   pthread_mutex_init(&st.lock,NULL);
+   nthreads = MAX(1,MIN(get_thread_count(),st.nchunk));
+   if ((workers=(ThiessenWorker *)malloc(nthreads*sizeof(ThiessenWorker)))==NULL)
+      zmabend("malloc failed");
+   for (i=0;i<nthreads;i++) workers[i].state = &st;
+   run_threads(nthreads,thiessen_worker,(void *)workers,sizeof(ThiessenWorker));
+   free(workers);
+   pthread_mutex_destroy(&st.lock);
+
+   for (ibig=0;ibig<npts;ibig++)
+      {
+      ck = &st.chunk[ibig/THIESSEN_CHUNK];
+      k = ibig-ck->start;
+      for (l=ck->off[k];l<ck->off[k+1];l++)
 	 {
-	 if (i==(ptr-1)) ip1 = 0; else ip1 = i+1;
-	 if (bjj[i]!=ibig && bjj[ip1]!=ibig)
+	 t1 = ck->tri[l*3];
+	 t2 = ck->tri[l*3+1];
+	 t3 = ck->tri[l*3+2];
+	 h123 = (t1*7+t2*330+t3*4199)%hlen1-1;
+	 for (j=0;j<hlen1;j++)
 	    {
-	    if (bjj[i]==bjj[ip1]) continue;
-	    tstarea = triarea((double)(buf[ibig*2]),(double)(buf[ibig*2+1]),
-		       (double)(buf[bjj[i]*2]),(double)(buf[bjj[i]*2+1]),
-		       (double)(buf[bjj[ip1]*2]),(double)(buf[bjj[ip1]*2+1]));
-            if (tstarea<skinny) continue;
-	    /*if (bgg) printf("***************saved\n");*/
-	    t1 = bptr[ibig];
-	    t2 = bptr[bjj[i]];
-	    t3 = bptr[bjj[ip1]];
-	    if (t1>t2) { tt=t1; t1=t2; t2=tt; }
-	    if (t1>t3) { tt=t1; t1=t3; t3=tt; }
-	    if (t2>t3) { tt=t2; t2=t3; t3=tt; }
-	    h123 = (t1*7+t2*330+t3*4199)%hlen1-1;
-	    for (j=0;j<hlen1;j++)
-	       {
-	       h123++; if (h123>=hlen1) h123 = 0;
-	       if (hash1[0][h123]==0) goto stor1;
-	       if (hash1[1][h123]!=t1) continue;
-	       if (hash1[2][h123]!=t2) continue;
-	       if (hash1[3][h123]!=t3) continue;
-	       hash1[0][h123]++; goto done1;
-	       }
-	    printf("debug:trict %d\n",trict);
-	    /*mifcb2 = mi_fopen("hash1dbg","w");
-	    lab[0] = '\0';
-	    mi_labwr(mifcb2,lab,0,0,"graphics","polytr");
-	    mg_put(mifcb2,1,4,hlen1,hash1[0]);
-	    mg_put(mifcb2,2,4,hlen1,hash1[1]);
-	    mg_put(mifcb2,3,4,hlen1,hash1[2]);
-	    mg_put(mifcb2,4,4,hlen1,hash1[3]);
-	    fclose(mifcb2);
-	    zmabend("hash error 1");*/
-	    stor1: hash1[1][h123] = t1;
-		   hash1[2][h123] = t2;
-		   hash1[3][h123] = t3;
-		   hash1[0][h123] = 1;
-		   /*if (bgg)
-		      {
-		      printf("###########saving h123 %d\n",h123);
-		      printf("ibig,ptr,i %d %d %d\n",ibig,ptr,i);
-		      for (k=0;k<ptr;k++)
-			 printf("k,bjj[k],bptr[bjj[k]] %d %d %d\n",
-				   k,bjj[k],bptr[bjj[k]]);
-		      }*/
-		   trict++;
-		   continue;
-	    done1: continue;
+	    h123++; if (h123>=hlen1) h123 = 0;
+	    if (hash1[0][h123]==0) goto stor1;
+	    if (hash1[1][h123]!=t1) continue;
+	    if (hash1[2][h123]!=t2) continue;
+	    if (hash1[3][h123]!=t3) continue;
+	    hash1[0][h123]++; goto done1;
 	    }
+	 stor1: hash1[1][h123] = t1;
+		hash1[2][h123] = t2;
+		hash1[3][h123] = t3;
+		hash1[0][h123] = 1;
+		trict++;
+		continue;
+	 done1: continue;
 	 }
       }
+   for (ic=0;ic<st.nchunk;ic++)
+      {
+      free(st.chunk[ic].tri);
+      free(st.chunk[ic].off);
+      }
+   free(st.chunk);
 
    /* condense the triangles, then remove intersecting triangles that
        result from perfect grid squares, prefer higher count duplicated
@@ -585,36 +749,502 @@ void thiessen( int npoints, int * nlinret, double reject, double skinny, int abe
       (*tcon3)[trict++] = tc[3][i];
       }
 
-   /* now sort the triangles in vertical order, as required by tiegrid */
-
    mz_free2((unsigned char **)tc,4);
-   mz_alloc1((unsigned char **)&buf,trict,8);
-   mz_alloc1((unsigned char **)&bptr,trict,4);
-   for (i=0;i<trict;i++)
+   tri_finish(npoints,ptx,pty,trict,*tcon1,*tcon2,*tcon3,ntriang,nlinret);
+   return;
+}
+
+/* delaunay triangulation by incremental insertion (Bowyer-Watson)     */
+/*                                                                      */
+/* the points are inserted in a biased randomized order: each point is  */
+/* assigned to a round (about half of them to the last, a quarter to    */
+/* the one before, and so on) and the rounds are taken in order, each   */
+/* in hilbert curve order, so that every insertion starts its walk      */
+/* near where the last one ended. the hull is closed with ghost         */
+/* triangles through a vertex at infinity, so no bounding triangle is   */
+/* needed. orientation and incircle tests are exact: a floating point   */
+/* result is used when it is certain and otherwise the determinant is   */
+/* evaluated in expansion arithmetic.                                   */
+
+#define DT_INF          -1      /* the vertex at infinity */
+#define DT_ROUNDS       16      /* insertion rounds for the biased order */
+#define DT_MAXEXP       2048    /* expansion length for exact incircle */
+#define DT_HILBERT_BITS 24      /* so round and hilbert index fit a double */
+
+typedef struct
+{
+   double *x,*y;                /* points in insertion order */
+   int npts;
+   int *v,*n;                   /* v[3t+i] vertex i of triangle t (ccw), */
+                                /* n[3t+i] the triangle across from it   */
+   int ntri,cap;
+   int *mark,stamp;             /* cavity membership */
+   int *stack,*cav,*bnd,ncap;   /* cavity triangles and boundary edges */
+   int *vstart;                 /* new triangle starting at each vertex */
+   int last;                    /* a real triangle to start walks from */
+   unsigned int seed;
+} DelaunayMesh;
+
+/* exact arithmetic after Shewchuk, "Adaptive precision floating-point */
+/* arithmetic and fast robust geometric predicates", 1997              */
+
+#define DT_EPSILON      (DBL_EPSILON/2.0)
+#define DT_CCWBOUND     ((3.0+16.0*DT_EPSILON)*DT_EPSILON)
+#define DT_ICCBOUND     ((10.0+96.0*DT_EPSILON)*DT_EPSILON)
+
+static void dt_two_sum( double a, double b, double * x, double * y )
+{
+   double bv,av;
+
+   *x = a+b;
+   bv = *x-a;
+   av = *x-bv;
+   *y = (a-av)+(b-bv);
+}
+
+static void dt_two_diff( double a, double b, double * e )
+{
+   double bv,av;
+
+   e[1] = a-b;
+   bv = a-e[1];
+   av = e[1]+bv;
+   e[0] = (a-av)+(bv-b);
+}
+
+/* the rounding error of a*b is exact as a fused multiply-add, whether */
+/* or not the compiler contracts other expressions into one            */
+
+static void dt_two_product( double a, double b, double * x, double * y )
+{
+   *x = a*b;
+   *y = fma(a,b,-*x);
+}
+
+/* h = h + b, in place; components in increasing magnitude, no zeros */
+
+static int dt_grow( int hlen, double * h, double b )
+{
+   int i,k;
+   double q,hh;
+
+   q = b;
+   for (i=0,k=0;i<hlen;i++)
       {
-      buf[i] = ptx[(*tcon1)[i]-1]+ptx[(*tcon2)[i]-1]+ptx[(*tcon3)[i]-1];
-      bptr[i] = i+1;
+      dt_two_sum(q,h[i],&q,&hh);
+      if (hh!=0.0) h[k++] = hh;
       }
-   sort8(buf,bptr,trict);
-   sortrec4(*tcon1,bptr,trict);
-   sortrec4(*tcon2,bptr,trict);
-   sortrec4(*tcon3,bptr,trict);
+   if (q!=0.0 || k==0) h[k++] = q;
+   return(k);
+}
 
-   /* triangles also have to be clockwise */
+/* h = e * b */
 
-   for (i=0;i<trict;i++)
+static int dt_scale( int elen, double * e, double b, double * h )
+{
+   int i,k;
+   double q,sum,hh,p1,p0;
+
+   k = 0;
+   dt_two_product(e[0],b,&q,&hh);
+   if (hh!=0.0) h[k++] = hh;
+   for (i=1;i<elen;i++)
       {
-      tstarea = triarea((double)(ptx[(*tcon1)[i]-1]),(double)(pty[(*tcon1)[i]-1]),
-		 (double)(ptx[(*tcon2)[i]-1]),(double)(pty[(*tcon2)[i]-1]),
-		 (double)(ptx[(*tcon3)[i]-1]),(double)(pty[(*tcon3)[i]-1]));
-      if (tstarea>0.0) continue;
-      temp = (*tcon3)[i]; (*tcon3)[i] = (*tcon1)[i]; (*tcon1)[i] = temp;
+      dt_two_product(e[i],b,&p1,&p0);
+      dt_two_sum(q,p0,&sum,&hh);
+      if (hh!=0.0) h[k++] = hh;
+      q = p1+sum; hh = sum-(q-p1);
+      if (hh!=0.0) h[k++] = hh;
       }
+   if (q!=0.0 || k==0) h[k++] = q;
+   return(k);
+}
 
-   *ntriang = trict;             /* can check this with Euler 2P-2-CVXHULL*/
-   *nlinret = npoints+trict-1;   /* using Euler */
-   printf("%d points %d lines %d triangles\n",npoints,*nlinret,trict);
-   free(buf); free(bptr);
+/* h = e * f, using tmp (2*elen) */
+
+static int dt_mul( int elen, double * e, int flen, double * f, double * h, double * tmp )
+{
+   int i,j,hlen,tlen;
+
+   hlen = 0;
+   for (j=0;j<flen;j++)
+      {
+      tlen = dt_scale(elen,e,f[j],tmp);
+      for (i=0;i<tlen;i++) hlen = dt_grow(hlen,h,tmp[i]);
+      }
+   if (hlen==0) { h[0] = 0.0; hlen = 1; }
+   return(hlen);
+}
+
+/* h = h + sign*f, in place */
+
+static int dt_add( int hlen, double * h, int flen, double * f, double sign )
+{
+   int i;
+
+   for (i=0;i<flen;i++) hlen = dt_grow(hlen,h,sign*f[i]);
+   return(hlen);
+}
+
+/* a*d - b*c for two-component expansions */
+
+static int dt_cross( double * a, double * d, double * b, double * c, double * h )
+{
+   double t1[8],t2[8],tmp[4];
+   int l1,l2;
+
+   l1 = dt_mul(2,a,2,d,t1,tmp);
+   l2 = dt_mul(2,b,2,c,t2,tmp);
+   memcpy(h,t1,l1*sizeof(double));
+   return(dt_add(l1,h,l2,t2,-1.0));
+}
+
+static double dt_orient_exact( double ax, double ay, double bx, double by, double cx, double cy )
+{
+   double acx[2],acy[2],bcx[2],bcy[2],det[16];
+   int len;
+
+   dt_two_diff(ax,cx,acx); dt_two_diff(ay,cy,acy);
+   dt_two_diff(bx,cx,bcx); dt_two_diff(by,cy,bcy);
+   len = dt_cross(acx,bcy,acy,bcx,det);
+   return(det[len-1]);
+}
+
+/* positive if a,b,c are counterclockwise (x east, y north) */
+
+static double dt_orient( double ax, double ay, double bx, double by, double cx, double cy )
+{
+   double detleft,detright,det;
+
+   detleft = (ax-cx)*(by-cy);
+   detright = (ay-cy)*(bx-cx);
+   det = detleft-detright;
+   if (fabs(det)>DT_CCWBOUND*(fabs(detleft)+fabs(detright))) return(det);
+   return(dt_orient_exact(ax,ay,bx,by,cx,cy));
+}
+
+static double dt_incircle_exact( double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy )
+{
+   double adx[2],ady[2],bdx[2],bdy[2],cdx[2],cdy[2];
+   double lift[16],sq[8],cr[16],tmp[32];
+   double det[DT_MAXEXP],term[DT_MAXEXP/2];
+   int llen,slen,clen,tlen,dlen,k;
+   double *px[3],*py[3];
+
+   dt_two_diff(ax,dx,adx); dt_two_diff(ay,dy,ady);
+   dt_two_diff(bx,dx,bdx); dt_two_diff(by,dy,bdy);
+   dt_two_diff(cx,dx,cdx); dt_two_diff(cy,dy,cdy);
+   px[0] = adx; py[0] = ady;
+   px[1] = bdx; py[1] = bdy;
+   px[2] = cdx; py[2] = cdy;
+
+   /* det = sum over k of lift(k) * cross(k+1,k+2) */
+
+   dlen = 0;
+   for (k=0;k<3;k++)
+      {
+      llen = dt_mul(2,px[k],2,px[k],lift,tmp);
+      slen = dt_mul(2,py[k],2,py[k],sq,tmp);
+      llen = dt_add(llen,lift,slen,sq,1.0);
+      clen = dt_cross(px[(k+1)%3],py[(k+2)%3],px[(k+2)%3],py[(k+1)%3],cr);
+      tlen = dt_mul(llen,lift,clen,cr,term,tmp);
+      dlen = dt_add(dlen,det,tlen,term,1.0);
+      }
+   return(det[dlen-1]);
+}
+
+/* positive if d is inside the circle through the ccw triangle a,b,c */
+
+static double dt_incircle( double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy )
+{
+   double adx,ady,bdx,bdy,cdx,cdy;
+   double bdxcdy,cdxbdy,cdxady,adxcdy,adxbdy,bdxady;
+   double alift,blift,clift,det,permanent;
+
+   adx = ax-dx; ady = ay-dy;
+   bdx = bx-dx; bdy = by-dy;
+   cdx = cx-dx; cdy = cy-dy;
+   bdxcdy = bdx*cdy; cdxbdy = cdx*bdy; alift = adx*adx+ady*ady;
+   cdxady = cdx*ady; adxcdy = adx*cdy; blift = bdx*bdx+bdy*bdy;
+   adxbdy = adx*bdy; bdxady = bdx*ady; clift = cdx*cdx+cdy*cdy;
+   det = alift*(bdxcdy-cdxbdy)+blift*(cdxady-adxcdy)+clift*(adxbdy-bdxady);
+   permanent = (fabs(bdxcdy)+fabs(cdxbdy))*alift+
+	       (fabs(cdxady)+fabs(adxcdy))*blift+
+	       (fabs(adxbdy)+fabs(bdxady))*clift;
+   if (fabs(det)>DT_ICCBOUND*permanent) return(det);
+   return(dt_incircle_exact(ax,ay,bx,by,cx,cy,dx,dy));
+}
+
+/* hilbert curve index of (hx,hy) on a 2^24 square grid */
+
+static double dt_hilbert( unsigned int hx, unsigned int hy )
+{
+   unsigned int rx,ry,s,t;
+   double d;
+
+   d = 0.0;
+   for (s=1u<<(DT_HILBERT_BITS-1);s>0;s>>=1)
+      {
+      rx = (hx&s)>0;
+      ry = (hy&s)>0;
+      d += (double)s*(double)s*(double)((3*rx)^ry);
+      if (ry==0)
+	 {
+	 if (rx==1) { hx = s-1-hx; hy = s-1-hy; }
+	 t = hx; hx = hy; hy = t;
+	 }
+      }
+   return(d);
+}
+
+/* ghost triangle (u,v,inf) is in conflict with p if p is outside the */
+/* hull edge u,v or on its interior                                   */
+
+static int dt_ghost_conflict( DelaunayMesh * m, int u, int w, int p )
+{
+   double o;
+
+   o = dt_orient(m->x[u],m->y[u],m->x[w],m->y[w],m->x[p],m->y[p]);
+   if (o>0.0) return(1);
+   if (o<0.0) return(0);
+   if (m->x[u]!=m->x[w])
+      return(m->x[p]>MIN(m->x[u],m->x[w]) && m->x[p]<MAX(m->x[u],m->x[w]));
+   return(m->y[p]>MIN(m->y[u],m->y[w]) && m->y[p]<MAX(m->y[u],m->y[w]));
+}
+
+static int dt_conflict( DelaunayMesh * m, int t, int p )
+{
+   int a,b,c;
+
+   a = m->v[3*t]; b = m->v[3*t+1]; c = m->v[3*t+2];
+   if (a==DT_INF) return(dt_ghost_conflict(m,b,c,p));
+   if (b==DT_INF) return(dt_ghost_conflict(m,c,a,p));
+   if (c==DT_INF) return(dt_ghost_conflict(m,a,b,p));
+   return(dt_incircle(m->x[a],m->y[a],m->x[b],m->y[b],m->x[c],m->y[c],
+		      m->x[p],m->y[p])>0.0);
+}
+
+static int dt_new_triangle( DelaunayMesh * m )
+{
+   if (m->ntri==m->cap)
+      {
+      m->cap = 2*m->cap+16;
+      m->v = (int *)realloc(m->v,3*m->cap*sizeof(int));
+      m->n = (int *)realloc(m->n,3*m->cap*sizeof(int));
+      m->mark = (int *)realloc(m->mark,m->cap*sizeof(int));
+      if (m->v==NULL || m->n==NULL || m->mark==NULL) zmabend("malloc failed");
+      }
+   m->mark[m->ntri] = 0;
+   return(m->ntri++);
+}
+
+static void dt_set( DelaunayMesh * m, int t, int a, int b, int c, int na, int nb, int nc )
+{
+   m->v[3*t] = a; m->v[3*t+1] = b; m->v[3*t+2] = c;
+   m->n[3*t] = na; m->n[3*t+1] = nb; m->n[3*t+2] = nc;
+}
+
+/* visibility walk from m->last to a triangle in conflict with p */
+
+static int dt_locate( DelaunayMesh * m, int p )
+{
+   int t,prev,k,e,i,a,b,nb;
+
+   t = m->last; prev = -1;
+   for (;;)
+      {
+      m->seed = m->seed*1103515245u+12345u;
+      k = (m->seed>>16)%3;
+      for (e=0;e<3;e++)
+	 {
+	 i = (k+e)%3;
+	 nb = m->n[3*t+i];
+	 if (nb==prev) continue;
+	 a = m->v[3*t+(i+1)%3];
+	 b = m->v[3*t+(i+2)%3];
+	 if (dt_orient(m->x[a],m->y[a],m->x[b],m->y[b],m->x[p],m->y[p])<0.0) break;
+	 }
+      if (e==3) return(t);
+      if (m->v[3*nb]==DT_INF || m->v[3*nb+1]==DT_INF || m->v[3*nb+2]==DT_INF)
+	 return(nb);
+      prev = t; t = nb;
+      }
+}
+
+static void dt_reserve( DelaunayMesh * m, int cnt )
+{
+   if (cnt<m->ncap) return;
+   m->ncap = 2*m->ncap+64;
+   m->stack = (int *)realloc(m->stack,m->ncap*sizeof(int));
+   m->cav = (int *)realloc(m->cav,m->ncap*sizeof(int));
+   m->bnd = (int *)realloc(m->bnd,3*m->ncap*sizeof(int));
+   if (m->stack==NULL || m->cav==NULL || m->bnd==NULL) zmabend("malloc failed");
+}
+
+/* remove the triangles in conflict with p and fill the cavity with */
+/* triangles joining p to its boundary edges                        */
+
+static void dt_insert( DelaunayMesh * m, int p )
+{
+   int t,nb,i,j,k,nstk,ncav,nbnd,a,b,u,w;
+
+   m->stamp++;
+   t = dt_locate(m,p);
+   m->mark[t] = m->stamp;
+   nstk = 0; ncav = 0; nbnd = 0;
+   dt_reserve(m,nstk);
+   m->stack[nstk++] = t;
+   while (nstk>0)
+      {
+      t = m->stack[--nstk];
+      dt_reserve(m,ncav);
+      m->cav[ncav++] = t;
+      for (i=0;i<3;i++)
+	 {
+	 nb = m->n[3*t+i];
+	 if (m->mark[nb]==m->stamp) continue;
+	 if (dt_conflict(m,nb,p))
+	    {
+	    m->mark[nb] = m->stamp;
+	    dt_reserve(m,nstk);
+	    m->stack[nstk++] = nb;
+	    continue;
+	    }
+	 dt_reserve(m,nbnd);
+	 m->bnd[3*nbnd] = m->v[3*t+(i+1)%3];
+	 m->bnd[3*nbnd+1] = m->v[3*t+(i+2)%3];
+	 m->bnd[3*nbnd+2] = nb;
+	 nbnd++;
+	 }
+      }
+
+   /* one new triangle (a,b,p) per boundary edge, reusing the cavity */
+
+   for (k=0;k<nbnd;k++)
+      {
+      a = m->bnd[3*k]; b = m->bnd[3*k+1]; nb = m->bnd[3*k+2];
+      if (k<ncav) t = m->cav[k]; else t = dt_new_triangle(m);
+      dt_set(m,t,a,b,p,-1,-1,nb);
+      m->bnd[3*k+2] = t;
+      for (j=0;j<3;j++)
+	 {
+	 u = m->v[3*nb+j];
+	 if (u!=a && u!=b) { m->n[3*nb+j] = t; break; }
+	 }
+      m->vstart[a==DT_INF ? m->npts : a] = t;
+      if (a!=DT_INF && b!=DT_INF) m->last = t;
+      }
+   for (k=0;k<nbnd;k++)
+      {
+      t = m->bnd[3*k+2];
+      b = m->v[3*t+1];
+      w = m->vstart[b==DT_INF ? m->npts : b];
+      m->n[3*t] = w;
+      m->n[3*w+1] = t;
+      }
+}
+
+void delaunay( int npoints, int * nlinret, double reject, double skinny, int abendi, double * ptx, double * pty, int * ntriang, int ** tcon1, int ** tcon2, int ** tcon3 )
+{
+   DelaunayMesh m;
+   int *bptr,*ord,*orig,npts,i,k,t,trict,t0,t1,t2,first;
+   double *buf,*key,bounds[4],xlo,ylo,xhi,yhi,xs,h,area;
+   unsigned int z;
+
+   *ntriang = 0; *nlinret = 0;
+   *tcon1 = *tcon2 = *tcon3 = NULL;
+   npts = tri_points(npoints,reject,abendi,ptx,pty,&buf,&bptr,bounds);
+
+   /* biased randomized insertion order */
+
+   mz_alloc1((unsigned char **)&key,MAX(npts,1),8);
+   mz_alloc1((unsigned char **)&ord,MAX(npts,1),4);
+   xlo = ylo = 1.e300; xhi = yhi = -1.e300;
+   for (i=0;i<npts;i++)
+      {
+      xlo = MIN(xlo,buf[2*i]); xhi = MAX(xhi,buf[2*i]);
+      ylo = MIN(ylo,buf[2*i+1]); yhi = MAX(yhi,buf[2*i+1]);
+      }
+   /* one scale for both axes, so the curve follows elongated data */
+   xs = MAX(xhi-xlo,yhi-ylo);
+   xs = xs>0.0 ? ((double)(1u<<DT_HILBERT_BITS)-1.0)/xs : 0.0;
+   for (i=0;i<npts;i++)
+      {
+      h = dt_hilbert((unsigned int)((buf[2*i]-xlo)*xs),(unsigned int)((buf[2*i+1]-ylo)*xs));
+      z = (unsigned int)bptr[i]*2654435761u;
+      z ^= z>>15; z *= 2246822519u; z ^= z>>13;
+      for (k=DT_ROUNDS-1;k>0 && (z&1);k--) z >>= 1;
+      key[i] = ldexp((double)k,2*DT_HILBERT_BITS)+h;
+      }
+   getSortIndices(key,ord,npts,CART_DOUBLE,1);
+   free(key);
+
+   m.npts = npts;
+   mz_alloc1((unsigned char **)&m.x,MAX(npts,1),8);
+   mz_alloc1((unsigned char **)&m.y,MAX(npts,1),8);
+   mz_alloc1((unsigned char **)&orig,MAX(npts,1),4);
+   for (i=0;i<npts;i++)
+      {
+      m.x[i] = buf[2*ord[i]];
+      m.y[i] = buf[2*ord[i]+1];
+      orig[i] = bptr[ord[i]];
+      }
+   free(buf); free(bptr); free(ord);
+
+   /* start from the first three points that are not collinear */
+
+   for (first=2;first<npts;first++)
+      if (dt_orient(m.x[0],m.y[0],m.x[1],m.y[1],m.x[first],m.y[first])!=0.0) break;
+   if (first>=npts)
+      {
+      free(m.x); free(m.y); free(orig);
+      printf("%d points are collinear, no triangles\n",npoints);
+      return;
+      }
+   m.v = m.n = m.mark = NULL; m.ntri = m.cap = 0;
+   m.stack = m.cav = m.bnd = NULL; m.ncap = 0;
+   m.stamp = 0; m.seed = 1;
+   mz_alloc1((unsigned char **)&m.vstart,npts+1,4);
+
+   t0 = 0; t1 = 1; t2 = first;
+   if (dt_orient(m.x[t0],m.y[t0],m.x[t1],m.y[t1],m.x[t2],m.y[t2])<0.0) { t1 = first; t2 = 1; }
+   for (i=0;i<4;i++) dt_new_triangle(&m);
+   dt_set(&m,0,t0,t1,t2,1,2,3);
+   dt_set(&m,1,t2,t1,DT_INF,3,2,0);
+   dt_set(&m,2,t0,t2,DT_INF,1,3,0);
+   dt_set(&m,3,t1,t0,DT_INF,2,1,0);
+   m.last = 0;
+
+   for (i=2;i<npts;i++)
+      {
+      if (i==first) continue;
+      dt_insert(&m,i);
+      }
+
+   /* keep the real triangles that are not too thin */
+
+   trict = 0;
+   for (t=0;t<m.ntri;t++)
+      if (m.v[3*t]!=DT_INF && m.v[3*t+1]!=DT_INF && m.v[3*t+2]!=DT_INF) trict++;
+   mz_alloc1((unsigned char **)tcon1,MAX(trict,1),4);
+   mz_alloc1((unsigned char **)tcon2,MAX(trict,1),4);
+   mz_alloc1((unsigned char **)tcon3,MAX(trict,1),4);
+   trict = 0;
+   for (t=0;t<m.ntri;t++)
+      {
+      t0 = m.v[3*t]; t1 = m.v[3*t+1]; t2 = m.v[3*t+2];
+      if (t0==DT_INF || t1==DT_INF || t2==DT_INF) continue;
+      area = triarea(m.x[t0],m.y[t0],m.x[t1],m.y[t1],m.x[t2],m.y[t2]);
+      if (fabs(area)<skinny) continue;
+      (*tcon1)[trict] = orig[t0];
+      (*tcon2)[trict] = orig[t1];
+      (*tcon3)[trict++] = orig[t2];
+      }
+
+   free(m.x); free(m.y); free(orig); free(m.vstart);
+   free(m.v); free(m.n); free(m.mark);
+   free(m.stack); free(m.cav); free(m.bnd);
+   tri_finish(npoints,ptx,pty,trict,*tcon1,*tcon2,*tcon3,ntriang,nlinret);
    return;
 }
 
@@ -627,3 +1257,134 @@ int insidetri( double x, double y, double x1, double y1, double x2, double y2, d
 }
 
  
+
+TriLocator * trilocator_build( double * ptx, double * pty, int ntriang, int * tcon1, int * tcon2, int * tcon3 )
+{
+   TriLocator *loc;
+   int i,j,k,t,a,b,c,ix0,ix1,iy0,iy1,nbuck,*fill;
+   double xlo,ylo,xhi,yhi,bx0,by0,bx1,by1,cell,area;
+
+   if ((loc=(TriLocator *)malloc(sizeof(TriLocator)))==NULL) zmabend("malloc failed");
+   loc->ptx = ptx; loc->pty = pty;
+   mz_alloc1((unsigned char **)&loc->v,3*MAX(ntriang,1),4);
+
+   /* keep the triangles with area, ordered as insidetri expects */
+
+   xlo = ylo = 1.e300; xhi = yhi = -1.e300;
+   for (i=0,t=0;i<ntriang;i++)
+      {
+      a = tcon1[i]-1; b = tcon2[i]-1; c = tcon3[i]-1;
+      area = triarea(ptx[a],pty[a],ptx[b],pty[b],ptx[c],pty[c]);
+      if (area<0.0) { k = a; a = c; c = k; }
+      else if (area==0.0) a = -1;
+      loc->v[3*i] = a; loc->v[3*i+1] = b; loc->v[3*i+2] = c;
+      if (a<0) continue;
+      t++;
+      xlo = MIN(xlo,MIN(ptx[a],MIN(ptx[b],ptx[c])));
+      xhi = MAX(xhi,MAX(ptx[a],MAX(ptx[b],ptx[c])));
+      ylo = MIN(ylo,MIN(pty[a],MIN(pty[b],pty[c])));
+      yhi = MAX(yhi,MAX(pty[a],MAX(pty[b],pty[c])));
+      }
+   loc->ntri = ntriang;
+
+   /* about one bucket per triangle, square in shape */
+
+   if (t==0) { xlo = ylo = 0.0; xhi = yhi = 1.0; }
+   cell = sqrt(MAX((xhi-xlo)*(yhi-ylo),1.e-300)/(double)MAX(t,1));
+   if (cell<=0.0) cell = MAX(xhi-xlo,yhi-ylo)/(double)MAX(t,1);
+   if (cell<=0.0) cell = 1.0;
+   loc->nx = (int)MIN((xhi-xlo)/cell+1.0,(double)MAX(t,1));
+   loc->ny = (int)MIN((yhi-ylo)/cell+1.0,(double)MAX(t,1));
+   loc->nx = MAX(loc->nx,1); loc->ny = MAX(loc->ny,1);
+   loc->xlo = xlo; loc->ylo = ylo;
+   loc->xscale = xhi>xlo ? loc->nx/(xhi-xlo) : 0.0;
+   loc->yscale = yhi>ylo ? loc->ny/(yhi-ylo) : 0.0;
+   nbuck = loc->nx*loc->ny;
+
+   /* count, then fill, the bucket lists */
+
+   mz_alloc1((unsigned char **)&loc->start,nbuck+1,4);
+   mz_alloc1((unsigned char **)&fill,nbuck,4);
+   for (k=0;k<=nbuck;k++) loc->start[k] = 0;
+   for (k=0;k<2;k++)
+      {
+      for (i=0;i<ntriang;i++)
+	 {
+	 a = loc->v[3*i]; b = loc->v[3*i+1]; c = loc->v[3*i+2];
+	 if (a<0) continue;
+	 bx0 = MIN(ptx[a],MIN(ptx[b],ptx[c])); bx1 = MAX(ptx[a],MAX(ptx[b],ptx[c]));
+	 by0 = MIN(pty[a],MIN(pty[b],pty[c])); by1 = MAX(pty[a],MAX(pty[b],pty[c]));
+	 ix0 = MIN((int)((bx0-xlo)*loc->xscale),loc->nx-1);
+	 ix1 = MIN((int)((bx1-xlo)*loc->xscale),loc->nx-1);
+	 iy0 = MIN((int)((by0-ylo)*loc->yscale),loc->ny-1);
+	 iy1 = MIN((int)((by1-ylo)*loc->yscale),loc->ny-1);
+	 for (j=iy0;j<=iy1;j++)
+	    for (t=ix0;t<=ix1;t++)
+	       {
+	       if (k==0) loc->start[j*loc->nx+t+1]++;
+	       else loc->list[fill[j*loc->nx+t]++] = i;
+	       }
+	 }
+      if (k==0)
+	 {
+	 for (j=0;j<nbuck;j++) loc->start[j+1] += loc->start[j];
+	 for (j=0;j<nbuck;j++) fill[j] = loc->start[j];
+	 mz_alloc1((unsigned char **)&loc->list,MAX(loc->start[nbuck],1),4);
+	 }
+      }
+   free(fill);
+   return(loc);
+}
+
+void trilocator_free( TriLocator * loc )
+{
+   free(loc->v);
+   free(loc->start);
+   free(loc->list);
+   free(loc);
+   return;
+}
+
+static int trilocator_inside( TriLocator * loc, int t, double x, double y )
+{
+   int *v;
+
+   v = &loc->v[3*t];
+   if (v[0]<0) return(0);
+   return(insidetri(x,y,loc->ptx[v[0]],loc->pty[v[0]],loc->ptx[v[1]],loc->pty[v[1]],
+		    loc->ptx[v[2]],loc->pty[v[2]]));
+}
+
+int trilocate( TriLocator * loc, double x, double y, int * hint )
+{
+   int ix,iy,c,k,t;
+   double fx,fy;
+
+   if (*hint>=0 && *hint<loc->ntri && trilocator_inside(loc,*hint,x,y)) return(*hint);
+
+   fx = (x-loc->xlo)*loc->xscale;
+   fy = (y-loc->ylo)*loc->yscale;
+   if (fx<0.0 || fy<0.0 || fx>(double)loc->nx || fy>(double)loc->ny) return(-1);
+   ix = MIN((int)fx,loc->nx-1);
+   iy = MIN((int)fy,loc->ny-1);
+   c = iy*loc->nx+ix;
+   for (k=loc->start[c];k<loc->start[c+1];k++)
+      {
+      t = loc->list[k];
+      if (trilocator_inside(loc,t,x,y)) { *hint = t; return(t); }
+      }
+   return(-1);
+}
+
+void trilocate_line( TriLocator * loc, double * x, double * y, int n, int * tri )
+{
+   int i,hint;
+
+   hint = -1;
+   for (i=0;i<n;i++)
+      {
+      tri[i] = trilocate(loc,x[i],y[i],&hint);
+      if (tri[i]<0) hint = -1;
+      }
+   return;
+}
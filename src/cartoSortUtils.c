@@ -1,8 +1,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
 
 #include "carto/cartoSortUtils.h"
+#include "carto/thread_manager.h"
 #include "carto/cartoStrUtils.h"
 #include "carto/cartoVicarProtos.h"
 
@@ -90,11 +93,532 @@ int compare(void *array, int index1, int index2, int type)
 }
 
 /***************************************************/
-/* This function performs selection sort on the    */
-/* unsorted array and stores the SORTED ORDER      */
-/* INDICES into indices array.  This function      */
-/* does not move around the data but only returns  */
-/* what the sorted index would be inside indices.  */
+/* These functions map a value of each CART_* type */
+/* to an unsigned key with the same ordering, so   */
+/* that every type can be sorted the same way.     */
+/* Negative floats have all bits flipped and       */
+/* positive ones only the sign bit; NaNs end up    */
+/* past the infinities of the same sign.  -0 is    */
+/* keyed as +0, since the two compare equal.       */
+/***************************************************/
+static uint64_t sortKeyDouble(double x)
+{
+   uint64_t u;
+
+   if (x == 0.0) x = 0.0;
+   memcpy(&u, &x, sizeof(u));
+   return (u & 0x8000000000000000ULL) ? ~u : (u | 0x8000000000000000ULL);
+}
+
+static uint64_t sortKeyFloat(float x)
+{
+   uint32_t u;
+
+   if (x == 0.0f) x = 0.0f;
+   memcpy(&u, &x, sizeof(u));
+   return (u & 0x80000000U) ? (uint32_t)~u : (u | 0x80000000U);
+}
+
+static uint64_t sortKeySigned(int64_t x, int nbytes)
+{
+   uint64_t sign, mask;
+
+   sign = (uint64_t)1 << (8*nbytes - 1);
+   mask = (nbytes == 8) ? ~(uint64_t)0 : (((uint64_t)1 << (8*nbytes)) - 1);
+   return ((uint64_t)x ^ sign) & mask;
+}
+
+/***************************************************/
+/* This function undoes sortKeySigned.  The float  */
+/* keys lose the sign of zero, so float data is    */
+/* moved rather than rebuilt from its keys.        */
+/***************************************************/
+static int sortKeyToInt(uint64_t k)
+{
+   // the key is x + 2^(w-1) for an int x of w bits
+   return (int)((int64_t)k - ((int64_t)1 << (8*sizeof(int) - 1)));
+}
+
+/***************************************************/
+/* This function returns a newly allocated array   */
+/* of the n keys for data of the given CART_*      */
+/* type, and the number of bytes that can differ   */
+/* between keys in nbytes. Returns NULL for an     */
+/* unknown type.                                   */
+/***************************************************/
+static uint64_t* getSortKeys(void *data, int n, int type, int *nbytes)
+{
+   int i;
+   uint64_t *key;
+
+   key = (uint64_t*)malloc(sizeof(uint64_t)*(n > 0 ? n : 1));
+   if(key == NULL) zmabend("malloc failed");
+
+   switch(type)
+   {
+      case CART_CHAR:
+         *nbytes = 1;
+         for(i = 0; i < n; i++)
+            key[i] = (CHAR_MIN < 0) ? sortKeySigned(((char*)data)[i], 1) : (uint64_t)(unsigned char)((char*)data)[i];
+         break;
+      case CART_SHORT:
+         *nbytes = sizeof(short int);
+         for(i = 0; i < n; i++) key[i] = sortKeySigned(((short int*)data)[i], sizeof(short int));
+         break;
+      case CART_INT:
+         *nbytes = sizeof(int);
+         for(i = 0; i < n; i++) key[i] = sortKeySigned(((int*)data)[i], sizeof(int));
+         break;
+      case CART_FLOAT:
+         *nbytes = 4;
+         for(i = 0; i < n; i++) key[i] = sortKeyFloat(((float*)data)[i]);
+         break;
+      case CART_DOUBLE:
+         *nbytes = 8;
+         for(i = 0; i < n; i++) key[i] = sortKeyDouble(((double*)data)[i]);
+         break;
+      case CART_LONG:
+         *nbytes = sizeof(long int);
+         for(i = 0; i < n; i++) key[i] = sortKeySigned(((long int*)data)[i], sizeof(long int));
+         break;
+      case CART_UCHAR:
+         *nbytes = 1;
+         for(i = 0; i < n; i++) key[i] = ((unsigned char*)data)[i];
+         break;
+      case CART_USHORT:
+         *nbytes = sizeof(unsigned short int);
+         for(i = 0; i < n; i++) key[i] = ((unsigned short int*)data)[i];
+         break;
+      case CART_UINT:
+         *nbytes = sizeof(unsigned int);
+         for(i = 0; i < n; i++) key[i] = ((unsigned int*)data)[i];
+         break;
+      case CART_ULONG:
+         *nbytes = sizeof(unsigned long int);
+         for(i = 0; i < n; i++) key[i] = ((unsigned long int*)data)[i];
+         break;
+      default:
+         free(key);
+         return NULL;
+   }
+
+   return key;
+}
+
+/***************************************************/
+/* This function sorts key ascending and applies   */
+/* the same permutation to idx, keeping equal keys */
+/* in their original order. Only the low nbytes    */
+/* bytes of the keys are used. Short arrays use    */
+/* insertion sort, longer ones an LSD radix sort   */
+/* on bytes, skipping bytes that all keys share.   */
+/***************************************************/
+#define RADIX_MIN_N 64
+
+static void radixSortKeys(uint64_t *key, int *idx, int n, int nbytes)
+{
+   int i, b, pos;
+   int *count, *idx2, *isrc, *idst, *itmp;
+   uint64_t *key2, *ksrc, *kdst, *ktmp;
+
+   if(n < 2) return;
+
+   if(n < RADIX_MIN_N)
+   {
+      for(i = 1; i < n; i++)
+      {
+         int j, ti;
+         uint64_t tk;
+
+         tk = key[i];
+         ti = idx[i];
+         for(j = i - 1; j >= 0 && key[j] > tk; j--)
+         {
+            key[j+1] = key[j];
+            idx[j+1] = idx[j];
+         }
+         key[j+1] = tk;
+         idx[j+1] = ti;
+      }
+      return;
+   }
+
+   count = (int*)calloc(256*nbytes, sizeof(int));
+   key2 = (uint64_t*)malloc(sizeof(uint64_t)*n);
+   idx2 = (int*)malloc(sizeof(int)*n);
+   if(count == NULL || key2 == NULL || idx2 == NULL) zmabend("malloc failed");
+
+   // histogram every byte in one read of the keys
+   for(i = 0; i < n; i++)
+      for(b = 0; b < nbytes; b++)
+         ++count[256*b + ((key[i] >> (8*b)) & 0xff)];
+
+   ksrc = key;
+   isrc = idx;
+   kdst = key2;
+   idst = idx2;
+   for(b = 0; b < nbytes; b++)
+   {
+      int *c, sum, t;
+
+      c = count + 256*b;
+      if(c[(ksrc[0] >> (8*b)) & 0xff] == n) continue;
+
+      sum = 0;
+      for(i = 0; i < 256; i++)
+      {
+         t = c[i];
+         c[i] = sum;
+         sum += t;
+      }
+      for(i = 0; i < n; i++)
+      {
+         pos = c[(ksrc[i] >> (8*b)) & 0xff]++;
+         kdst[pos] = ksrc[i];
+         idst[pos] = isrc[i];
+      }
+
+      ktmp = ksrc; ksrc = kdst; kdst = ktmp;
+      itmp = isrc; isrc = idst; idst = itmp;
+   }
+
+   if(ksrc != key)
+   {
+      memcpy(key, ksrc, sizeof(uint64_t)*n);
+      memcpy(idx, isrc, sizeof(int)*n);
+   }
+
+   free(count);
+   free(key2);
+   free(idx2);
+}
+
+/***************************************************/
+/* Work description for one thread of              */
+/* radixSortKeysThreaded. Each thread owns the     */
+/* block [lo,hi) of the source array and its own   */
+/* 256 bucket counts, which become its starting    */
+/* positions in the destination.                   */
+/***************************************************/
+typedef struct
+{
+   uint64_t *ksrc, *kdst;
+   int *isrc, *idst;
+   int lo, hi, shift;
+   int count[256];
+} RadixBlock;
+
+static void* radixCountWorker(void *arg)
+{
+   int i;
+   RadixBlock *blk;
+
+   blk = (RadixBlock*)arg;
+   memset(blk->count, 0, sizeof(blk->count));
+   for(i = blk->lo; i < blk->hi; i++)
+      ++(blk->count)[(blk->ksrc[i] >> blk->shift) & 0xff];
+
+   return NULL;
+}
+
+static void* radixScatterWorker(void *arg)
+{
+   int i, pos;
+   RadixBlock *blk;
+
+   blk = (RadixBlock*)arg;
+   for(i = blk->lo; i < blk->hi; i++)
+   {
+      pos = (blk->count)[(blk->ksrc[i] >> blk->shift) & 0xff]++;
+      blk->kdst[pos] = blk->ksrc[i];
+      blk->idst[pos] = blk->isrc[i];
+   }
+
+   return NULL;
+}
+
+/***************************************************/
+/* This function is radixSortKeys split across     */
+/* nthreads threads (get_thread_count() if <= 0).  */
+/* Each byte pass counts the blocks in parallel,   */
+/* then scatters them in parallel; block t's       */
+/* entries of a bucket go after those of blocks    */
+/* before it, so the sort stays stable and the     */
+/* result is the same as radixSortKeys. Arrays     */
+/* too short to be worth the threads are sorted    */
+/* serially.                                       */
+/***************************************************/
+#define RADIX_THREAD_MIN_N 65536
+
+static void radixSortKeysThreaded(uint64_t *key, int *idx, int n, int nbytes, int nthreads)
+{
+   int i, b, t, sum, total;
+   int *idx0, *idx2, *itmp;
+   uint64_t *key0, *key2, *ktmp;
+   RadixBlock *blk;
+
+   if(nthreads <= 0) nthreads = get_thread_count();
+   if(nthreads > n/RADIX_THREAD_MIN_N) nthreads = n/RADIX_THREAD_MIN_N;
+   if(nthreads <= 1)
+   {
+      radixSortKeys(key, idx, n, nbytes);
+      return;
+   }
+
+   blk = (RadixBlock*)malloc(sizeof(RadixBlock)*nthreads);
+   key2 = (uint64_t*)malloc(sizeof(uint64_t)*n);
+   idx2 = (int*)malloc(sizeof(int)*n);
+   if(blk == NULL || key2 == NULL || idx2 == NULL) zmabend("malloc failed");
+   key0 = key;
+   idx0 = idx;
+
+   for(t = 0; t < nthreads; t++)
+   {
+      blk[t].lo = (int)(((long)n*t)/nthreads);
+      blk[t].hi = (int)(((long)n*(t+1))/nthreads);
+      blk[t].ksrc = key;
+      blk[t].isrc = idx;
+      blk[t].kdst = key2;
+      blk[t].idst = idx2;
+   }
+
+   for(b = 0; b < nbytes; b++)
+   {
+      for(t = 0; t < nthreads; t++) blk[t].shift = 8*b;
+      run_threads(nthreads, radixCountWorker, (void*)blk, sizeof(RadixBlock));
+
+      // skip a byte all keys share
+      total = 0;
+      for(t = 0; t < nthreads; t++) total += blk[t].count[(key[0] >> (8*b)) & 0xff];
+      if(total == n) continue;
+
+      sum = 0;
+      for(i = 0; i < 256; i++)
+         for(t = 0; t < nthreads; t++)
+         {
+            total = blk[t].count[i];
+            blk[t].count[i] = sum;
+            sum += total;
+         }
+      run_threads(nthreads, radixScatterWorker, (void*)blk, sizeof(RadixBlock));
+
+      ktmp = key; key = key2; key2 = ktmp;
+      itmp = idx; idx = idx2; idx2 = itmp;
+      for(t = 0; t < nthreads; t++)
+      {
+         blk[t].ksrc = key;
+         blk[t].isrc = idx;
+         blk[t].kdst = key2;
+         blk[t].idst = idx2;
+      }
+   }
+
+   // an odd number of passes leaves the result in the work arrays
+   if(key != key0)
+   {
+      memcpy(key0, key, sizeof(uint64_t)*n);
+      memcpy(idx0, idx, sizeof(int)*n);
+      key2 = key;
+      idx2 = idx;
+   }
+
+   free(blk);
+   free(key2);
+   free(idx2);
+}
+
+/***************************************************/
+/* This function is a helper for introSortKeys.    */
+/* It heap sorts key[lo..hi) and idx with it.      */
+/***************************************************/
+static void heapSortKeys(uint64_t *key, int *idx, int lo, int hi)
+{
+   int i, j, k, m, ti;
+   uint64_t tk;
+
+   m = hi - lo;
+   key += lo;
+   idx += lo;
+   for(i = m/2 - 1; i >= -m + 1; i--)
+   {
+      // first build the heap (i >= 0), then pop (i < 0)
+      if(i < 0)
+      {
+         j = m + i;
+         tk = key[0]; key[0] = key[j]; key[j] = tk;
+         ti = idx[0]; idx[0] = idx[j]; idx[j] = ti;
+         k = 0;
+      }
+      else
+      {
+         j = m;
+         k = i;
+      }
+
+      tk = key[k];
+      ti = idx[k];
+      while(2*k+1 < j)
+      {
+         int c;
+
+         c = 2*k+1;
+         if(c+1 < j && key[c+1] > key[c]) ++c;
+         if(key[c] <= tk) break;
+         key[k] = key[c];
+         idx[k] = idx[c];
+         k = c;
+      }
+      key[k] = tk;
+      idx[k] = ti;
+   }
+}
+
+/***************************************************/
+/* This function is a helper for introSortKeys.    */
+/* It quick sorts key[lo..hi) down to runs of 16,  */
+/* switching to heap sort when the recursion gets  */
+/* deeper than depth.                              */
+/***************************************************/
+static void introSortRange(uint64_t *key, int *idx, int lo, int hi, int depth)
+{
+   int i, j, mid, ti;
+   uint64_t piv, tk;
+
+   while(hi - lo > 16)
+   {
+      if(depth-- == 0)
+      {
+         heapSortKeys(key, idx, lo, hi);
+         return;
+      }
+
+      // median of three
+      mid = lo + (hi - lo)/2;
+      if(key[mid] < key[lo])
+      {
+         tk = key[mid]; key[mid] = key[lo]; key[lo] = tk;
+         ti = idx[mid]; idx[mid] = idx[lo]; idx[lo] = ti;
+      }
+      if(key[hi-1] < key[lo])
+      {
+         tk = key[hi-1]; key[hi-1] = key[lo]; key[lo] = tk;
+         ti = idx[hi-1]; idx[hi-1] = idx[lo]; idx[lo] = ti;
+      }
+      if(key[hi-1] < key[mid])
+      {
+         tk = key[hi-1]; key[hi-1] = key[mid]; key[mid] = tk;
+         ti = idx[hi-1]; idx[hi-1] = idx[mid]; idx[mid] = ti;
+      }
+      piv = key[mid];
+
+      i = lo;
+      j = hi - 1;
+      while(i <= j)
+      {
+         while(key[i] < piv) ++i;
+         while(key[j] > piv) --j;
+         if(i <= j)
+         {
+            tk = key[i]; key[i] = key[j]; key[j] = tk;
+            ti = idx[i]; idx[i] = idx[j]; idx[j] = ti;
+            ++i;
+            --j;
+         }
+      }
+
+      // recurse into the smaller side, loop on the larger
+      if(j - lo < hi - i)
+      {
+         introSortRange(key, idx, lo, j+1, depth);
+         lo = i;
+      }
+      else
+      {
+         introSortRange(key, idx, i, hi, depth);
+         hi = j+1;
+      }
+   }
+}
+
+/***************************************************/
+/* This function sorts key ascending and applies   */
+/* the same permutation to idx, without the extra  */
+/* buffers radixSortKeys needs. Equal keys may be  */
+/* reordered.                                      */
+/***************************************************/
+static void introSortKeys(uint64_t *key, int *idx, int n)
+{
+   int i, depth;
+
+   if(n < 2) return;
+
+   depth = 0;
+   for(i = n; i > 1; i >>= 1) depth += 2;
+   introSortRange(key, idx, 0, n, depth);
+
+   // finish the short runs
+   for(i = 1; i < n; i++)
+   {
+      int j, ti;
+      uint64_t tk;
+
+      tk = key[i];
+      ti = idx[i];
+      for(j = i - 1; j >= 0 && key[j] > tk; j--)
+      {
+         key[j+1] = key[j];
+         idx[j+1] = idx[j];
+      }
+      key[j+1] = tk;
+      idx[j+1] = ti;
+   }
+}
+
+/***************************************************/
+/* This function stores the SORTED ORDER INDICES   */
+/* (ascending) of the unsorted array into indices, */
+/* without moving the data. It runs in O(n log n)  */
+/* or better for every CART_* type.                */
+/*                                                 */
+/* IN: void *unsorted - buffer containing unsorted */
+/*     data                                        */
+/*     int n - number of entries in unsorted buf   */
+/*     int type - type of elements in unsorted     */
+/*                buffer (CART_CHAR ... CART_ULONG)*/
+/*     int stable - if nonzero, equal elements     */
+/*                keep their original order (radix */
+/*                sort); otherwise an in-place     */
+/*                introsort that needs less memory */
+/*                is used                          */
+/*                                                 */
+/* OUT: int *indices - returns sorted index order  */
+/***************************************************/
+void getSortIndices(void *unsorted, int *indices, int n, int type, int stable)
+{
+   int i, nbytes;
+   uint64_t *key;
+
+   key = getSortKeys(unsorted, n, type, &nbytes);
+   assert(key != NULL);
+
+   for(i = 0; i < n; i++) indices[i] = i;
+
+   if(stable) radixSortKeys(key, indices, n, nbytes);
+   else introSortKeys(key, indices, n);
+
+   free(key);
+}
+
+/***************************************************/
+/* This function stores the SORTED ORDER INDICES   */
+/* of the unsorted array into indices.  This       */
+/* function does not move around the data but only */
+/* returns what the sorted index would be inside   */
+/* indices.                                        */
+/*                                                 */
+/* It used to be a selection sort; it is now       */
+/* getSortIndices with stable set, so equal        */
+/* elements keep their original order.             */
 /*                                                 */
 /* IN: void *unsorted - buffer containing unsorted */
 /*     data                                        */
@@ -116,155 +640,27 @@ int compare(void *array, int index1, int index2, int type)
 /***************************************************/
 void getSelectionSortIndices(void *unsorted, int *indices, int n, int type)
 {
-   int i;
-
-   for(i = 0; i < n; i++) indices[i] = i;
-
-   for(i = 0; i < n-1; i++)
-   {
-      int j, min;
-      min = i;
-
-      for(j = i+1; j < n; j++)
-      {
-         int cmpResult;
-
-	 cmpResult = compare(unsorted, indices[min], indices[j], type);
-	 assert(cmpResult != CANNOT_COMPARE);
-
-	 if(cmpResult == -1) min = j;
-      }
-
-      if(i != min) swap(indices, i, min);
-   }
+   getSortIndices(unsorted, indices, n, type, 1);
 }
 
+/***************************************************/
+/* sort8, sort88, sort4 and sort7 sort buf         */
+/* ascending and carry ptr along: after the sort,  */
+/* ptr[i] is the ptr that came with buf[i]. They   */
+/* were heap sorts translated from sortin.com and  */
+/* are now wrappers around the single-threaded     */
+/* radix sorts below, so equal keys now keep their */
+/* original order.                                 */
+/***************************************************/
 void sort8( double * buf, int * ptr, int n )
 {
-      /* quick and dirty translation of quicksort with middle pivot
-      taken from sortin.com */
-      
-      int l,m,k,j,iptr;
-      double ibuf;
-   
-      if (n<2) return;
-      l = n-1;
-      m = n/2-1;
-
- l10: k = m;
-      ibuf = buf[k];
-      iptr = ptr[k];
-
- l20: j = 2*k+1;
-      if (j>=n) goto l25;
-      if (j<(n-1)&&buf[j+1]>buf[j]) j++;
-      if (buf[j]<=ibuf) goto l25;
-      buf[k] = buf[j];
-      ptr[k] = ptr[j];
-      k = j;
-      goto l20;
-
- l25: buf[k] = ibuf;
-      ptr[k] = iptr;
-      m--;
-      if (m>=0) goto l10;
-
- l30: k = 0;
-      ibuf = buf[k];
-      iptr = ptr[k];
-
- l40: j = 2*k+1;
-      if (j>l) goto l45;
-      if (j<l&&buf[j+1]>buf[j]) j++;
-      if (buf[j]<=ibuf) goto l45;
-      buf[k] = buf[j];
-      ptr[k] = ptr[j];
-      k = j;
-      goto l40;
-
- l45: buf[k] = ibuf;
-      ptr[k] = iptr;
-      ibuf = buf[0];
-      iptr = ptr[0];
-      buf[0] = buf[l];
-      ptr[0] = ptr[l];
-      buf[l] = ibuf;
-      ptr[l] = iptr;
-      l--;
-      if (l>0) goto l30;
-
-      return;
+   sort8radix(buf, ptr, n, 1);
 }
 
+/* sorts a vector (x,y,x,y,x,y...) on x then on y */
 void sort88( double * buf, int * ptr, int n )
 {
-      /* quick and dirty translation of quicksort with middle pivot
-      taken from sortin.com; sorts a vector (x,y,x,y,x,y...) on x
-      then on y */
-      
-      int l,m,k,j,iptr;
-      double ibufx,ibufy;
-   
-      if (n<2) return;
-      l = n-1;
-      m = n/2-1;
-
- l10: k = m;
-      ibufx = buf[2*k];
-      ibufy = buf[2*k+1];
-      iptr = ptr[k];
-
- l20: j = 2*k+1;
-      if (j>=n) goto l25;
-      if (j<(n-1)&&((buf[2*j+2]>buf[2*j])||(
-         (buf[2*j+2]==buf[2*j])&&(buf[2*j+3]>buf[2*j+1]) ))) j++;
-      if ((buf[2*j]<ibufx)||(
-         (buf[2*j]==ibufx)&&(buf[2*j+1]<=ibufy) )) goto l25;
-      buf[2*k] = buf[2*j];
-      buf[2*k+1] = buf[2*j+1];
-      ptr[k] = ptr[j];
-      k = j;
-      goto l20;
-
- l25: buf[2*k] = ibufx;
-      buf[2*k+1] = ibufy;
-      ptr[k] = iptr;
-      m--;
-      if (m>=0) goto l10;
-
- l30: k = 0;
-      ibufx = buf[2*k];
-      ibufy = buf[2*k+1];
-      iptr = ptr[k];
-
- l40: j = 2*k+1;
-      if (j>l) goto l45;
-      if (j<l&&((buf[2*j+2]>buf[2*j])||(
-         (buf[2*j+2]==buf[2*j])&&(buf[2*j+3]>buf[2*j+1]) ))) j++;
-      if ((buf[2*j]<ibufx)||(
-         (buf[2*j]==ibufx)&&(buf[2*j+1]<=ibufy) )) goto l45;
-      buf[2*k] = buf[2*j];
-      buf[2*k+1] = buf[2*j+1];
-      ptr[k] = ptr[j];
-      k = j;
-      goto l40;
-
- l45: buf[2*k] = ibufx;
-      buf[2*k+1] = ibufy;
-      ptr[k] = iptr;
-      ibufx = buf[0];
-      ibufy = buf[1];
-      iptr = ptr[0];
-      buf[0] = buf[2*l];
-      buf[1] = buf[2*l+1];
-      ptr[0] = ptr[l];
-      buf[2*l] = ibufx;
-      buf[2*l+1] = ibufy;
-      ptr[l] = iptr;
-      l--;
-      if (l>0) goto l30;
-
-      return;
+   sort88radix(buf, ptr, n, 1);
 }
 
 void sortrec4( int * key, int * ptr, int len )
@@ -332,114 +728,157 @@ void sortretn8( double *key, int* ptr, int len )
 
 void sort4(int *buf, int *ptr, int n)
 {
-      /* quick and dirty translation of quicksort with middle pivot
-      taken from sortin.com */
-      
-      int l,m,k,j,iptr;
-      double ibuf;
-   
-      if (n<2) return;
-      l = n-1;
-      m = n/2-1;
-
- l10: k = m;
-      ibuf = buf[k];
-      iptr = ptr[k];
-
- l20: j = 2*k+1;
-      if (j>=n) goto l25;
-      if (j<(n-1)&&buf[j+1]>buf[j]) j++;
-      if (buf[j]<=ibuf) goto l25;
-      buf[k] = buf[j];
-      ptr[k] = ptr[j];
-      k = j;
-      goto l20;
-
- l25: buf[k] = ibuf;
-      ptr[k] = iptr;
-      m--;
-      if (m>=0) goto l10;
-
- l30: k = 0;
-      ibuf = buf[k];
-      iptr = ptr[k];
-
- l40: j = 2*k+1;
-      if (j>l) goto l45;
-      if (j<l&&buf[j+1]>buf[j]) j++;
-      if (buf[j]<=ibuf) goto l45;
-      buf[k] = buf[j];
-      ptr[k] = ptr[j];
-      k = j;
-      goto l40;
-
- l45: buf[k] = ibuf;
-      ptr[k] = iptr;
-      ibuf = buf[0];
-      iptr = ptr[0];
-      buf[0] = buf[l];
-      ptr[0] = ptr[l];
-      buf[l] = ibuf;
-      ptr[l] = iptr;
-      l--;
-      if (l>0) goto l30;
-
-      return;
+   sort4radix(buf, ptr, n, 1);
 }
 
 void sort7( float *buf, int *ptr, int n )
 {
-      /* quick and dirty translation of quicksort with middle pivot
-      taken from sortin.com */
-      
-      int l,m,k,j,iptr;
-      double ibuf;
-   
-      if (n<2) return;
-      l = n-1;
-      m = n/2-1;
-
- l10: k = m;
-      ibuf = buf[k];
-      iptr = ptr[k];
-
- l20: j = 2*k+1;
-      if (j>=n) goto l25;
-      if (j<(n-1)&&buf[j+1]>buf[j]) j++;
-      if (buf[j]<=ibuf) goto l25;
-      buf[k] = buf[j];
-      ptr[k] = ptr[j];
-      k = j;
-      goto l20;
-
- l25: buf[k] = ibuf;
-      ptr[k] = iptr;
-      m--;
-      if (m>=0) goto l10;
-
- l30: k = 0;
-      ibuf = buf[k];
-      iptr = ptr[k];
-
- l40: j = 2*k+1;
-      if (j>l) goto l45;
-      if (j<l&&buf[j+1]>buf[j]) j++;
-      if (buf[j]<=ibuf) goto l45;
-      buf[k] = buf[j];
-      ptr[k] = ptr[j];
-      k = j;
-      goto l40;
-
- l45: buf[k] = ibuf;
-      ptr[k] = iptr;
-      ibuf = buf[0];
-      iptr = ptr[0];
-      buf[0] = buf[l];
-      ptr[0] = ptr[l];
-      buf[l] = ibuf;
-      ptr[l] = iptr;
-      l--;
-      if (l>0) goto l30;
+   sort7radix(buf, ptr, n, 1);
+}
 
-      return;
+/***************************************************/
+/* Stable LSD radix sorts with the same key and    */
+/* pointer semantics as sort8 (double keys),       */
+/* sort88 (x,y double pairs), sort4 (int keys) and */
+/* sort7 (float keys). The sort runs on            */
+/* order-preserving integer keys. sort8radix,      */
+/* sort88radix and sort7radix sort an index with   */
+/* the keys, then move the original values and ptr */
+/* through it, so no values are altered. -0.0 is   */
+/* keyed as +0.0, so the two zeros keep their      */
+/* input order. sort4radix carries ptr with the    */
+/* keys and rebuilds buf from them, which is exact */
+/* for int.                                        */
+/*                                                 */
+/* nthreads is the number of threads to use        */
+/* (get_thread_count() if <= 0); arrays shorter    */
+/* than RADIX_THREAD_MIN_N per thread use fewer.   */
+/* The result does not depend on nthreads.         */
+/***************************************************/
+void sort8radix( double * buf, int * ptr, int n, int nthreads )
+{
+   int i,*idx,*tptr;
+   uint64_t *key;
+   double *temp;
+
+   if (n<2) return;
+   if ((key=(uint64_t *)malloc(sizeof(uint64_t)*n))==NULL)
+          zmabend("malloc failed");
+   if ((idx=(int *)malloc(sizeof(int)*n))==NULL)
+          zmabend("malloc failed");
+   for (i=0;i<n;i++)
+      {
+      key[i] = sortKeyDouble(buf[i]);
+      idx[i] = i;
+      }
+   radixSortKeysThreaded(key,idx,n,8,nthreads);
+   free(key);
+
+   if ((temp=(double *)malloc(8*n))==NULL)
+          zmabend("malloc failed");
+   if ((tptr=(int *)malloc(sizeof(int)*n))==NULL)
+          zmabend("malloc failed");
+   memcpy(temp,buf,8*n);
+   memcpy(tptr,ptr,sizeof(int)*n);
+   for (i=0;i<n;i++)
+      {
+      buf[i] = temp[idx[i]];
+      ptr[i] = tptr[idx[i]];
+      }
+   free(temp);
+   free(tptr);
+   free(idx);
+   return;
+}
+
+void sort88radix( double * buf, int * ptr, int n, int nthreads )
+{
+   int i,*idx,*tptr;
+   uint64_t *key;
+   double *temp;
+
+   if (n<2) return;
+   if ((key=(uint64_t *)malloc(sizeof(uint64_t)*n))==NULL)
+          zmabend("malloc failed");
+   if ((idx=(int *)malloc(sizeof(int)*n))==NULL)
+          zmabend("malloc failed");
+
+   /* least significant key first: y, then a stable pass on x */
+   for (i=0;i<n;i++)
+      {
+      key[i] = sortKeyDouble(buf[2*i+1]);
+      idx[i] = i;
+      }
+   radixSortKeysThreaded(key,idx,n,8,nthreads);
+   for (i=0;i<n;i++) key[i] = sortKeyDouble(buf[2*idx[i]]);
+   radixSortKeysThreaded(key,idx,n,8,nthreads);
+   free(key);
+
+   if ((temp=(double *)malloc(16*n))==NULL)
+          zmabend("malloc failed");
+   if ((tptr=(int *)malloc(sizeof(int)*n))==NULL)
+          zmabend("malloc failed");
+   memcpy(temp,buf,16*n);
+   memcpy(tptr,ptr,sizeof(int)*n);
+   for (i=0;i<n;i++)
+      {
+      buf[2*i] = temp[2*idx[i]];
+      buf[2*i+1] = temp[2*idx[i]+1];
+      ptr[i] = tptr[idx[i]];
+      }
+   free(temp);
+   free(tptr);
+   free(idx);
+   return;
+}
+
+void sort4radix( int * buf, int * ptr, int n, int nthreads )
+{
+   int i;
+   uint64_t *key;
+
+   if (n<2) return;
+   if ((key=(uint64_t *)malloc(sizeof(uint64_t)*n))==NULL)
+          zmabend("malloc failed");
+   for (i=0;i<n;i++) key[i] = sortKeySigned(buf[i],sizeof(int));
+   radixSortKeysThreaded(key,ptr,n,sizeof(int),nthreads);
+   for (i=0;i<n;i++) buf[i] = sortKeyToInt(key[i]);
+   free(key);
+   return;
+}
+
+void sort7radix( float * buf, int * ptr, int n, int nthreads )
+{
+   int i,*idx,*tptr;
+   uint64_t *key;
+   float *temp;
+
+   if (n<2) return;
+   if ((key=(uint64_t *)malloc(sizeof(uint64_t)*n))==NULL)
+          zmabend("malloc failed");
+   if ((idx=(int *)malloc(sizeof(int)*n))==NULL)
+          zmabend("malloc failed");
+   for (i=0;i<n;i++)
+      {
+      key[i] = sortKeyFloat(buf[i]);
+      idx[i] = i;
+      }
+   radixSortKeysThreaded(key,idx,n,4,nthreads);
+   free(key);
+
+   if ((temp=(float *)malloc(4*n))==NULL)
+          zmabend("malloc failed");
+   if ((tptr=(int *)malloc(sizeof(int)*n))==NULL)
+          zmabend("malloc failed");
+   memcpy(temp,buf,4*n);
+   memcpy(tptr,ptr,sizeof(int)*n);
+   for (i=0;i<n;i++)
+      {
+      buf[i] = temp[idx[i]];
+      ptr[i] = tptr[idx[i]];
+      }
+   free(temp);
+   free(tptr);
+   free(idx);
+   return;
 }
@@ -5,12 +5,59 @@
   Date:      Nov 25, 1998
   Function:  C replicas of the linpack dblas, drotg, and drot routines
 
+  Notes:     The level-1 routines dispatch three ways. When the library is
+               built against an external BLAS (HAVE_BLAS, set by configure
+               --with-lapack) and n >= CBLAS_EXTERNAL_MIN_N, the Fortran
+               BLAS routine is called. Otherwise unit-stride calls go to
+               the cblas_*_unit kernels below, which are unrolled by four
+               with independent accumulators so the compiler can keep the
+               work in SIMD registers, and other strides go to the
+               original translated loops (cblas_*_strided). Below the
+               size threshold the call overhead of the external library
+               outweighs its speed, which matters for csvd on small
+               matrices.
+
+               The unrolled reductions (ddot, dasum, dnrm2) add in a
+               different order than the original loops, so results can
+               differ in the last bits.
+
 *******************************************************************************/
 #include <stdio.h>
 #include <math.h>
 #include "carto/cblas.h"
 #include "carto/burl.h"
 
+#define CBLAS_EXTERNAL_MIN_N 64
+
+#ifdef HAVE_BLAS
+extern double dasum_(int *n, double *dx, int *incx);
+extern void   daxpy_(int *n, double *da, double *dx, int *incx, double *dy, int *incy);
+extern void   dcopy_(int *n, double *dx, int *incx, double *dy, int *incy);
+extern double ddot_(int *n, double *dx, int *incx, double *dy, int *incy);
+extern double dnrm2_(int *n, double *dx, int *incx);
+extern void   dscal_(int *n, double *da, double *dx, int *incx);
+extern void   dswap_(int *n, double *dx, int *incx, double *dy, int *incy);
+extern int    idamax_(int *n, double *dx, int *incx);
+extern void   drot_(int *n, double *dx, int *incx, double *dy, int *incy, double *c, double *s);
+#endif
+
+static double cblas_dasum_unit(int n, double *dx);
+static double cblas_dasum_strided(int n, double *dx, int incx);
+static void   cblas_daxpy_unit(int n, double da, double *dx, double *dy);
+static void   cblas_daxpy_strided(int n, double da, double *dx, int incx, double *dy, int incy);
+static void   cblas_dcopy_unit(int n, double *dx, double *dy);
+static void   cblas_dcopy_strided(int n, double *dx, int incx, double *dy, int incy);
+static double cblas_ddot_unit(int n, double *dx, double *dy);
+static double cblas_ddot_strided(int n, double *dx, int incx, double *dy, int incy);
+static double cblas_dnrm2_unit(int n, double *dx);
+static double cblas_dnrm2_strided(int n, double *dx, int incx);
+static void   cblas_dscal_unit(int n, double da, double *dx);
+static void   cblas_dscal_strided(int n, double da, double *dx, int incx);
+static void   cblas_dswap_unit(int n, double *dx, double *dy);
+static void   cblas_dswap_strided(int n, double *dx, int incx, double *dy, int incy);
+static void   cblas_drot_unit(int n, double *dx, double *dy, double c, double s);
+static void   cblas_drot_strided(int n, double *dx, int incx, double *dy, int incy, double c, double s);
+
 /********************/
 /* dsign            */
 /********************/
@@ -36,15 +83,49 @@ double dsign(double a, double b) {
 
 double dasum(int n, double *dx, int incx) {
 
-  int     i, nincx;
-  double  dtemp;
   char    infunc[] = "dasum";
 
-  dtemp = D_ZERO;
   if (n <= 0) {
     printf ("ERROR (%s): n = %d <= 0", infunc, n);
     return(D_ZERO);
   }
+#ifdef HAVE_BLAS
+  if ((n >= CBLAS_EXTERNAL_MIN_N) && (incx > 0)) {
+    return(dasum_(&n, dx, &incx));
+  }
+#endif
+  if (incx == 1) {
+    return(cblas_dasum_unit(n, dx));
+  }
+  return(cblas_dasum_strided(n, dx, incx));
+}
+
+static double cblas_dasum_unit(int n, double *dx) {
+
+  int     i, m;
+  double  t0, t1, t2, t3;
+
+  t0 = t1 = t2 = t3 = D_ZERO;
+  m = n - n%4;
+  for (i = 0; i < m; i += 4) {
+    t0 += fabs(dx[i]);
+    t1 += fabs(dx[i+1]);
+    t2 += fabs(dx[i+2]);
+    t3 += fabs(dx[i+3]);
+  }
+  for (; i < n; i++) {
+    t0 += fabs(dx[i]);
+  }
+
+  return((t0 + t1) + (t2 + t3));
+}
+
+static double cblas_dasum_strided(int n, double *dx, int incx) {
+
+  int     i, nincx;
+  double  dtemp;
+
+  dtemp = D_ZERO;
   nincx = n*incx;
   for (i = 0; i < nincx; i += incx) {
     dtemp += fabs(dx[i]);
@@ -62,7 +143,6 @@ double dasum(int n, double *dx, int incx) {
 
 int daxpy(int n, double da, double *dx, int incx, double *dy, int incy) {
   
-  int   i, ix, iy;
   char  infunc[] = "daxpy";
 
   if (n <= 0) {
@@ -72,7 +152,42 @@ int daxpy(int n, double da, double *dx, int incx, double *dy, int incy) {
   if (da == D_ZERO) {
     return(OK);
   }
-      
+#ifdef HAVE_BLAS
+  if (n >= CBLAS_EXTERNAL_MIN_N) {
+    daxpy_(&n, &da, dx, &incx, dy, &incy);
+    return(OK);
+  }
+#endif
+  if ((incx == 1) && (incy == 1)) {
+    cblas_daxpy_unit(n, da, dx, dy);
+  }
+  else {
+    cblas_daxpy_strided(n, da, dx, incx, dy, incy);
+  }
+
+  return(OK);
+}
+
+static void cblas_daxpy_unit(int n, double da, double *dx, double *dy) {
+
+  int   i, m;
+
+  m = n - n%4;
+  for (i = 0; i < m; i += 4) {
+    dy[i]   += da*dx[i];
+    dy[i+1] += da*dx[i+1];
+    dy[i+2] += da*dx[i+2];
+    dy[i+3] += da*dx[i+3];
+  }
+  for (; i < n; i++) {
+    dy[i] += da*dx[i];
+  }
+}
+
+static void cblas_daxpy_strided(int n, double da, double *dx, int incx, double *dy, int incy) {
+
+  int   i, ix, iy;
+
   ix = 0;
   iy = 0;
   if (incx < 0) {
@@ -86,8 +201,6 @@ int daxpy(int n, double da, double *dx, int incx, double *dy, int incy) {
     ix += incx;
     iy += incy;
   }
-
-  return(OK);
 }
 
 
@@ -100,13 +213,47 @@ int daxpy(int n, double da, double *dx, int incx, double *dy, int incy) {
 
 int dcopy(int n, double *dx, int incx, double *dy, int incy) {
 
-  int   i, ix, iy;
   char  infunc[] = "dcopy";
 
   if (n <= 0) {
     printf("ERROR (%s): n = %d < 0\n", infunc, n);
     return(ERR);
   }
+#ifdef HAVE_BLAS
+  if (n >= CBLAS_EXTERNAL_MIN_N) {
+    dcopy_(&n, dx, &incx, dy, &incy);
+    return(OK);
+  }
+#endif
+  if ((incx == 1) && (incy == 1)) {
+    cblas_dcopy_unit(n, dx, dy);
+  }
+  else {
+    cblas_dcopy_strided(n, dx, incx, dy, incy);
+  }
+
+  return(OK);
+}
+
+static void cblas_dcopy_unit(int n, double *dx, double *dy) {
+
+  int   i, m;
+
+  m = n - n%4;
+  for (i = 0; i < m; i += 4) {
+    dy[i]   = dx[i];
+    dy[i+1] = dx[i+1];
+    dy[i+2] = dx[i+2];
+    dy[i+3] = dx[i+3];
+  }
+  for (; i < n; i++) {
+    dy[i] = dx[i];
+  }
+}
+
+static void cblas_dcopy_strided(int n, double *dx, int incx, double *dy, int incy) {
+
+  int   i, ix, iy;
 
   ix = 0;
   iy = 0;
@@ -121,8 +268,6 @@ int dcopy(int n, double *dx, int incx, double *dy, int incy) {
     ix += incx;
     iy += incy;
   }
-
-  return(OK);
 }
 
 
@@ -135,15 +280,49 @@ int dcopy(int n, double *dx, int incx, double *dy, int incy) {
 
 double ddot(int n, double *dx, int incx, double *dy, int incy) {
 
-  double  dtemp;
-  int     i, ix, iy;
   char    infunc[] = "ddot";
 
-  dtemp = D_ZERO;
   if (n < 0) {
     printf("ERROR (%s): n = %d < 0\n", infunc, n);
-    return(dtemp);
+    return(D_ZERO);
+  }
+#ifdef HAVE_BLAS
+  if (n >= CBLAS_EXTERNAL_MIN_N) {
+    return(ddot_(&n, dx, &incx, dy, &incy));
+  }
+#endif
+  if ((incx == 1) && (incy == 1)) {
+    return(cblas_ddot_unit(n, dx, dy));
+  }
+  return(cblas_ddot_strided(n, dx, incx, dy, incy));
+}
+
+static double cblas_ddot_unit(int n, double *dx, double *dy) {
+
+  int     i, m;
+  double  t0, t1, t2, t3;
+
+  t0 = t1 = t2 = t3 = D_ZERO;
+  m = n - n%4;
+  for (i = 0; i < m; i += 4) {
+    t0 += dx[i]*dy[i];
+    t1 += dx[i+1]*dy[i+1];
+    t2 += dx[i+2]*dy[i+2];
+    t3 += dx[i+3]*dy[i+3];
+  }
+  for (; i < n; i++) {
+    t0 += dx[i]*dy[i];
   }
+
+  return((t0 + t1) + (t2 + t3));
+}
+
+static double cblas_ddot_strided(int n, double *dx, int incx, double *dy, int incy) {
+
+  double  dtemp;
+  int     i, ix, iy;
+
+  dtemp = D_ZERO;
   ix = 0;
   iy = 0;
   if (incx < 0) {
@@ -182,9 +361,43 @@ double dmach(int job) {
 
 double dnrm2(int n, double *dx, int incx) {
 
+  /*  char   infunc[] = "dnrm2"; */
+
+#ifdef HAVE_BLAS
+  if ((n >= CBLAS_EXTERNAL_MIN_N) && (incx > 0)) {
+    return(dnrm2_(&n, dx, &incx));
+  }
+#endif
+  if (incx == 1) {
+    return(cblas_dnrm2_unit(n, dx));
+  }
+  return(cblas_dnrm2_strided(n, dx, incx));
+}
+
+static double cblas_dnrm2_unit(int n, double *dx) {
+
+  int     i, m;
+  double  t0, t1, t2, t3;
+
+  t0 = t1 = t2 = t3 = D_ZERO;
+  m = n - n%4;
+  for (i = 0; i < m; i += 4) {
+    t0 += dx[i]*dx[i];
+    t1 += dx[i+1]*dx[i+1];
+    t2 += dx[i+2]*dx[i+2];
+    t3 += dx[i+3]*dx[i+3];
+  }
+  for (; i < n; i++) {
+    t0 += dx[i]*dx[i];
+  }
+
+  return(sqrt((t0 + t1) + (t2 + t3)));
+}
+
+static double cblas_dnrm2_strided(int n, double *dx, int incx) {
+
   int    i, nincx;
   double dtemp;
-  /*  char   infunc[] = "dnrm2"; */
 
   dtemp = D_ZERO;
   nincx = n * incx;
@@ -203,19 +416,52 @@ double dnrm2(int n, double *dx, int incx) {
 
 int dscal(int n, double da, double *dx, int incx) {
 
-  int   i, nincx;
   char  infunc[] = "dscal";
 
   if (n <= 0) {
     printf("ERROR (%s): n = %d < 0\n", infunc, n);
     return(ERR);
   }
+#ifdef HAVE_BLAS
+  if ((n >= CBLAS_EXTERNAL_MIN_N) && (incx > 0)) {
+    dscal_(&n, &da, dx, &incx);
+    return(OK);
+  }
+#endif
+  if (incx == 1) {
+    cblas_dscal_unit(n, da, dx);
+  }
+  else {
+    cblas_dscal_strided(n, da, dx, incx);
+  }
+
+  return(OK);
+}
+
+static void cblas_dscal_unit(int n, double da, double *dx) {
+
+  int   i, m;
+
+  m = n - n%4;
+  for (i = 0; i < m; i += 4) {
+    dx[i]   *= da;
+    dx[i+1] *= da;
+    dx[i+2] *= da;
+    dx[i+3] *= da;
+  }
+  for (; i < n; i++) {
+    dx[i] *= da;
+  }
+}
+
+static void cblas_dscal_strided(int n, double da, double *dx, int incx) {
+
+  int   i, nincx;
+
   nincx = n*incx;
   for (i = 0; i < nincx; i += incx) {
     dx[i] *= da;
   }
-
-  return(OK);
 }
 
 
@@ -228,14 +474,45 @@ int dscal(int n, double da, double *dx, int incx) {
 
 int dswap(int n, double *dx, int incx, double *dy, int incy) {
 
-  int     i, ix, iy;
-  double  dtemp;
   char    infunc[] = "dswap";
 
   if (n <= 0) {
     printf("ERROR (%s): n = %d <= 0\n", infunc, n);
     return(ERR);
   }
+#ifdef HAVE_BLAS
+  if (n >= CBLAS_EXTERNAL_MIN_N) {
+    dswap_(&n, dx, &incx, dy, &incy);
+    return(OK);
+  }
+#endif
+  if ((incx == 1) && (incy == 1)) {
+    cblas_dswap_unit(n, dx, dy);
+  }
+  else {
+    cblas_dswap_strided(n, dx, incx, dy, incy);
+  }
+
+  return(OK);
+}
+
+static void cblas_dswap_unit(int n, double *dx, double *dy) {
+
+  int     i;
+  double  dtemp;
+
+  for (i = 0; i < n; i++) {
+    dtemp = dx[i];
+    dx[i] = dy[i];
+    dy[i] = dtemp;
+  }
+}
+
+static void cblas_dswap_strided(int n, double *dx, int incx, double *dy, int incy) {
+
+  int     i, ix, iy;
+  double  dtemp;
+
   ix = 0;
   iy = 0;
   if (incx < 0) {
@@ -251,7 +528,6 @@ int dswap(int n, double *dx, int incx, double *dy, int incy) {
     ix += incx;
     iy += incy;
   }
-  return(OK);
 }
 
 /********************/
@@ -276,6 +552,11 @@ int idamax(int n, double *dx, int incx) {
   if (n == 1) {
     return(ind);
   }
+#ifdef HAVE_BLAS
+  if ((n >= CBLAS_EXTERNAL_MIN_N) && (incx > 0)) {
+    return(idamax_(&n, dx, &incx) - 1); /* Fortran index is 1-based */
+  }
+#endif
   ix = 0;
   dmax = fabs(dx[0]);
   ix += incx;
@@ -357,14 +638,46 @@ int drotg(double *da_adr, double *db_adr, double *c_adr, double *s_adr) {
 
 int drot(int n, double *dx, int incx, double *dy, int incy, double c, double s) {
 
-  int    i, ix, iy;
-  double dtemp;
   char   infunc[] = "drot";
 
   if (n < 0) {
     printf("ERROR (%s): n = %d < 0\n", infunc, n);
     return(ERR);
   }
+#ifdef HAVE_BLAS
+  if (n >= CBLAS_EXTERNAL_MIN_N) {
+    drot_(&n, dx, &incx, dy, &incy, &c, &s);
+    return(OK);
+  }
+#endif
+  if ((incx == 1) && (incy == 1)) {
+    cblas_drot_unit(n, dx, dy, c, s);
+  }
+  else {
+    cblas_drot_strided(n, dx, incx, dy, incy, c, s);
+  }
+
+  return(OK);
+}
+
+static void cblas_drot_unit(int n, double *dx, double *dy, double c, double s) {
+
+  int    i;
+  double x, y;
+
+  for (i = 0; i < n; i++) {
+    x = dx[i];
+    y = dy[i];
+    dx[i] = c*x + s*y;
+    dy[i] = c*y - s*x;
+  }
+}
+
+static void cblas_drot_strided(int n, double *dx, int incx, double *dy, int incy, double c, double s) {
+
+  int    i, ix, iy;
+  double dtemp;
+
   ix = 0;
   iy = 0;
   if (incx < 0) {
@@ -380,8 +693,4 @@ int drot(int n, double *dx, int incx, double *dy, int incy, double c, double s)
     ix += incx;
     iy += incy;
   }
-
-  return(OK);
 }
-
-
@@ -139,27 +139,54 @@ int ecef_from_geodetic(double *XYZ, int n_rows, double *LLH)
 int geodetic_from_ecef(double *LLH, int n_rows, double *XYZ)
 {
   ellipsoid_struct   *ellipsoid;
-  int                k, ind;
-  double             p, theta, argy, argx, phi, N;
+  int                status;
   /*  char               infunc[] = "geodetic_from_ecef"; */
 
   /*--------------------------------------------------------------*/
   define_ellipsoid("WGS1984", &ellipsoid);
+  status = geodetic_from_ecef_ellipsoid(ellipsoid, LLH, n_rows, XYZ);
+  free_ellipsoid(ellipsoid);
+
+  return(status);
+}
+
+/**************************************/
+/* geodetic_from_ecef_ellipsoid       */
+/**************************************/
+/* Same as geodetic_from_ecef, but with a caller-supplied ellipsoid. This */
+/*   avoids defining (and allocating) the ellipsoid on every call, which  */
+/*   matters when converting one point at a time in an inner loop.        */
+
+int geodetic_from_ecef_ellipsoid(ellipsoid_struct *ellipsoid, double *LLH, int n_rows, double *XYZ)
+{
+  int                k, ind;
+  double             p, zt, pt, r, stheta, ctheta, argy, argx, phi, sphi, cphi, N;
+  /*  char               infunc[] = "geodetic_from_ecef_ellipsoid"; */
+
+  /*--------------------------------------------------------------*/
+  /* sin and cos of theta and phi are formed from the atan2 arguments */
+  /*   directly, which leaves a single atan2 per angle in the loop */
   ind = 0;
   for (k = 0; k < n_rows; k++) {
     p = sqrt(XYZ[ind]*XYZ[ind] + XYZ[ind+1]*XYZ[ind+1]);
-    theta = atan2(XYZ[ind+2]*ellipsoid->a, p * ellipsoid->b);
-    argy = XYZ[ind+2] + ellipsoid->ep2 * ellipsoid->b * pow(sin(theta), 3.0);
-    argx = p - ellipsoid->e2*ellipsoid->a*pow(cos(theta), 3.0);
+    zt = XYZ[ind+2]*ellipsoid->a;
+    pt = p * ellipsoid->b;
+    r = sqrt(zt*zt + pt*pt);
+    stheta = (r > D_ZERO) ? zt/r : D_ZERO;
+    ctheta = (r > D_ZERO) ? pt/r : D_ONE;
+    argy = XYZ[ind+2] + ellipsoid->ep2 * ellipsoid->b * stheta*stheta*stheta;
+    argx = p - ellipsoid->e2*ellipsoid->a*ctheta*ctheta*ctheta;
     phi = atan2(argy, argx);
-    N = ellipsoid->a / sqrt(1.0 - ellipsoid->e2 * sin(phi) * sin(phi));
+    r = sqrt(argx*argx + argy*argy);
+    sphi = argy/r;
+    cphi = argx/r;
+    N = ellipsoid->a / sqrt(1.0 - ellipsoid->e2 * sphi * sphi);
 
     LLH[ind] = phi * RAD2DEG;
     LLH[ind+1] = atan2(XYZ[ind+1], XYZ[ind]) * RAD2DEG;
-    LLH[ind+2] = p/cos(phi) - N;
+    LLH[ind+2] = p/cphi - N;
     ind += 3;
   }
-  free_ellipsoid(ellipsoid);
 
   return(OK);
 }
@@ -68,12 +68,38 @@
 
 #define N_NUTATION_TERMS 106
 
+/* Number of Chebyshev coefficients per segment of an eos_coords_cache, and */
+/*   the number of functions of TT it interpolates (J2000_R_TOD and EQ_sec) */
+#define EOS_CACHE_NCOEF  12
+#define EOS_CACHE_NFUNC  10
+#define EOS_CACHE_MAXSEG (1 << 20)
+
+static int eos_coords_tt(double TT, double *J2000_R_TOD, double *EQ_sec_adr);
+static int eos_coords_spin(double UT1, double EQ_sec, double *ECEF_R_TOD);
+static void eos_coords_cache_interp(eos_coords_cache_struct *cache, double TT, double *J2000_R_TOD, double *EQ_sec_adr);
+
 /***********************/
 /* EOS_COORDS          */
 /***********************/
 int eos_coords(double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD)
 {
-  double               T_UT1, T_UT1_POWERS[5];
+  double               EQ_sec;
+
+  eos_coords_tt(TT, J2000_R_TOD, &EQ_sec);
+  eos_coords_spin(UT1, EQ_sec, ECEF_R_TOD);
+
+  return(OK);
+}
+
+/***********************/
+/* EOS_COORDS_TT       */
+/***********************/
+/* The part of eos_coords that depends only on TT: precession and nutation
+   (giving J2000_R_TOD) and the equation of the equinoxes EQ_sec (in time
+   seconds), which is needed for the spin transformation. */
+
+static int eos_coords_tt(double TT, double *J2000_R_TOD, double *EQ_sec_adr)
+{
   double               T_TT, T_TT_POWERS[5];
   int                  i, j;
 
@@ -93,11 +119,7 @@ int eos_coords(double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD)
   double               epsilon_prime_deg, epsilon_prime_rad;
   double               epsilon_deg, epsilon_rad;
 
-  double               alpha_GMST_sec;
   double               EQ_sec, EQ_arcsec;
-  double               alpha_GAST_deg;
-  double               alpha_GAST_rad;
-  double               alpha_GAST_deg_standard;
 
   /* Coefficients for various calculations */
   static double        C_zeta_arcsec[5]  = { D_ZERO, 2306.2181, 0.30188, 0.017998, D_ZERO }; /* MCB: fixed 2 errors in memo-rev3 */
@@ -111,7 +133,6 @@ int eos_coords(double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD)
   static double        C_F5[5] = { 125.0445222, -1934.136261, 0.002071, 2.22e-06, D_ZERO };
 
   static double        C_epsilon_deg[5] = { 23.43929111, -0.0130042, -1.6389e-07, 5.0361e-07, D_ZERO };
-  static double        C_alpha_GMST[5] = { 67310.54841, (876600.0 * 3600.0 + 8640184.812866), 0.093104, -6.2e-06, D_ZERO };
 
   static double        NUT[N_NUTATION_TERMS][9] = {
                          { 0,  0,  0,  0,  1, -171996, -174.2, 92025,  8.9}, /* 1-10 */
@@ -242,14 +263,6 @@ int eos_coords(double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD)
     T_TT_POWERS[i] = T_TT * T_TT_POWERS[i-1];
   }
 
-  /*======================*/
-  /* Get powers of T_UT1  */
-  /*======================*/
-  T_UT1 = UT1/(86400.0*36525.0); /* T_UT1 is UT1 expressed in Julian centuries */
-  T_UT1_POWERS[0] = D_ONE;
-  for (i = 1; i <= 4; i++) {
-    T_UT1_POWERS[i] = T_UT1 * T_UT1_POWERS[i-1];
-  }
   /*===========================*/
   /* Precession Transformation */
   /*===========================*/
@@ -375,6 +388,41 @@ int eos_coords(double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD)
   mat33_mat33_mult(TOD_R_MOD, MOD_R_J2000, TOD_R_J2000);
   mat33_inverse(TOD_R_J2000, J2000_R_TOD);
 
+  /* Commented part of equation includes the moon correction terms, which are apparently omitted */
+  /*   in partner's calculations. */
+  EQ_arcsec = Delta_psi_arcsec * cos(epsilon_prime_rad); /* + 0.00264*sin(F1_deg * DEG2RAD) + 0.000063*sin(2 * F1_deg * DEG2RAD); */
+  EQ_sec = EQ_arcsec/((double) 15.0); /* 15 degrees per 3600 seconds is 15 arcsec per second */
+  *EQ_sec_adr = EQ_sec;
+
+  return(OK);
+}
+
+/***********************/
+/* EOS_COORDS_SPIN     */
+/***********************/
+/* The spin transformation ECEF_R_TOD, from UT1 and the equation of the
+   equinoxes EQ_sec computed by eos_coords_tt. */
+
+static int eos_coords_spin(double UT1, double EQ_sec, double *ECEF_R_TOD)
+{
+  double               T_UT1, T_UT1_POWERS[5];
+  int                  i;
+  double               alpha_GMST_sec;
+  double               alpha_GAST_deg;
+  double               alpha_GAST_rad;
+  double               alpha_GAST_deg_standard;
+
+  static double        C_alpha_GMST[5] = { 67310.54841, (876600.0 * 3600.0 + 8640184.812866), 0.093104, -6.2e-06, D_ZERO };
+
+  /*======================*/
+  /* Get powers of T_UT1  */
+  /*======================*/
+  T_UT1 = UT1/(86400.0*36525.0); /* T_UT1 is UT1 expressed in Julian centuries */
+  T_UT1_POWERS[0] = D_ONE;
+  for (i = 1; i <= 4; i++) {
+    T_UT1_POWERS[i] = T_UT1 * T_UT1_POWERS[i-1];
+  }
+
   /*=====================*/
   /* Spin Transformation */
   /*=====================*/
@@ -384,11 +432,6 @@ int eos_coords(double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD)
     alpha_GMST_sec += C_alpha_GMST[i] * T_UT1_POWERS[i];
   }
 
-  /* Commented part of equation includes the moon correction terms, which are apparently omitted */
-  /*   in partner's calculations. */
-  EQ_arcsec = Delta_psi_arcsec * cos(epsilon_prime_rad); /* + 0.00264*sin(F1_deg * DEG2RAD) + 0.000063*sin(2 * F1_deg * DEG2RAD); */
-  EQ_sec = EQ_arcsec/((double) 15.0); /* 15 degrees per 3600 seconds is 15 arcsec per second */
-
   alpha_GAST_deg = (alpha_GMST_sec + EQ_sec) * ((double) 15.0)/((double) 3600.0); /* 15 degrees per 3600 time seconds */
   alpha_GAST_rad = alpha_GAST_deg * DEG2RAD;
 
@@ -403,3 +446,185 @@ int eos_coords(double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD)
 
   return(OK);
 }
+
+/***************************/
+/* EOS_COORDS_CACHE_CREATE */
+/***************************/
+/* Build an interpolant for eos_coords over the TT window [TT0, TT1] (in the
+   same units as eos_coords), for use when eos_coords would be called at many
+   closely spaced epochs, e.g., once per line of a line scanner.
+
+   The TT-dependent part (J2000_R_TOD and the equation of the equinoxes) is
+   represented by a piecewise Chebyshev series of EOS_CACHE_NCOEF terms. The
+   window starts out split into one-day segments, and segments are halved
+   until the interpolant, checked against eos_coords between the Chebyshev
+   nodes, is within tol radians. The achieved bound is stored in max_err.
+   The UT1-dependent Earth rotation is still evaluated exactly, so the
+   interpolant stays good however fast the Earth turns within the window.
+
+   Returns ERR if tol cannot be met. */
+
+int eos_coords_cache_create(double TT0, double TT1, double tol, eos_coords_cache_struct **cache_adr)
+{
+  eos_coords_cache_struct  *cache;
+  double                   f[EOS_CACHE_NCOEF][EOS_CACHE_NFUNC];
+  double                   R[9], EQ_sec, R2[9], EQ2_sec;
+  double                   x, a, err, e, sum;
+  double                   *c;
+  int                      nseg, k, i, j, m, n;
+  char                     infunc[] = "eos_coords_cache_create";
+
+  *cache_adr = NULL;
+  if ((TT1 <= TT0) || (tol <= D_ZERO)) {
+    fprintf(stderr, "ERROR (%s): need TT1 > TT0 and tol > 0\n", infunc);
+    return(ERR);
+  }
+
+  nseg = (int) ceil((TT1 - TT0)/86400.0);
+  if (nseg < 1) {
+    nseg = 1;
+  }
+
+  for (; nseg <= EOS_CACHE_MAXSEG; nseg *= 2) {
+    cache = (eos_coords_cache_struct *) qmalloc(1, sizeof(eos_coords_cache_struct), 1, infunc, "cache");
+    if (cache == NULL) {
+      return(ERR);
+    }
+    cache->TT0 = TT0;
+    cache->TT1 = TT1;
+    cache->nseg = nseg;
+    cache->ncoef = EOS_CACHE_NCOEF;
+    cache->seglen = (TT1 - TT0)/nseg;
+    cache->coef = (double *) qmalloc((size_t) nseg * EOS_CACHE_NFUNC * EOS_CACHE_NCOEF, sizeof(double), 0, infunc, "coef");
+    if (cache->coef == NULL) {
+      free((void *) cache);
+      return(ERR);
+    }
+
+    for (k = 0; k < nseg; k++) {
+      a = TT0 + k*cache->seglen;
+
+      /* Sample at the Chebyshev nodes of the segment */
+      for (m = 0; m < EOS_CACHE_NCOEF; m++) {
+        x = cos(M_PI * (m + 0.5)/EOS_CACHE_NCOEF);
+        eos_coords_tt(a + 0.5*(x + D_ONE)*cache->seglen, R, &EQ_sec);
+        for (i = 0; i < 9; i++) {
+          f[m][i] = R[i];
+        }
+        f[m][9] = EQ_sec;
+      }
+
+      /* Chebyshev coefficients for each function */
+      c = cache->coef + (size_t) k*EOS_CACHE_NFUNC*EOS_CACHE_NCOEF;
+      for (i = 0; i < EOS_CACHE_NFUNC; i++) {
+        for (j = 0; j < EOS_CACHE_NCOEF; j++) {
+          sum = D_ZERO;
+          for (m = 0; m < EOS_CACHE_NCOEF; m++) {
+            sum += f[m][i] * cos(M_PI * j * (m + 0.5)/EOS_CACHE_NCOEF);
+          }
+          c[i*EOS_CACHE_NCOEF+j] = (D_TWO/EOS_CACHE_NCOEF) * sum;
+        }
+        c[i*EOS_CACHE_NCOEF] *= 0.5;
+      }
+    }
+
+    /* Check the interpolant midway between nodes (where it is worst) */
+    err = D_ZERO;
+    for (k = 0; k < nseg; k++) {
+      a = TT0 + k*cache->seglen;
+      for (n = 0; n <= EOS_CACHE_NCOEF; n++) {
+        x = (n == 0) ? -D_ONE : ((n == EOS_CACHE_NCOEF) ? D_ONE : cos(M_PI * n/EOS_CACHE_NCOEF));
+        eos_coords_tt(a + 0.5*(x + D_ONE)*cache->seglen, R, &EQ_sec);
+        eos_coords_cache_interp(cache, a + 0.5*(x + D_ONE)*cache->seglen, R2, &EQ2_sec);
+        for (i = 0; i < 9; i++) {
+          e = fabs(R[i] - R2[i]);
+          err = MAX(err, e);
+        }
+        e = fabs(EQ_sec - EQ2_sec) * ((double) 15.0)/((double) 3600.0) * DEG2RAD;
+        err = MAX(err, e);
+      }
+    }
+    cache->max_err = err;
+
+    if (err <= tol) {
+      *cache_adr = cache;
+      return(OK);
+    }
+    eos_coords_cache_free(cache);
+  }
+
+  fprintf(stderr, "ERROR (%s): could not reach tolerance %g rad\n", infunc, tol);
+  return(ERR);
+}
+
+/***************************/
+/* EOS_COORDS_CACHE_EVAL   */
+/***************************/
+/* Same outputs as eos_coords(TT, UT1, ...), from the interpolant. Epochs
+   outside the cache window are passed through to eos_coords. */
+
+int eos_coords_cache_eval(eos_coords_cache_struct *cache, double TT, double UT1, double *J2000_R_TOD, double *ECEF_R_TOD)
+{
+  double   EQ_sec;
+
+  if ((TT < cache->TT0) || (TT > cache->TT1)) {
+    return(eos_coords(TT, UT1, J2000_R_TOD, ECEF_R_TOD));
+  }
+
+  eos_coords_cache_interp(cache, TT, J2000_R_TOD, &EQ_sec);
+  eos_coords_spin(UT1, EQ_sec, ECEF_R_TOD);
+
+  return(OK);
+}
+
+/***************************/
+/* EOS_COORDS_CACHE_INTERP */
+/***************************/
+/* Evaluate the Chebyshev series of the segment holding TT (which must be
+   inside the cache window) by Clenshaw's recurrence. */
+
+static void eos_coords_cache_interp(eos_coords_cache_struct *cache, double TT, double *J2000_R_TOD, double *EQ_sec_adr)
+{
+  double   x, x2, b0, b1, b2;
+  double   out[EOS_CACHE_NFUNC];
+  double   *c;
+  int      k, i, j;
+
+  k = (int) ((TT - cache->TT0)/cache->seglen);
+  if (k >= cache->nseg) {
+    k = cache->nseg - 1;
+  }
+  x = D_TWO*(TT - (cache->TT0 + k*cache->seglen))/cache->seglen - D_ONE;
+  x2 = D_TWO*x;
+
+  c = cache->coef + (size_t) k*EOS_CACHE_NFUNC*EOS_CACHE_NCOEF;
+  for (i = 0; i < EOS_CACHE_NFUNC; i++) {
+    b1 = b2 = D_ZERO;
+    for (j = EOS_CACHE_NCOEF-1; j >= 1; j--) {
+      b0 = x2*b1 - b2 + c[i*EOS_CACHE_NCOEF+j];
+      b2 = b1;
+      b1 = b0;
+    }
+    out[i] = x*b1 - b2 + c[i*EOS_CACHE_NCOEF];
+  }
+
+  for (i = 0; i < 9; i++) {
+    J2000_R_TOD[i] = out[i];
+  }
+  *EQ_sec_adr = out[9];
+
+  return;
+}
+
+/***************************/
+/* EOS_COORDS_CACHE_FREE   */
+/***************************/
+int eos_coords_cache_free(eos_coords_cache_struct *cache)
+{
+  if (cache != NULL) {
+    free((void *) cache->coef);
+    free((void *) cache);
+  }
+
+  return(OK);
+}
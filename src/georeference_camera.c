@@ -46,6 +46,7 @@
 *******************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "carto/burl.h"
 #include "carto/qmalloc.h"
@@ -55,7 +56,39 @@
 #include "carto/earth_coordinates.h"
 #include "carto/georeference_camera.h"
 #include "carto/ray_intersect_ellipsoid.h"
+#include "carto/ray_intersect_dem.h"
 #include "carto/mat33.h"
+#include "carto/verbosity_manager.h"
+#include "carto/thread_manager.h"
+
+/****************************/
+/* GLOBAL DECLARATIONS      */
+/****************************/
+
+/* Work description for one thread of georeference_camera_batch (or _dem). Each thread
+   handles the contiguous block of sample indices [i0, i1) and writes its
+   correspondences, in the same order georeference_camera would, into G. */
+typedef struct
+{
+  int       i0, i1;
+  int       nv, nh;
+  double    *urange, *vrange, *hrange;
+  double    *ECEF_R_C, *ECEF_t_C;
+  double    fu, fv, q, u0, v0;
+  double    a, b;      /* ellipsoid semi-axes */
+  dem_struct *dem;     /* terrain, for georeference_camera_dem */
+  double    *G;        /* (n X 5) correspondences for this block */
+  int       n;
+  int       status;
+} georeference_block_struct;
+
+static void georeference_camera_frame(int wframe, double *w_t_c, double *w_q_c, double TT, double UT1,
+    int verbose, double *ECEF_R_C, double *ECEF_t_C);
+static int georeference_camera_threaded(double *urange, double *vrange, double *hrange, dem_struct *dem,
+    double *ECEF_R_C, double *ECEF_t_C, double fu, double fv, double q, double u0, double v0,
+    void *(*worker)(void *), int *gr_adr, int *gc_adr, double **G_adr);
+static void *georeference_camera_block(void *arg);
+static void *georeference_camera_dem_block(void *arg);
 
 /****************************/
 /* GEOREFERENCE_CAMERA_SV_C */
@@ -110,9 +143,6 @@ int georeference_camera_sv_c(double *urange, double *vrange, double *hrange,
 int georeference_camera(double *urange, double *vrange, double *hrange, int wframe, double *w_t_c, double *w_q_c, double fu, double fv, double q, double u0, double v0, double *kappa, double TT, double UT1, int *gr_adr, int *gc_adr, double **G_adr)
 {
   ellipsoid_struct     *ellipsoid;
-  double               w_o_c[3];
-  double               J2000_R_TOD[3*3], ECEF_R_TOD[3*3];
-  double               TOD_R_C[3*3];
   double               ECEF_R_C[3*3], ECEF_t_C[3];
   int                  nu, nv, nh, N;
   int                  i, j, k, n;
@@ -127,33 +157,8 @@ int georeference_camera(double *urange, double *vrange, double *hrange, int wfra
 
   define_ellipsoid("WGS1984", &ellipsoid);
 
-  /* Convert w_q_c into a rodrigues/rotation vector for internal use */
-  quaternion_to_rodrigues(w_q_c, w_o_c);
-
-  /* Create ECEF_R_C from w_o_c, which was given wrt TOD */
-  /*   Also, create ECEF_t_C from w_t_c, which was also given wrt TOD */
-  if (wframe == GEOREFERENCE_TOD) {
-    /* Determine coordinate transformation between ECEF and TOD; */
-    /*   Here, we do not care about J2000, but it is calculated anyway */
-    eos_coords(TT, UT1, J2000_R_TOD, ECEF_R_TOD);
-    printf("ECEF_R_TOD:\n");
-    mat33_print(ECEF_R_TOD);
-    printf("\n");
-
-    rodrigues_vec2mat(w_o_c, TOD_R_C);
-    mat33_mat33_mult(ECEF_R_TOD, TOD_R_C, ECEF_R_C);
-    mat33_vec31_mult(ECEF_R_TOD, w_t_c, ECEF_t_C); /* Convert the translation vector to ECEF too */
-  }
-  else {
-    rodrigues_vec2mat(w_o_c, ECEF_R_C);
-    vec31_copy(w_t_c, ECEF_t_C);
-  }
-  printf("ECEF_R_C:\n");
-  mat33_print(ECEF_R_C);
-  printf("\n\n");
-  printf("ECEF_t_C:\n");
-  vec31_print(ECEF_t_C);
-  printf("\n\n");
+  /* Determine ECEF_R_C and ECEF_t_C from the camera pose */
+  georeference_camera_frame(wframe, w_t_c, w_q_c, TT, UT1, TRUE, ECEF_R_C, ECEF_t_C);
 
   /* Determine number of steps along each dimension of grid */
   nu = 1 + (int) floor((urange[2]-urange[0]+0.1)/urange[1]); /* Add 0.1 as hack to avoid epsilon errors */
@@ -221,3 +226,380 @@ int georeference_camera(double *urange, double *vrange, double *hrange, int wfra
   free_ellipsoid(ellipsoid);
   return(OK);
 }
+
+/*******************************/
+/* GEOREFERENCE_CAMERA_FRAME   */
+/*******************************/
+/* Compute the camera-to-ECEF rotation ECEF_R_C and camera position ECEF_t_C
+   from a pose given wrt ECEF or TOD (see wframe). The intermediate matrices
+   are printed if verbose is nonzero. */
+
+static void georeference_camera_frame(int wframe, double *w_t_c, double *w_q_c, double TT, double UT1,
+    int verbose, double *ECEF_R_C, double *ECEF_t_C)
+{
+  double               w_o_c[3];
+  double               J2000_R_TOD[3*3], ECEF_R_TOD[3*3];
+  double               TOD_R_C[3*3];
+
+  /* Convert w_q_c into a rodrigues/rotation vector for internal use */
+  quaternion_to_rodrigues(w_q_c, w_o_c);
+
+  /* Create ECEF_R_C from w_o_c, which was given wrt TOD */
+  /*   Also, create ECEF_t_C from w_t_c, which was also given wrt TOD */
+  if (wframe == GEOREFERENCE_TOD) {
+    /* Determine coordinate transformation between ECEF and TOD; */
+    /*   Here, we do not care about J2000, but it is calculated anyway */
+    eos_coords(TT, UT1, J2000_R_TOD, ECEF_R_TOD);
+    if (verbose) {
+      printf("ECEF_R_TOD:\n");
+      mat33_print(ECEF_R_TOD);
+      printf("\n");
+    }
+
+    rodrigues_vec2mat(w_o_c, TOD_R_C);
+    mat33_mat33_mult(ECEF_R_TOD, TOD_R_C, ECEF_R_C);
+    mat33_vec31_mult(ECEF_R_TOD, w_t_c, ECEF_t_C); /* Convert the translation vector to ECEF too */
+  }
+  else {
+    rodrigues_vec2mat(w_o_c, ECEF_R_C);
+    vec31_copy(ECEF_t_C, w_t_c);
+  }
+  if (verbose) {
+    printf("ECEF_R_C:\n");
+    mat33_print(ECEF_R_C);
+    printf("\n\n");
+    printf("ECEF_t_C:\n");
+    vec31_print(ECEF_t_C);
+    printf("\n\n");
+  }
+
+  return;
+}
+
+/*****************************/
+/* GEOREFERENCE_CAMERA_BATCH */
+/*****************************/
+/* Same inputs and outputs as georeference_camera, including the layout and
+   ordering of the rows of G, but intended for dense (e.g., per-pixel) grids.
+   Ray directions are computed for a whole line of v values at once and
+   intersected with each dilated ellipsoid by ray_intersect_ca_ellipsoid_n,
+   the hits are converted to geodetic coords in bulk, and the samples (u) are
+   split across get_thread_count() threads. Nothing is printed unless the
+   verbosity level is at least 1. There is no lens distortion model. Unlike
+   georeference_camera, which ignores kappa, this returns ERR unless kappa
+   is NULL. */
+
+int georeference_camera_batch(double *urange, double *vrange, double *hrange, int wframe, double *w_t_c, double *w_q_c, double fu, double fv, double q, double u0, double v0, double *kappa, double TT, double UT1, int *gr_adr, int *gc_adr, double **G_adr)
+{
+  double                     ECEF_R_C[3*3], ECEF_t_C[3];
+  int                        status;
+  char                       infunc[] = "georeference_camera_batch";
+
+  if (kappa != NULL) {
+    fprintf(stderr, "ERROR (%s): lens distortion (kappa) is not supported; pass NULL\n", infunc);
+    return(ERR);
+  }
+
+  georeference_camera_frame(wframe, w_t_c, w_q_c, TT, UT1, (get_verbosity_level() >= 1), ECEF_R_C, ECEF_t_C);
+
+  status = georeference_camera_threaded(urange, vrange, hrange, NULL, ECEF_R_C, ECEF_t_C, fu, fv, q, u0, v0,
+                                        georeference_camera_block, gr_adr, gc_adr, G_adr);
+
+  return(status);
+}
+
+/***************************/
+/* GEOREFERENCE_CAMERA_DEM */
+/***************************/
+/* Like georeference_camera_batch, but instead of sweeping a range of heights,
+   each ray is intersected with the terrain in dem (see ray_intersect_dem).
+   G holds at most one row (u, v, lat, lon, height) per (u, v) grid point, in
+   the same u-major order; rays that miss the terrain are left out. As in
+   georeference_camera_batch, kappa must be NULL. */
+
+int georeference_camera_dem(double *urange, double *vrange, dem_struct *dem, int wframe, double *w_t_c, double *w_q_c, double fu, double fv, double q, double u0, double v0, double *kappa, double TT, double UT1, int *gr_adr, int *gc_adr, double **G_adr)
+{
+  double                     ECEF_R_C[3*3], ECEF_t_C[3];
+  int                        status;
+  char                       infunc[] = "georeference_camera_dem";
+
+  if (kappa != NULL) {
+    fprintf(stderr, "ERROR (%s): lens distortion (kappa) is not supported; pass NULL\n", infunc);
+    return(ERR);
+  }
+
+  georeference_camera_frame(wframe, w_t_c, w_q_c, TT, UT1, (get_verbosity_level() >= 1), ECEF_R_C, ECEF_t_C);
+
+  status = georeference_camera_threaded(urange, vrange, NULL, dem, ECEF_R_C, ECEF_t_C, fu, fv, q, u0, v0,
+                                        georeference_camera_dem_block, gr_adr, gc_adr, G_adr);
+
+  return(status);
+}
+
+/********************************/
+/* GEOREFERENCE_CAMERA_THREADED */
+/********************************/
+/* Split the u range of the grid into one block per thread, run worker on
+   each block and concatenate the block outputs, in u order, into G. If
+   hrange is NULL, a single height level is assumed (the DEM case). */
+
+static int georeference_camera_threaded(double *urange, double *vrange, double *hrange, dem_struct *dem,
+    double *ECEF_R_C, double *ECEF_t_C, double fu, double fv, double q, double u0, double v0,
+    void *(*worker)(void *), int *gr_adr, int *gc_adr, double **G_adr)
+{
+  ellipsoid_struct           *ellipsoid;
+  int                        nu, nv, nh;
+  int                        nthreads, t, n, status;
+  double                     *G;
+  georeference_block_struct  *blocks;
+  char                       infunc[] = "georeference_camera_threaded";
+
+  /* Determine number of steps along each dimension of grid */
+  nu = 1 + (int) floor((urange[2]-urange[0]+0.1)/urange[1]); /* Add 0.1 as hack to avoid epsilon errors */
+  nv = 1 + (int) floor((vrange[2]-vrange[0]+0.1)/vrange[1]); /* Add 0.1 as hack to avoid epsilon errors */
+  nh = 1;
+  if (hrange != NULL) {
+    nh = 1 + (int) floor((hrange[2]-hrange[0]+0.1)/hrange[1]); /* Add 0.1 as hack to avoid epsilon errors */
+  }
+
+  nthreads = MIN(get_thread_count(), nu);
+  if (nthreads < 1) {
+    nthreads = 1;
+  }
+
+  define_ellipsoid("WGS1984", &ellipsoid);
+  blocks = (georeference_block_struct *) qmalloc(nthreads, sizeof(georeference_block_struct), 1, infunc, "blocks");
+  if (blocks == NULL) {
+    free_ellipsoid(ellipsoid);
+    return(ERR);
+  }
+
+  /* Split the samples into contiguous blocks, one per thread */
+  for (t = 0; t < nthreads; t++) {
+    blocks[t].i0 = (int) (((long) nu * t)/nthreads);
+    blocks[t].i1 = (int) (((long) nu * (t+1))/nthreads);
+    blocks[t].nv = nv;
+    blocks[t].nh = nh;
+    blocks[t].urange = urange;
+    blocks[t].vrange = vrange;
+    blocks[t].hrange = hrange;
+    blocks[t].ECEF_R_C = ECEF_R_C;
+    blocks[t].ECEF_t_C = ECEF_t_C;
+    blocks[t].fu = fu;
+    blocks[t].fv = fv;
+    blocks[t].q = q;
+    blocks[t].u0 = u0;
+    blocks[t].v0 = v0;
+    blocks[t].a = ellipsoid->a;
+    blocks[t].b = ellipsoid->b;
+    blocks[t].dem = dem;
+  }
+  free_ellipsoid(ellipsoid);
+
+  run_threads(nthreads, worker, (void *) blocks, sizeof(georeference_block_struct));
+
+  /* Concatenate the blocks in sample order */
+  status = OK;
+  n = 0;
+  for (t = 0; t < nthreads; t++) {
+    if (blocks[t].status != OK) {
+      status = ERR;
+    }
+    n += blocks[t].n;
+  }
+
+  G = NULL;
+  if (status == OK) {
+    G = (double *) qmalloc(n*5, sizeof(double), 0, infunc, "G");
+    if ((G == NULL) && (n > 0)) {
+      status = ERR;
+    }
+  }
+  n = 0;
+  for (t = 0; t < nthreads; t++) {
+    if ((status == OK) && (blocks[t].n > 0)) {
+      memcpy(G + n*5, blocks[t].G, blocks[t].n*5*sizeof(double));
+      n += blocks[t].n;
+    }
+    free((void *) blocks[t].G);
+  }
+  free((void *) blocks);
+
+  if (status != OK) {
+    free((void *) G);
+    return(ERR);
+  }
+
+  *G_adr = G;
+  *gr_adr = n;
+  *gc_adr = 5;
+
+  return(OK);
+}
+
+/*******************************/
+/* GEOREFERENCE_CAMERA_BLOCK   */
+/*******************************/
+/* Thread body for georeference_camera_batch. Fills in blk->G and blk->n for
+   the samples i0 <= i < i1. Per line of v values, the rays for every height
+   are intersected first, and the hits are then packed and converted to
+   geodetic coords with a single call to ecef_to_geodetic. */
+
+static void *georeference_camera_block(void *arg)
+{
+  georeference_block_struct  *blk;
+  double                     *R, *t;
+  double                     *dx, *dy, *dz;
+  double                     *px, *py, *pz;
+  double                     *XYZ, *LLH;
+  int                        *hit;
+  double                     s[3];
+  double                     u, v, un, vn, uq, hh;
+  int                        nv, nh, nvh;
+  int                        i, j, k, m, ind, n;
+  char                       infunc[] = "georeference_camera_block";
+
+  blk = (georeference_block_struct *) arg;
+  R = blk->ECEF_R_C;
+  t = blk->ECEF_t_C;
+  nv = blk->nv;
+  nh = blk->nh;
+  nvh = nv*nh;
+
+  blk->n = 0;
+  blk->status = OK;
+  blk->G = (double *) qmalloc((size_t) (blk->i1 - blk->i0) * nvh * 5, sizeof(double), 0, infunc, "G");
+  dx  = (double *) qmalloc(3*nv, sizeof(double), 0, infunc, "dx");
+  px  = (double *) qmalloc(3*nvh, sizeof(double), 0, infunc, "px");
+  XYZ = (double *) qmalloc(3*nvh, sizeof(double), 0, infunc, "XYZ");
+  LLH = (double *) qmalloc(3*nvh, sizeof(double), 0, infunc, "LLH");
+  hit = (int *) qmalloc(nvh, sizeof(int), 0, infunc, "hit");
+  if ((blk->G == NULL) || (dx == NULL) || (px == NULL) || (XYZ == NULL) || (LLH == NULL) || (hit == NULL)) {
+    blk->status = ERR;
+    free((void *) dx);
+    free((void *) px);
+    free((void *) XYZ);
+    free((void *) LLH);
+    free((void *) hit);
+    return(NULL);
+  }
+  dy = dx + nv;
+  dz = dy + nv;
+  py = px + nvh;
+  pz = py + nvh;
+
+  n = 0;
+  for (i = blk->i0; i < blk->i1; i++) {
+    u = blk->urange[0] + i*blk->urange[1];
+    un = (u-blk->u0)/blk->fu;
+
+    /* Ray directions for the whole line: d = ECEF_R_C * [un-q*vn; vn; 1] */
+    for (j = 0; j < nv; j++) {
+      vn = (blk->vrange[0] + j*blk->vrange[1] - blk->v0)/blk->fv;
+      uq = un - blk->q*vn;
+      dx[j] = R[0]*uq + R[1]*vn + R[2];
+      dy[j] = R[3]*uq + R[4]*vn + R[5];
+      dz[j] = R[6]*uq + R[7]*vn + R[8];
+    }
+
+    /* Intersect all rays with each dilated ellipsoid */
+    for (k = 0; k < nh; k++) {
+      hh = blk->hrange[0] + k*blk->hrange[1];
+      vec31_assign(s, blk->a+hh, blk->a+hh, blk->b+hh);
+      ray_intersect_ca_ellipsoid_n(nv, t, dx, dy, dz, s, px+k*nv, py+k*nv, pz+k*nv, hit+k*nv);
+    }
+
+    /* Pack hits in (v, h) order, matching georeference_camera */
+    m = 0;
+    for (j = 0; j < nv; j++) {
+      for (k = 0; k < nh; k++) {
+        ind = k*nv + j;
+        if (hit[ind] == OK) {
+          XYZ[m*3] = px[ind];
+          XYZ[m*3+1] = py[ind];
+          XYZ[m*3+2] = pz[ind];
+          m++;
+        }
+      }
+    }
+    ecef_to_geodetic(m, XYZ, LLH);
+
+    m = 0;
+    for (j = 0; j < nv; j++) {
+      v = blk->vrange[0] + j*blk->vrange[1];
+      for (k = 0; k < nh; k++) {
+        if (hit[k*nv + j] == OK) {
+          ind = n*5;
+          blk->G[ind] = u;            /* sample */
+          blk->G[ind+1] = v;          /* line */
+          blk->G[ind+2] = LLH[m*3];   /* Geodetic latitude (in decimal degrees) */
+          blk->G[ind+3] = LLH[m*3+1]; /* Longitude (in decimal degrees) */
+          blk->G[ind+4] = LLH[m*3+2]; /* Height (in meters) */
+          m++;
+          n++;
+        }
+      }
+    }
+  }
+  blk->n = n;
+
+  free((void *) dx);
+  free((void *) px);
+  free((void *) XYZ);
+  free((void *) LLH);
+  free((void *) hit);
+
+  return(NULL);
+}
+
+/*********************************/
+/* GEOREFERENCE_CAMERA_DEM_BLOCK */
+/*********************************/
+/* Thread body for georeference_camera_dem. Fills in blk->G and blk->n for
+   the samples i0 <= i < i1. */
+
+static void *georeference_camera_dem_block(void *arg)
+{
+  georeference_block_struct  *blk;
+  double                     *R;
+  double                     vec[3], d[3], p[3], LLH[3];
+  double                     u, v, un, vn;
+  int                        i, j, ind, n;
+  char                       infunc[] = "georeference_camera_dem_block";
+
+  blk = (georeference_block_struct *) arg;
+  R = blk->ECEF_R_C;
+
+  blk->n = 0;
+  blk->status = OK;
+  blk->G = (double *) qmalloc((size_t) (blk->i1 - blk->i0) * blk->nv * 5, sizeof(double), 0, infunc, "G");
+  if (blk->G == NULL) {
+    blk->status = ERR;
+    return(NULL);
+  }
+
+  n = 0;
+  for (i = blk->i0; i < blk->i1; i++) {
+    u = blk->urange[0] + i*blk->urange[1];
+    un = (u-blk->u0)/blk->fu;
+    for (j = 0; j < blk->nv; j++) {
+      v = blk->vrange[0] + j*blk->vrange[1];
+      vn = (v-blk->v0)/blk->fv;
+
+      vec31_assign(vec, un-blk->q*vn, vn, D_ONE);
+      mat33_vec31_mult(R, vec, d);
+      if (ray_intersect_dem(blk->dem, blk->ECEF_t_C, d, p, LLH) == OK) {
+        ind = n*5;
+        blk->G[ind] = u;          /* sample */
+        blk->G[ind+1] = v;        /* line */
+        blk->G[ind+2] = LLH[0];   /* Geodetic latitude (in decimal degrees) */
+        blk->G[ind+3] = LLH[1];   /* Longitude (in decimal degrees) */
+        blk->G[ind+4] = LLH[2];   /* Height (in meters) */
+        n++;
+      }
+    }
+  }
+  blk->n = n;
+
+  return(NULL);
+}
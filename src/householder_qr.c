@@ -0,0 +1,208 @@
+/*******************************************************************************
+
+  Title:    householder_qr
+  Function: Householder QR factorization of an (mr x mc) matrix, mr >= mc,
+              and the helpers needed to use it: applying Q or Q' to a set
+              of vectors and inverting R. Used by pinv (to reduce a tall
+              matrix to a small square one before calling csvd) and by
+              least_squares (to solve well-conditioned problems directly).
+
+            The factorization is stored column-major in QR, an array of
+              mr*mc doubles with element (i,j) at QR[j*mr+i], so that all
+              inner loops run down a column with unit stride. On return,
+              R is in the upper triangle and the Householder vector v_k
+              for column k is below the diagonal (with an implicit 1 at
+              position k), so that H_k = I - tau[k] v_k v_k' and
+              Q = H_0 H_1 ... H_(mc-1).
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "carto/burl.h"
+#include "carto/householder_qr.h"
+
+/******************/
+/* HOUSEHOLDER_QR */
+/******************/
+/* M is (mr x mc) row-major and is not modified. QR must hold mr*mc doubles */
+/*   and tau mc doubles. */
+
+int householder_qr(int mr, int mc, double *M, double *QR, double *tau)
+{
+  int    i, j, k;
+  double *a, *b;
+  double xnorm, alpha, v0, d;
+  char   infunc[] = "householder_qr";
+
+  if (mr < mc) {
+    fprintf(stderr, "ERROR (%s): need mr >= mc, got %d x %d\n", infunc, mr, mc);
+    return(ERR);
+  }
+
+  for (i = 0; i < mr; i++) {
+    for (j = 0; j < mc; j++) {
+      QR[j*mr+i] = M[i*mc+j];
+    }
+  }
+
+  for (k = 0; k < mc; k++) {
+    a = QR + k*mr;
+    xnorm = D_ZERO;
+    for (i = k+1; i < mr; i++) {
+      xnorm += a[i]*a[i];
+    }
+    if (xnorm == D_ZERO) {
+      /* Nothing to annihilate below the diagonal */
+      tau[k] = D_ZERO;
+      continue;
+    }
+    alpha = sqrt(a[k]*a[k] + xnorm);
+    if (a[k] > D_ZERO) {
+      alpha = -alpha;
+    }
+    v0 = a[k] - alpha;
+    tau[k] = -v0/alpha;
+    for (i = k+1; i < mr; i++) {
+      a[i] /= v0;
+    }
+    a[k] = alpha;
+
+    /* Apply H_k to the remaining columns */
+    for (j = k+1; j < mc; j++) {
+      b = QR + j*mr;
+      d = b[k];
+      for (i = k+1; i < mr; i++) {
+        d += a[i]*b[i];
+      }
+      d *= tau[k];
+      b[k] -= d;
+      for (i = k+1; i < mr; i++) {
+        b[i] -= d*a[i];
+      }
+    }
+  }
+
+  return(OK);
+}
+
+/***************************/
+/* HOUSEHOLDER_QR_APPLY_QT */
+/***************************/
+/* B := Q' B for nb column-major vectors of length mr (B[j*mr+i]). */
+
+int householder_qr_apply_qt(int mr, int mc, double *QR, double *tau, int nb, double *B)
+{
+  int    i, j, k;
+  double *a, *b;
+  double d;
+
+  for (j = 0; j < nb; j++) {
+    b = B + j*mr;
+    for (k = 0; k < mc; k++) {
+      if (tau[k] == D_ZERO) {
+        continue;
+      }
+      a = QR + k*mr;
+      d = b[k];
+      for (i = k+1; i < mr; i++) {
+        d += a[i]*b[i];
+      }
+      d *= tau[k];
+      b[k] -= d;
+      for (i = k+1; i < mr; i++) {
+        b[i] -= d*a[i];
+      }
+    }
+  }
+
+  return(OK);
+}
+
+/**************************/
+/* HOUSEHOLDER_QR_APPLY_Q */
+/**************************/
+/* B := Q B for nb column-major vectors of length mr (B[j*mr+i]). */
+
+int householder_qr_apply_q(int mr, int mc, double *QR, double *tau, int nb, double *B)
+{
+  int    i, j, k;
+  double *a, *b;
+  double d;
+
+  for (j = 0; j < nb; j++) {
+    b = B + j*mr;
+    for (k = mc-1; k >= 0; k--) {
+      if (tau[k] == D_ZERO) {
+        continue;
+      }
+      a = QR + k*mr;
+      d = b[k];
+      for (i = k+1; i < mr; i++) {
+        d += a[i]*b[i];
+      }
+      d *= tau[k];
+      b[k] -= d;
+      for (i = k+1; i < mr; i++) {
+        b[i] -= d*a[i];
+      }
+    }
+  }
+
+  return(OK);
+}
+
+/*************************/
+/* HOUSEHOLDER_QR_R_COPY */
+/*************************/
+/* Copy R out as an (mc x mc) row-major upper triangular matrix. */
+
+int householder_qr_r_copy(int mr, int mc, double *QR, double *R)
+{
+  int    i, j;
+
+  for (i = 0; i < mc; i++) {
+    for (j = 0; j < mc; j++) {
+      R[i*mc+j] = (j >= i) ? QR[j*mr+i] : D_ZERO;
+    }
+  }
+
+  return(OK);
+}
+
+/*************************/
+/* HOUSEHOLDER_QR_R_INV  */
+/*************************/
+/* Invert R by back substitution into Rinv, (mc x mc) row-major upper */
+/*   triangular. Returns ERR, without a message, if R has a zero on its */
+/*   diagonal; callers use this as a rank test. */
+
+int householder_qr_r_inv(int mr, int mc, double *QR, double *Rinv)
+{
+  int    i, j, k;
+  double d;
+  /*  char   infunc[] = "householder_qr_r_inv"; */
+
+  for (i = 0; i < mc; i++) {
+    if (QR[i*mr+i] == D_ZERO) {
+      return(ERR);
+    }
+  }
+
+  for (j = 0; j < mc; j++) {
+    /* Column j of Rinv solves R x = e_j */
+    for (i = mc-1; i >= 0; i--) {
+      if (i > j) {
+        Rinv[i*mc+j] = D_ZERO;
+        continue;
+      }
+      d = (i == j) ? D_ONE : D_ZERO;
+      for (k = i+1; k <= j; k++) {
+        d -= QR[k*mr+i] * Rinv[k*mc+j];
+      }
+      Rinv[i*mc+j] = d / QR[i*mr+i];
+    }
+  }
+
+  return(OK);
+}
@@ -1,49 +1,96 @@
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "carto/ibisControlMapper.h"
 
 #include "carto/ibishelper.h"
 
-#define MAXCONTROLS 50
+/******************************************************/
+/* hashes a control value, with -0 and 0 alike since   */
+/* they compare equal                                  */
+/******************************************************/
+static unsigned int hashControl(double control)
+{
+   unsigned long long bits;
+
+   if(control == 0.0) control = 0.0;
+   memcpy(&bits, &control, sizeof(bits));
+   bits ^= bits >> 33;
+   bits *= 0xff51afd7ed558ccdULL;
+   bits ^= bits >> 33;
+
+   return (unsigned int)bits;
+}
 
+/******************************************************/
+/* Rows are grouped in one pass through an open        */
+/* addressing table of control values, and the maps    */
+/* are filled in a second.  Controls keep the order in */
+/* which they first appear.                            */
 /******************************************************/
 IBIS_CONTROL_MAPPER* IBISCONTROL_getMapper(IBISStruct *ibis, int controlCol)
 {
    IBIS_CONTROL_MAPPER *mapper;
-   int i, j, ncontrols, found, counts[MAXCONTROLS];
-   double controls[MAXCONTROLS];
+   IBIS_CONTROL_MAP *map;
+   int i, g, h, mask, ncontrols, *table, *groups, *counts;
+   double *controls, *ids;
 
    if(controlCol <= 0) return IBISCONTROL_getSingleMapper(ibis);
    --controlCol;
 
+   controls = IBISHELPER_getDoubleColumn(ibis, controlCol);
+
+   for(mask = 1; mask < 2*ibis->nr; mask <<= 1);
+   table = (int*)malloc(sizeof(int)*mask);
+   for(h = 0; h < mask; h++) table[h] = -1;
+   --mask;
+
+   groups = (int*)malloc(sizeof(int)*ibis->nr);
+   counts = (int*)malloc(sizeof(int)*ibis->nr);
+   ids = (double*)malloc(sizeof(double)*ibis->nr);
+
    ncontrols = 0;
    for(i = 0; i < ibis->nr; i++)
    {
-      found = 0;
-      for(j = 0; j < ncontrols; j++)
-      {
-         if(IBISHELPER_getDouble(ibis, controlCol, i) == controls[j])
-         {
-            found = 1;
-            break;
-         }
-      }
-      if(!found)
+      h = hashControl(controls[i]) & mask;
+      while((g = table[h]) >= 0 && ids[g] != controls[i]) h = (h + 1) & mask;
+
+      if(g < 0)
       {
-         controls[ncontrols] = IBISHELPER_getDouble(ibis, controlCol, i);
-         counts[ncontrols++] = 1;
+         g = ncontrols++;
+         table[h] = g;
+         ids[g] = controls[i];
+         counts[g] = 0;
       }
-      else
-         counts[j]++;
+
+      ++counts[g];
+      groups[i] = g;
    }
 
    mapper = (IBIS_CONTROL_MAPPER*)malloc(sizeof(IBIS_CONTROL_MAPPER));
    mapper->nControls = ncontrols;
 
    mapper->maps = (IBIS_CONTROL_MAP**)malloc(sizeof(IBIS_CONTROL_MAP*)*ncontrols);
-   for(i = 0; i < ncontrols; i++)
-      mapper->maps[i] = IBISCONTROL_getMap(ibis, controlCol, controls[i], counts[i]);
+   for(g = 0; g < ncontrols; g++)
+   {
+      map = (IBIS_CONTROL_MAP*)malloc(sizeof(IBIS_CONTROL_MAP));
+      map->controlID = ids[g];
+      map->toIbisIndices = (int*)malloc(sizeof(int)*counts[g]);
+      map->length = 0;
+      mapper->maps[g] = map;
+   }
+
+   for(i = 0; i < ibis->nr; i++)
+   {
+      map = mapper->maps[groups[i]];
+      map->toIbisIndices[(map->length)++] = i;
+   }
+
+   free(table);
+   free(groups);
+   free(counts);
+   free(ids);
 
    return mapper;
 }
@@ -72,6 +119,7 @@ IBIS_CONTROL_MAPPER* IBISCONTROL_getSingleMapper(IBISStruct *ibis)
 IBIS_CONTROL_MAP* IBISCONTROL_getMap(IBISStruct *ibis, int controlCol, double control, int count)
 {
    int i;
+   double *controls;
    IBIS_CONTROL_MAP *map;
 
    map = (IBIS_CONTROL_MAP*)malloc(sizeof(IBIS_CONTROL_MAP));
@@ -79,8 +127,9 @@ IBIS_CONTROL_MAP* IBISCONTROL_getMap(IBISStruct *ibis, int controlCol, double co
    map->toIbisIndices = (int*)calloc(count, sizeof(int));
    map->length = 0;
 
+   controls = IBISHELPER_getDoubleColumn(ibis, controlCol);
    for(i = 0; i < ibis->nr; i++)
-      if(IBISHELPER_getDouble(ibis, controlCol, i) == control)
+      if(controls[i] == control)
          map->toIbisIndices[(map->length)++] = i;
 
    assert(map->length == count);
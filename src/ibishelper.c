@@ -77,7 +77,7 @@ void IBISHELPER_wrongFormatError(IBISStruct *ibis, int col)
 }
 
 /*****************************************************************/
-IBISStruct* IBISHELPER_openIBIS(char *name, int instance, char *mode)
+IBISStruct* IBISHELPER_openIBISFile(char *name, int instance, char *mode)
 {
    int status, i, *lengths;
    IBISStruct *ibis;
@@ -139,16 +139,35 @@ IBISStruct* IBISHELPER_openIBIS(char *name, int instance, char *mode)
        else IBISHELPER_wrongFormatError(ibis, i);
    }
 
+   ibis->data = NULL;
+   ibis->colViews = NULL;
+
+   return ibis;
+}
+
+/*****************************************************************/
+void IBISHELPER_allocIBISData(IBISStruct *ibis, int nr)
+{
+   int i;
+
    ibis->data = (char **)malloc(sizeof(void *)*(ibis->nc));
    for(i = 0; i < ibis->nc; i++)
    {
        int size;
 
-       size = lengths[i]*ibis->nr;
+       size = (ibis->colLens)[i]*nr;
        ibis->data[i] = (char *)malloc(size);
        ibis->totDataSize += size;
    }
+}
 
+/*****************************************************************/
+IBISStruct* IBISHELPER_openIBIS(char *name, int instance, char *mode)
+{
+   IBISStruct *ibis;
+
+   ibis = IBISHELPER_openIBISFile(name, instance, mode);
+   IBISHELPER_allocIBISData(ibis, ibis->nr);
    IBISHELPER_readIBISData(ibis);
 
    return ibis;
@@ -237,6 +256,7 @@ IBISStruct* IBISHELPER_openIBIS_out(char **format, int inst, int nr, int nc)
    ibis->data = (char**)malloc(sizeof(char*)*ibis->nc);
    for(i = 0; i < ibis->nc; i++)
       ibis->data[i] = (char*)calloc(ibis->nr, IBISHELPER_getLenByFormat(ibis->formats[i]));
+   ibis->colViews = NULL;
 
    return ibis;
 }
@@ -270,21 +290,36 @@ void IBISHELPER_writeIBIS(IBISStruct *ibis)
    free(fmts);
 }
 
+/*****************************************************************/
+void IBISHELPER_freeIBISStruct(IBISStruct **ibis)
+{
+   int i;
+
+   for(i = 0; i < (*ibis)->nc; i++)
+      if(((*ibis)->data)[i] != NULL) free(((*ibis)->data)[i]);
+   free((*ibis)->data);
+
+   if((*ibis)->colViews != NULL)
+   {
+      for(i = 0; i < (*ibis)->nc; i++)
+         if(((*ibis)->colViews)[i] != NULL) free(((*ibis)->colViews)[i]);
+      free((*ibis)->colViews);
+   }
+
+   free(*ibis);
+}
+
 /*****************************************************************/
 void IBISHELPER_closeIBIS(IBISStruct **ibis)
 {
-   int i, status;
+   int status;
 
    if(!strcmp((*ibis)->mode, "write") || !strcmp((*ibis)->mode, "update"))
       IBISHELPER_writeIBIS(*ibis);
    status = IBISFileClose((*ibis)->handle, 0);
    if(status != 1) IBISSignal((*ibis)->handle, status, 1);
 
-   for(i = 0; i < (*ibis)->nc; i++)
-      if(((*ibis)->data)[i] != NULL) free(((*ibis)->data)[i]);
-   free((*ibis)->data);
-
-   free(*ibis);
+   IBISHELPER_freeIBISStruct(ibis);
 }
 
 /*****************************************************************/
@@ -299,6 +334,17 @@ int IBISHELPER_getMaxColLen(IBISStruct *ibis)
    return max;
 }
 
+/*****************************************************************/
+/* frees the converted copy of col, which setting it makes stale */
+void IBISHELPER_dropColumnView(IBISStruct *ibis, int col)
+{
+   if(ibis->colViews != NULL && (ibis->colViews)[col] != NULL)
+   {
+      free((ibis->colViews)[col]);
+      (ibis->colViews)[col] = NULL;
+   }
+}
+
 /*****************************************************************/
 void IBISHELPER_setString(IBISStruct *ibis, int col, int index, char *str)
 {
@@ -306,6 +352,7 @@ void IBISHELPER_setString(IBISStruct *ibis, int col, int index, char *str)
 
    dataPtr = IBISHELPER_getBufPtr(ibis, col, index);
    assert(ibis->formats[col][0] == 'a' || ibis->formats[col][0] == 'A');
+   IBISHELPER_dropColumnView(ibis, col);
    strncpy(dataPtr, str, ibis->colLens[col]-1);
    *(dataPtr+(ibis->colLens[col]-1)) = 0;
 }
@@ -316,6 +363,7 @@ void IBISHELPER_setDouble(IBISStruct *ibis, int col, int index, double data)
    char *dataPtr;
 
    dataPtr = IBISHELPER_getBufPtr(ibis, col, index);
+   IBISHELPER_dropColumnView(ibis, col);
 
    switch(tolower(ibis->formats[col][0]))
    {
@@ -458,6 +506,84 @@ char* IBISHELPER_getBufPtr(IBISStruct *ibis, int col, int index)
    return (ibis->data)[col] + (index*(ibis->colLens)[col]);
 }
 
+/*****************************************************************/
+void IBISHELPER_readDoubleColumn(IBISStruct *ibis, int col, double *buf)
+{
+   int i, nr;
+   char *data;
+
+   data = IBISHELPER_getBufPtr(ibis, col, 0);
+   nr = ibis->nr;
+   switch(tolower((ibis->formats)[col][0]))
+   {
+      case 'b': for(i = 0; i < nr; i++) buf[i] = (double)(data[i]);
+                return;
+      case 'h': for(i = 0; i < nr; i++) buf[i] = (double)(((short int*)data)[i]);
+                return;
+      case 'f': for(i = 0; i < nr; i++) buf[i] = (double)(((int*)data)[i]);
+                return;
+      case 'r': for(i = 0; i < nr; i++) buf[i] = (double)(((float*)data)[i]);
+                return;
+      case 'd': memcpy(buf, data, sizeof(double)*nr);
+                return;
+   }
+
+   printf("Column %d of format %s is not numeric or is complex.\n", col, (ibis->formats)[col]);
+   zabend();
+}
+
+/*****************************************************************/
+double* IBISHELPER_getDoubleColumn(IBISStruct *ibis, int col)
+{
+   if(tolower((ibis->formats)[col][0]) == 'd')
+      return (double*)IBISHELPER_getBufPtr(ibis, col, 0);
+
+   if(ibis->colViews == NULL)
+      ibis->colViews = (double**)calloc(ibis->nc, sizeof(double*));
+   if((ibis->colViews)[col] == NULL)
+   {
+      (ibis->colViews)[col] = (double*)malloc(sizeof(double)*(ibis->nr > 0 ? ibis->nr : 1));
+      IBISHELPER_readDoubleColumn(ibis, col, (ibis->colViews)[col]);
+   }
+
+   return (ibis->colViews)[col];
+}
+
+/*****************************************************************/
+void* IBISHELPER_getTypedColumn(IBISStruct *ibis, int col, char fmt)
+{
+   if(tolower((ibis->formats)[col][0]) != tolower(fmt)) return NULL;
+
+   return (void*)IBISHELPER_getBufPtr(ibis, col, 0);
+}
+
+/*****************************************************************/
+void IBISHELPER_setDoubleColumn(IBISStruct *ibis, int col, double *buf)
+{
+   int i, nr;
+   char *data;
+
+   data = IBISHELPER_getBufPtr(ibis, col, 0);
+   IBISHELPER_dropColumnView(ibis, col);
+   nr = ibis->nr;
+   switch(tolower((ibis->formats)[col][0]))
+   {
+      case 'b': for(i = 0; i < nr; i++) data[i] = (char)buf[i];
+                return;
+      case 'h': for(i = 0; i < nr; i++) ((short int*)data)[i] = (short int)buf[i];
+                return;
+      case 'f': for(i = 0; i < nr; i++) ((int*)data)[i] = (int)buf[i];
+                return;
+      case 'r': for(i = 0; i < nr; i++) ((float*)data)[i] = (float)buf[i];
+                return;
+      case 'd': memcpy(data, buf, sizeof(double)*nr);
+                return;
+   }
+
+   printf("Column %d of format %s is not numeric or is complex.\n", col, (ibis->formats)[col]);
+   zabend();
+}
+
 /*****************************************************************/
 void IBISHELPER_getFormats(IBISStruct *ibis, char formats[MAXCOLS][30])
 {
@@ -474,6 +600,145 @@ void IBISHELPER_getFormats(IBISStruct *ibis, char formats[MAXCOLS][30])
    }
 }
 
+/*****************************************************************/
+IBISStream* IBISHELPER_newIBISStream(IBISStruct *chunk, int chunkRows)
+{
+   IBISStream *stream;
+
+   assert(chunkRows > 0);
+
+   stream = (IBISStream*)malloc(sizeof(IBISStream));
+   stream->chunk = chunk;
+   stream->nr = chunk->nr;
+   stream->startRow = 0;
+   stream->chunkRows = chunkRows;
+
+   chunk->totDataSize = 0;
+   IBISHELPER_allocIBISData(chunk, chunkRows);
+   chunk->nr = 0;
+
+   return stream;
+}
+
+/*****************************************************************/
+IBISStream* IBISHELPER_openIBISStream(char *name, int instance, char *mode, int chunkRows)
+{
+   return IBISHELPER_newIBISStream(IBISHELPER_openIBISFile(name, instance, mode), chunkRows);
+}
+
+/*****************************************************************/
+IBISStream* IBISHELPER_openIBISStream_out(char **format, int inst, int nr, int nc, int chunkRows)
+{
+   int status, i;
+   IBISStruct *chunk;
+   char *fmts;
+
+   chunk = (IBISStruct*)malloc(sizeof(IBISStruct));
+   chunk->nr = nr;
+   chunk->nc = nc;
+   for(i = 0; i < nc; i++)
+      IBISHELPER_lowerString(chunk->formats[i], format[i]);
+   IBISHELPER_setColumnWidths(chunk);
+   IBISHELPER_setTotRecordSize(chunk);
+   strcpy(chunk->mode, "write");
+
+   status = zvunit(&(chunk->unit), "out", inst, NULL);
+   assert(status == 1);
+
+   fmts = (char*)malloc(sizeof(char)*6*nc);
+   for(i = 0; i < nc; i++) strncpy(fmts+6*i, chunk->formats[i], 6);
+   status = IBISFileOpen(chunk->unit, &(chunk->handle), chunk->mode, nc, nr, fmts, NULL);
+   if(status != 1) IBISSignalU(chunk->unit, status, 1);
+   free(fmts);
+
+   chunk->data = NULL;
+   chunk->colViews = NULL;
+
+   return IBISHELPER_newIBISStream(chunk, chunkRows);
+}
+
+/*****************************************************************/
+int IBISHELPER_setChunkRange(IBISStream *stream, int startRow)
+{
+   int i, n;
+   IBISStruct *chunk;
+
+   assert(startRow >= 0 && startRow <= stream->nr);
+
+   n = stream->nr - startRow;
+   if(n > stream->chunkRows) n = stream->chunkRows;
+
+   chunk = stream->chunk;
+   for(i = 0; i < chunk->nc; i++) IBISHELPER_dropColumnView(chunk, i);
+   chunk->nr = n;
+   stream->startRow = startRow;
+
+   return n;
+}
+
+/*****************************************************************/
+int IBISHELPER_readIBISChunk(IBISStream *stream, int startRow)
+{
+   int i, n, status;
+   IBISStruct *chunk;
+
+   n = IBISHELPER_setChunkRange(stream, startRow);
+   if(n == 0) return 0;
+
+   chunk = stream->chunk;
+   for(i = 0; i < chunk->nc; i++)
+   {
+      status = IBISColumnRead(chunk->handle, (chunk->data)[i], i+1, startRow+1, n);
+      if(status != 1) IBISSignal(chunk->handle, status, 1);
+   }
+
+   return n;
+}
+
+/*****************************************************************/
+int IBISHELPER_newIBISChunk(IBISStream *stream, int startRow)
+{
+   int i, n;
+   IBISStruct *chunk;
+
+   n = IBISHELPER_setChunkRange(stream, startRow);
+
+   chunk = stream->chunk;
+   for(i = 0; i < chunk->nc; i++)
+      memset((chunk->data)[i], 0, (chunk->colLens)[i]*n);
+
+   return n;
+}
+
+/*****************************************************************/
+void IBISHELPER_writeIBISChunk(IBISStream *stream)
+{
+   int i, status;
+   IBISStruct *chunk;
+
+   chunk = stream->chunk;
+   if(chunk->nr == 0) return;
+
+   for(i = 0; i < chunk->nc; i++)
+   {
+      status = IBISColumnWrite(chunk->handle, (chunk->data)[i], i+1, stream->startRow+1, chunk->nr);
+      if(status != 1) IBISSignal(chunk->handle, status, 1);
+   }
+}
+
+/*****************************************************************/
+void IBISHELPER_closeIBISStream(IBISStream **stream)
+{
+   int status;
+
+   status = IBISFileClose((*stream)->chunk->handle, 0);
+   if(status != 1) IBISSignal((*stream)->chunk->handle, status, 1);
+
+   IBISHELPER_freeIBISStruct(&((*stream)->chunk));
+   free(*stream);
+   *stream = NULL;
+}
+
 /*****************************************************************/
 void IBISHELPER_printIBISPrep(IBISPrep *ibis)
 {
@@ -590,6 +855,7 @@ IBISStruct* IBISHELPER_getIBISStruct(IBISPrep **prep)
    ibis->data = (char**)malloc(sizeof(char*)*ibis->nc);
    for(i = 0; i < ibis->nc; i++)
       ibis->data[i] = (char*)calloc(ibis->nr, (ibis->colLens)[i]);
+   ibis->colViews = NULL;
 
    IBISHELPER_freeIBISPrep(prep);
 
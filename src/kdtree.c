@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "carto/kdtree.h"
+
+/*----------------*/
+/* State of one KDTREE_knn query. The best points found so */
+/* far are kept in a max-heap on (distance, index), so the */
+/* current k'th nearest is always heapDist[0].             */
+typedef struct
+{
+   KdTree *tree;
+   double *query;
+   KdTreeSkip skip;
+   void *skipArg;
+
+   int k, cnt;
+   double *heapDist;
+   int *heapIdx;
+}KdTreeQuery;
+
+/*=========================================================*/
+/* (d1, i1) farther than (d2, i2)                          */
+/*=========================================================*/
+int kdtreeFarther(double d1, int i1, double d2, int i2)
+{
+   if(d1 != d2) return d1 > d2;
+   return i1 > i2;
+}
+
+/*=========================================================*/
+/* Rearranges perm[lo..hi) so that perm[mid] is the point  */
+/* that belongs there when sorted on coordinate d (ties by */
+/* index), with no larger point before it and no smaller   */
+/* after it.                                               */
+/*=========================================================*/
+void kdtreeSelect(double *pts, int dim, int *perm, int lo, int hi, int mid, int d)
+{
+   int i, j, tmp, piv;
+   double pv;
+
+   --hi;
+   while(hi > lo)
+   {
+      piv = perm[(lo+hi)/2];
+      pv = pts[piv*dim+d];
+
+      i = lo;
+      j = hi;
+      while(i <= j)
+      {
+         while(kdtreeFarther(pv, piv, pts[perm[i]*dim+d], perm[i])) ++i;
+         while(kdtreeFarther(pts[perm[j]*dim+d], perm[j], pv, piv)) --j;
+         if(i <= j)
+         {
+            tmp = perm[i];
+            perm[i] = perm[j];
+            perm[j] = tmp;
+            ++i;
+            --j;
+         }
+      }
+
+      if(mid <= j) hi = j;
+      else if(mid >= i) lo = i;
+      else break;
+   }
+}
+
+/*=========================================================*/
+void kdtreeBuildRange(KdTree *tree, double *pts, int *perm, int lo, int hi)
+{
+   int i, j, mid, d;
+   double min, max, spread, best;
+
+   if(hi <= lo) return;
+
+   mid = (lo+hi)/2;
+   if(hi - lo == 1)
+   {
+      (tree->splitDim)[mid] = -1;
+      return;
+   }
+
+   // split on the dimension with the largest spread
+   d = 0;
+   best = -1.0;
+   for(j = 0; j < tree->dim; j++)
+   {
+      min = max = pts[perm[lo]*tree->dim+j];
+      for(i = lo+1; i < hi; i++)
+      {
+         if(pts[perm[i]*tree->dim+j] < min) min = pts[perm[i]*tree->dim+j];
+         if(pts[perm[i]*tree->dim+j] > max) max = pts[perm[i]*tree->dim+j];
+      }
+      spread = max - min;
+      if(spread > best)
+      {
+         best = spread;
+         d = j;
+      }
+   }
+
+   kdtreeSelect(pts, tree->dim, perm, lo, hi, mid, d);
+   (tree->splitDim)[mid] = d;
+
+   kdtreeBuildRange(tree, pts, perm, lo, mid);
+   kdtreeBuildRange(tree, pts, perm, mid+1, hi);
+}
+
+/*=========================================================*/
+KdTree* KDTREE_build(double *pts, int n, int dim)
+{
+   int i;
+   KdTree *tree;
+
+   assert(n >= 0 && dim > 0);
+
+   tree = (KdTree*)malloc(sizeof(KdTree));
+   tree->dim = dim;
+   tree->n = n;
+   tree->pts = (double*)malloc(sizeof(double)*dim*(n > 0 ? n : 1));
+   tree->index = (int*)malloc(sizeof(int)*(n > 0 ? n : 1));
+   tree->splitDim = (int*)malloc(sizeof(int)*(n > 0 ? n : 1));
+
+   for(i = 0; i < n; i++) (tree->index)[i] = i;
+   kdtreeBuildRange(tree, pts, tree->index, 0, n);
+
+   for(i = 0; i < n; i++)
+      memcpy(tree->pts + i*dim, pts + (tree->index)[i]*dim, sizeof(double)*dim);
+
+   return tree;
+}
+
+/*=========================================================*/
+void KDTREE_delete(KdTree *tree)
+{
+   free(tree->pts);
+   free(tree->index);
+   free(tree->splitDim);
+   free(tree);
+}
+
+/*=========================================================*/
+void kdtreeHeapDown(KdTreeQuery *q, int i, int cnt)
+{
+   int c, ti;
+   double td;
+
+   while((c = 2*i+1) < cnt)
+   {
+      if(c+1 < cnt && kdtreeFarther((q->heapDist)[c+1], (q->heapIdx)[c+1],
+                                    (q->heapDist)[c], (q->heapIdx)[c])) ++c;
+      if(!kdtreeFarther((q->heapDist)[c], (q->heapIdx)[c],
+                        (q->heapDist)[i], (q->heapIdx)[i])) break;
+
+      td = (q->heapDist)[i]; (q->heapDist)[i] = (q->heapDist)[c]; (q->heapDist)[c] = td;
+      ti = (q->heapIdx)[i]; (q->heapIdx)[i] = (q->heapIdx)[c]; (q->heapIdx)[c] = ti;
+      i = c;
+   }
+}
+
+/*=========================================================*/
+void kdtreeOffer(KdTreeQuery *q, double d2, int index)
+{
+   int i, p;
+
+   if(q->cnt < q->k)
+   {
+      // append and sift up
+      i = (q->cnt)++;
+      while(i > 0)
+      {
+         p = (i-1)/2;
+         if(!kdtreeFarther(d2, index, (q->heapDist)[p], (q->heapIdx)[p])) break;
+         (q->heapDist)[i] = (q->heapDist)[p];
+         (q->heapIdx)[i] = (q->heapIdx)[p];
+         i = p;
+      }
+      (q->heapDist)[i] = d2;
+      (q->heapIdx)[i] = index;
+      return;
+   }
+
+   if(!kdtreeFarther((q->heapDist)[0], (q->heapIdx)[0], d2, index)) return;
+
+   (q->heapDist)[0] = d2;
+   (q->heapIdx)[0] = index;
+   kdtreeHeapDown(q, 0, q->cnt);
+}
+
+/*=========================================================*/
+void kdtreeSearch(KdTreeQuery *q, int lo, int hi)
+{
+   int j, mid, sd, dim;
+   double d2, diff, *p;
+
+   if(hi <= lo) return;
+
+   dim = q->tree->dim;
+   mid = (lo+hi)/2;
+   p = q->tree->pts + mid*dim;
+
+   if(!(q->skip) || !(q->skip)(q->skipArg, (q->tree->index)[mid]))
+   {
+      d2 = 0.0;
+      for(j = 0; j < dim; j++)
+         d2 += (q->query[j] - p[j])*(q->query[j] - p[j]);
+      kdtreeOffer(q, d2, (q->tree->index)[mid]);
+   }
+
+   sd = (q->tree->splitDim)[mid];
+   if(sd < 0) return;
+
+   diff = q->query[sd] - p[sd];
+   if(diff < 0.0)
+   {
+      kdtreeSearch(q, lo, mid);
+      if(q->cnt < q->k || diff*diff <= (q->heapDist)[0]) kdtreeSearch(q, mid+1, hi);
+   }
+   else
+   {
+      kdtreeSearch(q, mid+1, hi);
+      if(q->cnt < q->k || diff*diff <= (q->heapDist)[0]) kdtreeSearch(q, lo, mid);
+   }
+}
+
+/*=========================================================*/
+int KDTREE_knn(KdTree *tree, double *query, int k, KdTreeSkip skip, void *skipArg,
+               int *idx, double *dist2)
+{
+   int i, cnt;
+   double *heapDist;
+   KdTreeQuery q;
+
+   if(k > tree->n) k = tree->n;
+   if(k <= 0) return 0;
+
+   heapDist = dist2 ? dist2 : (double*)malloc(sizeof(double)*k);
+
+   q.tree = tree;
+   q.query = query;
+   q.skip = skip;
+   q.skipArg = skipArg;
+   q.k = k;
+   q.cnt = 0;
+   q.heapDist = heapDist;
+   q.heapIdx = idx;
+
+   kdtreeSearch(&q, 0, tree->n);
+
+   // heap sort in place, nearest first
+   cnt = q.cnt;
+   for(i = cnt-1; i > 0; i--)
+   {
+      double td;
+      int ti;
+
+      td = heapDist[0]; heapDist[0] = heapDist[i]; heapDist[i] = td;
+      ti = idx[0]; idx[0] = idx[i]; idx[i] = ti;
+      kdtreeHeapDown(&q, 0, i);
+   }
+
+   if(!dist2) free(heapDist);
+
+   return cnt;
+}
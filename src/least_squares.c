@@ -1,19 +1,34 @@
 /*******************************************************************************
 
   Title:    least_squares
-  Author:   Mike Burl 
+  Author:   Mike Burl
   Function: Compute least squares solution to Mx = b, where M and
             b are given and x is unknown. Return RMS error.
-            x must be preallocated to proper size (mc x 1) 
-           
+            x must be preallocated to proper size (mc x 1)
+
+  Notes:    When M has at least as many rows as columns it is first
+              factored as M = QR. If the factorization proves that every
+              singular value of M is above the threshold pinv uses to
+              drop singular values, the pseudo-inverse solution is just
+              x = inv(R) Q'b, and that is returned without forming
+              pinv(M). Otherwise (rank-deficient or nearly so) the
+              solution comes from pinv as before.
+
 *******************************************************************************/
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "carto/least_squares.h"
+#include "carto/householder_qr.h"
 #include "carto/qmalloc.h"
 #include "carto/pinv.h"
 #include "carto/burl.h"
 
+#define LSQ_EPS 1e-08 /* As EPS in pinv */
+#define LSQ_SAFETY 10.0
+
+static int least_squares_qr(int mr, int mc, double *M, double *b, double *x);
+
 double least_squares(int mr, int mc, double *M, double *b, double *x)
 {
   int    ar, ac;
@@ -23,16 +38,19 @@ double least_squares(int mr, int mc, double *M, double *b, double *x)
   double e;
   char   infunc[] = "least_squares";
 
-  ar = mc;
-  ac = mr;
-  A = (double *) qmalloc(ar*ac, sizeof(double), 0, infunc, "A");  
-  pinv(mr, mc, M, A);
+  if ((mr < mc) || (least_squares_qr(mr, mc, M, b, x) == ERR)) {
+    ar = mc;
+    ac = mr;
+    A = (double *) qmalloc(ar*ac, sizeof(double), 0, infunc, "A");
+    pinv(mr, mc, M, A);
 
-  for (i = 0; i < ar; i++) {
-    x[i] = D_ZERO;
-    for (j = 0; j < ac; j++) {
-      x[i] += A[i*ac+j] * b[j];
+    for (i = 0; i < ar; i++) {
+      x[i] = D_ZERO;
+      for (j = 0; j < ac; j++) {
+        x[i] += A[i*ac+j] * b[j];
+      }
     }
+    free((void *) A);
   }
 
   bhat = (double *) qmalloc(mr, sizeof(double), 0, infunc, "bhat");
@@ -45,9 +63,69 @@ double least_squares(int mr, int mc, double *M, double *b, double *x)
     e += (bhat[i] - b[i]) * (bhat[i] - b[i]);
   }
 
-  free((void *) A);
   free((void *) bhat);
 
   return(sqrt(e));
 }
 
+/********************/
+/* LEAST_SQUARES_QR */
+/********************/
+/* Solve by QR, or return ERR (leaving x alone) if M may be too close to */
+/*   rank deficient for the answer to match pinv. The test uses           */
+/*   sigma_max <= ||R||_F and sigma_min >= 1/||inv(R)||_F.                */
+
+static int least_squares_qr(int mr, int mc, double *M, double *b, double *x)
+{
+  int    i, j;
+  int    status;
+  double *QR, *tau, *Rinv, *y;
+  double rnorm, rinorm, d;
+  char   infunc[] = "least_squares_qr";
+
+  QR   = (double *) qmalloc(mr*mc, sizeof(double), 0, infunc, "QR");
+  tau  = (double *) qmalloc(mc, sizeof(double), 0, infunc, "tau");
+  Rinv = (double *) qmalloc(mc*mc, sizeof(double), 0, infunc, "Rinv");
+  y    = (double *) qmalloc(mr, sizeof(double), 0, infunc, "y");
+
+  householder_qr(mr, mc, M, QR, tau);
+
+  status = ERR;
+  rnorm = D_ZERO;
+  for (j = 0; j < mc; j++) {
+    for (i = 0; i <= j; i++) {
+      rnorm += QR[j*mr+i] * QR[j*mr+i];
+    }
+  }
+  rnorm = sqrt(rnorm);
+
+  if ((rnorm > D_ZERO) && (householder_qr_r_inv(mr, mc, QR, Rinv) == OK)) {
+    rinorm = D_ZERO;
+    for (i = 0; i < mc*mc; i++) {
+      rinorm += Rinv[i] * Rinv[i];
+    }
+    rinorm = sqrt(rinorm);
+
+    if (D_ONE/rinorm > LSQ_SAFETY * rnorm * MAX(mr, mc) * LSQ_EPS) {
+      for (i = 0; i < mr; i++) {
+        y[i] = b[i];
+      }
+      householder_qr_apply_qt(mr, mc, QR, tau, 1, y);
+      for (i = 0; i < mc; i++) {
+        d = D_ZERO;
+        for (j = i; j < mc; j++) {
+          d += Rinv[i*mc+j] * y[j];
+        }
+        x[i] = d;
+      }
+      status = OK;
+    }
+  }
+
+  free((void *) QR);
+  free((void *) tau);
+  free((void *) Rinv);
+  free((void *) y);
+
+  return(status);
+}
@@ -1,3 +1,5 @@
+#include <zvproto.h>
+
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -9,6 +11,22 @@
 #include "gsl/gsl_linalg.h"
 #include "gsl/gsl_multifit.h"
 
+#define LSQEQUATION_ALIGN 64
+
+/*=========================================================*/
+/* zeroed block of n doubles aligned for vector loads      */
+/*=========================================================*/
+double* allocAlignedDoubles(int n)
+{
+   void *ptr = NULL;
+
+   if(n < 1) n = 1;
+   if(posix_memalign(&ptr, LSQEQUATION_ALIGN, sizeof(double)*n)) zmabend("malloc failed");
+   memset(ptr, 0, sizeof(double)*n);
+
+   return (double*)ptr;
+}
+
 /*=========================================================*/
 LsqEquation* LSQEQUATION_getEquation(int xcnt, int nRecs, int weight)
 {
@@ -19,49 +37,73 @@ LsqEquation* LSQEQUATION_getEquation(int xcnt, int nRecs, int weight)
    eq = (LsqEquation*)malloc(sizeof(LsqEquation));
 
    eq->nRecs = nRecs;
+   eq->maxRecs = nRecs;
    eq->xcnt = xcnt;
-   eq->ypar = (double*)calloc(nRecs, sizeof(double));
-   eq->xpar = (double**)calloc(xcnt, sizeof(double*));
-   for(i = 0; i < xcnt; i++)
-      (eq->xpar)[i] = (double*)calloc(nRecs, sizeof(double));
+   eq->ypar = allocAlignedDoubles(nRecs);
+   eq->xpar = allocAlignedDoubles(xcnt*nRecs);
 
    eq->res = (double*)calloc(nRecs, sizeof(double));
    eq->sol = (double*)calloc(nRecs, sizeof(double));
    if(weight > 0) eq->weight = 1;
    else eq->weight=0;
+   eq->xwork = eq->ywork = NULL;
+   eq->gslWork = NULL;
+   eq->gslRecs = -1;
    if(weight)
    {
-      eq->weights = (double*)calloc(nRecs, sizeof(double));
+      eq->weights = allocAlignedDoubles(nRecs);
 
+      // one block, by row, so GSL can write it directly
       eq->cov = (double**)malloc(xcnt*sizeof(double*));
-      for(i = 0; i < xcnt; i++) (eq->cov)[i] = (double*)calloc(xcnt, sizeof(double));
-
+      (eq->cov)[0] = (double*)calloc(xcnt*xcnt, sizeof(double));
+      for(i = 1; i < xcnt; i++) (eq->cov)[i] = (eq->cov)[0] + i*xcnt;
+   }
+   else
+   {
+      eq->xwork = allocAlignedDoubles(xcnt*nRecs);
+      eq->ywork = allocAlignedDoubles(nRecs);
    }
 
    return eq;
 }
 
 /*=========================================================*/
-void LSQEQUATION_deleteEquation(LsqEquation* eq)
+void freeGslWorkspace(LsqEquation *eq)
 {
-   int i;
+   if(eq->gslWork) gsl_multifit_linear_free((gsl_multifit_linear_workspace*)(eq->gslWork));
+   eq->gslWork = NULL;
+   eq->gslRecs = -1;
+}
 
+/*=========================================================*/
+void LSQEQUATION_deleteEquation(LsqEquation* eq)
+{
    free(eq->sol);
    free(eq->res);
-   for(i = 0; i < eq->xcnt; i++) free((eq->xpar)[i]);
    free(eq->xpar);
    free(eq->ypar);
+   free(eq->xwork);
+   free(eq->ywork);
    if(eq->weight)
    {
       free(eq->weights);
 
-      for(i = 0; i < eq->xcnt; i++) free((eq->cov)[i]);
+      free((eq->cov)[0]);
       free(eq->cov);
+      freeGslWorkspace(eq);
    }
 
    free(eq);
 }
 
+/*=========================================================*/
+void LSQEQUATION_setNRecs(LsqEquation *eq, int nRecs)
+{
+   assert(nRecs >= 0 && nRecs <= eq->maxRecs);
+
+   eq->nRecs = nRecs;
+}
+
 /*=========================================================*/
 void LSQEQUATION_setYPar(LsqEquation *eq, double *buf, int nRecs)
 {
@@ -79,103 +121,87 @@ void LSQEQUATION_setWeightPar(LsqEquation *eq, double *buf, int nRecs)
 /*=========================================================*/
 void LSQEQUATION_setXPar(LsqEquation *eq, double *buf, int ix, int nRecs)
 {
-   assert(ix < eq->xcnt);
+   int i;
+   double *row;
+
+   assert(ix < eq->xcnt && nRecs <= eq->nRecs);
+
+   if(!eq->weight)
+   {
+      memcpy(eq->xpar + ix*eq->nRecs, buf, sizeof(double)*nRecs);
+      return;
+   }
 
-   memcpy((eq->xpar)[ix], buf, sizeof(double)*nRecs);
+   for(i = 0, row = eq->xpar + ix; i < nRecs; i++, row += eq->xcnt) *row = buf[i];
 }
 
 /*=========================================================*/
 void calcResiduals(LsqEquation *eq)
 {
-   int i;
+   int i, j, n, rs, cs;
+   double *col, *res;
 
-   for(i = 0; i < eq->nRecs; i++)
-   {
-      int j;
-      double result;
+   n = eq->nRecs;
+   res = eq->res;
 
-      result = 0;
-      for(j = 0; j < eq->xcnt; j++)
-         result += (eq->xpar)[j][i]*(eq->sol)[j];
-      (eq->res)[i] = (eq->ypar)[i] - result;
-   }
+   // element (i, j) of xpar is at i*rs + j*cs
+   rs = eq->weight ? eq->xcnt : 1;
+   cs = eq->weight ? 1 : n;
 
+   // sum down the columns, in the same order per row as a dot product
+   for(i = 0; i < n; i++) res[i] = 0.0;
+   for(j = 0; j < eq->xcnt; j++)
+   {
+      col = eq->xpar + j*cs;
+      for(i = 0; i < n; i++) res[i] += col[i*rs]*(eq->sol)[j];
+   }
+   for(i = 0; i < n; i++) res[i] = (eq->ypar)[i] - res[i];
 }
 
 /*=========================================================*/
 void solveOrig(LsqEquation *eq)
 {
-   int i;
-   double *xbuf, *ybuf;
-
-   xbuf = (double*)malloc(sizeof(double)*eq->xcnt*eq->nRecs);
-   for(i = 0; i < eq->xcnt; i++)
-      memcpy(xbuf+(i*eq->nRecs), (eq->xpar)[i], sizeof(double)*eq->nRecs);
-   ybuf = (double*)malloc(sizeof(double)*eq->nRecs);
-   memcpy(ybuf, eq->ypar, sizeof(double)*eq->nRecs);
-   lsqfit(xbuf, ybuf, eq->nRecs, eq->xcnt, eq->sol, 1.e-7, &(eq->lsqErr));
+   // lsqfit destroys its input, and the residuals need it
+   memcpy(eq->xwork, eq->xpar, sizeof(double)*eq->xcnt*eq->nRecs);
+   memcpy(eq->ywork, eq->ypar, sizeof(double)*eq->nRecs);
+   lsqfit(eq->xwork, eq->ywork, eq->nRecs, eq->xcnt, eq->sol, 1.e-7, &(eq->lsqErr));
 
    calcResiduals(eq);
-
-   free(xbuf);
-   free(ybuf);
 }
 
 /*=========================================================*/
 void wsolve(LsqEquation *eq)
 {
-   int i;
-   gsl_matrix *mX, *mCov;
-   gsl_vector *vY, *vC, *vW;
-   gsl_multifit_linear_workspace *work;
-
-   work = gsl_multifit_linear_alloc(eq->nRecs, eq->xcnt);
+   int n;
+   gsl_matrix_view mX, mCov;
+   gsl_vector_view vY, vC, vW;
 
-   mX = gsl_matrix_alloc(eq->nRecs, eq->xcnt);
-   vY = gsl_vector_alloc(eq->nRecs);
-   vW = gsl_vector_alloc(eq->nRecs);
-   vC = gsl_vector_alloc(eq->xcnt);
-   mCov = gsl_matrix_alloc(eq->xcnt, eq->xcnt);
-
-   /* set mX matrix */
-   for(i = 0; i < eq->nRecs; i++)
+   n = eq->nRecs;
+   if(eq->gslRecs != n)
    {
-      int j;
+      freeGslWorkspace(eq);
+      eq->gslWork = gsl_multifit_linear_alloc(n, eq->xcnt);
+      eq->gslRecs = n;
+   }
 
-      for(j = 0; j < eq->xcnt; j++)
-         gsl_matrix_set(mX, i, j, (eq->xpar)[j][i]);
+   /* xpar is stored by row for weighted equations, as GSL takes it */
+   mX = gsl_matrix_view_array(eq->xpar, n, eq->xcnt);
 
-      gsl_vector_set(vY, i, (eq->ypar)[i]);
-      gsl_vector_set(vW, i, (eq->weights)[i]);
-      //      gsl_vector_set(vW, i, 1/(eq->xcnt - i));
-   }
+   vY = gsl_vector_view_array(eq->ypar, n);
+   vW = gsl_vector_view_array(eq->weights, n);
+   vC = gsl_vector_view_array(eq->sol, eq->xcnt);
+   mCov = gsl_matrix_view_array((eq->cov)[0], eq->xcnt, eq->xcnt);
 
    /* solve */
-   gsl_multifit_wlinear(mX, vW, vY, vC, mCov, &(eq->chisq), work);
+   gsl_multifit_wlinear(&(mX.matrix), &(vW.vector), &(vY.vector), &(vC.vector), &(mCov.matrix),
+                        &(eq->chisq), (gsl_multifit_linear_workspace*)(eq->gslWork));
 
    //   printf(" *** chisq estimate: %f\n", eq->chisq);
 
-   for(i = 0; i < eq->xcnt; i++)
-   {
-      int j;
-
-      (eq->sol)[i] = gsl_vector_get(vC, i);
-
-      for(j = 0; j < eq->xcnt; j++)
-         (eq->cov)[i][j] = gsl_matrix_get(mCov, i, j);
-   }
-
    eq->lsqErr = 0;
 
    /* calculate residuals */
    calcResiduals(eq);
-
-   gsl_multifit_linear_free(work);
-   gsl_matrix_free(mX);
-   gsl_matrix_free(mCov);
-   gsl_vector_free(vY);
-   gsl_vector_free(vW);
-   gsl_vector_free(vC);
 }
 
 /*=========================================================*/
@@ -4,12 +4,13 @@
 #include <assert.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "carto/lsqibis.h"
 #include "carto/ibishelper.h"
 #include "ibisfile.h"
 
-#include "carto/cartoSortUtils.h"
+#include "carto/thread_manager.h"
 
 #define MAXCOEFFCOLS 200
 #define MAXRESCOLS   10
@@ -21,6 +22,7 @@ void setControlMapping(LsqIbis *ibis)
    float control;
    float *pastControls;
    int *pastCnts;
+   double *controls;
    IBISStruct *ibisfile;
 
    ibisfile = ibis->ibisfile;
@@ -56,6 +58,7 @@ void setControlMapping(LsqIbis *ibis)
    }
 
    // to keep track of past control numbers
+   controls = IBISHELPER_getDoubleColumn(ibisfile, ibis->concol - 1);
    pastControls = (float*)calloc(ibisfile->nr, sizeof(float));
    pastCnts = (int*)calloc(ibisfile->nr, sizeof(int));
    cnt = 0;
@@ -63,7 +66,7 @@ void setControlMapping(LsqIbis *ibis)
    {
       int j, isNew;
 
-      control = IBISHELPER_getFloat(ibisfile, ibis->concol - 1, i);
+      control = (float)controls[i];
       if(i == 0)
       {
          pastControls[0] = control;
@@ -111,7 +114,7 @@ void setControlMapping(LsqIbis *ibis)
    {
       int j;
 
-      control = IBISHELPER_getFloat(ibisfile, ibis->concol - 1, i);
+      control = (float)controls[i];
       for(j = 0; j < cnt; j++)
       {
          if(control == pastControls[j])
@@ -283,6 +286,13 @@ void LSQIBIS_deleteLsqIbis(LsqIbis *ibis)
    free(ibis->control2IBIS);
    free(ibis->controlSol);
 
+   if(ibis->controlTrees)
+   {
+      for(i = 0; i < ibis->controlCnt; i++)
+         if((ibis->controlTrees)[i]) KDTREE_delete((ibis->controlTrees)[i]);
+      free(ibis->controlTrees);
+   }
+
    for(i = 0; i < ibisfile->nr; i++)
       free((ibis->IBIS2control)[i]);
    free(ibis->IBIS2control);
@@ -346,9 +356,11 @@ void getControlYBuf(LsqIbis *ibis, double *buf, int icontrol, int iy, int includ
 {
    int i, ycol, ycnt;
    int controlCnt;
+   double *column;
 
    ycnt = 0;
    ycol = (ibis->ycols)[iy] - 1;
+   column = IBISHELPER_getDoubleColumn(ibis->ibisfile, ycol);
    controlCnt = (ibis->controlIDCnts)[icontrol];
    for(i = 0; i < controlCnt; i++)
    {
@@ -358,7 +370,7 @@ void getControlYBuf(LsqIbis *ibis, double *buf, int icontrol, int iy, int includ
 
       if(!includeThrowout && isThrowout(ibis, icontrol, i)) continue;
 
-      buf[ycnt++] = IBISHELPER_getDouble(ibis->ibisfile, ycol, rec);
+      buf[ycnt++] = column[rec];
    }
 }
 
@@ -370,9 +382,11 @@ void getControlXBuf(LsqIbis *ibis, double *buf, int icontrol, int ix, int includ
 {
    int i, xcol, xcnt;
    int controlCnt;
+   double *column;
 
    xcnt = 0;
    xcol = (ibis->xcols)[ix] - 1;
+   column = IBISHELPER_getDoubleColumn(ibis->ibisfile, xcol);
    controlCnt = (ibis->controlIDCnts)[icontrol];
    for(i = 0; i < controlCnt; i++)
    {
@@ -382,7 +396,7 @@ void getControlXBuf(LsqIbis *ibis, double *buf, int icontrol, int ix, int includ
 
       if(!includeThrowout && isThrowout(ibis, icontrol, i)) continue;
 
-      buf[xcnt++] = IBISHELPER_getDouble(ibis->ibisfile, xcol, rec);
+      buf[xcnt++] = column[rec];
    }
 }
 
@@ -394,9 +408,11 @@ void getControlWeightBuf(LsqIbis *ibis, double *buf, int icontrol, int includeTh
 {
    int i, wcol, wcnt;
    int controlCnt;
+   double *column;
 
    wcnt = 0;
    wcol = ibis->weightcol - 1;
+   column = IBISHELPER_getDoubleColumn(ibis->ibisfile, wcol);
    controlCnt = (ibis->controlIDCnts)[icontrol];
    for(i = 0; i < controlCnt; i++)
    {
@@ -406,21 +422,21 @@ void getControlWeightBuf(LsqIbis *ibis, double *buf, int icontrol, int includeTh
 
       if(!includeThrowout && isThrowout(ibis, icontrol, i)) continue;
 
-      buf[wcnt++] = IBISHELPER_getDouble(ibis->ibisfile, wcol, rec);
+      buf[wcnt++] = column[rec];
    }
 }
 
 /*=========================================================*/
-LsqEquation* LSQIBIS_getLsqEquation(LsqIbis *ibis, int icontrol, int iy, int includeThrowout)
+/* Loads control icontrol, dependent column iy into an     */
+/* existing eq whose capacity is at least the control's    */
+/* record count. buf must be as large as that capacity.    */
+/*=========================================================*/
+void fillLsqEquation(LsqIbis *ibis, LsqEquation *eq, double *buf, int icontrol, int iy, int includeThrowout)
 {
-   double *buf;
    int i, nRecs;
-   LsqEquation *eq;
 
    nRecs = getControlNRecs(ibis, icontrol, includeThrowout);
-   eq = LSQEQUATION_getEquation(ibis->xcnt, nRecs, ibis->weightcol);
-
-   buf = (double*)malloc(sizeof(double)*nRecs);
+   LSQEQUATION_setNRecs(eq, nRecs);
 
    getControlYBuf(ibis, buf, icontrol, iy, includeThrowout);
    LSQEQUATION_setYPar(eq, buf, nRecs);
@@ -436,53 +452,96 @@ LsqEquation* LSQIBIS_getLsqEquation(LsqIbis *ibis, int icontrol, int iy, int inc
       getControlWeightBuf(ibis, buf, icontrol, includeThrowout);
       LSQEQUATION_setWeightPar(eq, buf, nRecs);
    }
+}
+
+/*=========================================================*/
+LsqEquation* LSQIBIS_getLsqEquation(LsqIbis *ibis, int icontrol, int iy, int includeThrowout)
+{
+   double *buf;
+   int nRecs;
+   LsqEquation *eq;
+
+   nRecs = getControlNRecs(ibis, icontrol, includeThrowout);
+   eq = LSQEQUATION_getEquation(ibis->xcnt, nRecs, ibis->weightcol);
 
+   buf = (double*)malloc(sizeof(double)*nRecs);
+   fillLsqEquation(ibis, eq, buf, icontrol, iy, includeThrowout);
    free(buf);
 
    return eq;
 }
 
 /*=========================================================*/
-void getClosestPts(LsqIbis *ibis, int *pts, int row, int includeThrowout)
+KdTree* getControlTree(LsqIbis *ibis, int control)
 {
-   int i;
-   int control, controlRec, ncontrols;
-   double *orig, *dist, max;
+   int i, j, ncontrols;
+   double *pts, *column;
 
-   orig = (double*)malloc(sizeof(double)*ibis->xcnt);
-   for(i = 0; i < ibis->xcnt; i++)
-      orig[i] = IBISHELPER_getDouble(ibis->ibisfile, (ibis->xcols)[i] - 1, row);
-   control = (ibis->IBIS2control)[row][0];
-   controlRec = (ibis->IBIS2control)[row][1];
+   if(!(ibis->controlTrees))
+      ibis->controlTrees = (KdTree**)calloc(ibis->controlCnt, sizeof(KdTree*));
 
-   // get the distances
-   max = -1;
-   ncontrols = (ibis->controlIDCnts)[control];
-   dist = (double*)calloc(ncontrols, sizeof(double));
-   for(i = 0; i < ncontrols; i++)
+   if(!((ibis->controlTrees)[control]))
    {
-      int j;
-      double x;
-
+      ncontrols = (ibis->controlIDCnts)[control];
+      pts = (double*)malloc(sizeof(double)*ibis->xcnt*(ncontrols > 0 ? ncontrols : 1));
       for(j = 0; j < ibis->xcnt; j++)
       {
-         x = IBISHELPER_getDouble(ibis->ibisfile, (ibis->xcols)[j] - 1, (ibis->control2IBIS)[control][i]);
-         dist[i] += pow(orig[j] - x, 2.0);
+         column = IBISHELPER_getDoubleColumn(ibis->ibisfile, (ibis->xcols)[j] - 1);
+         for(i = 0; i < ncontrols; i++)
+            pts[i*ibis->xcnt+j] = column[(ibis->control2IBIS)[control][i]];
       }
 
-      dist[i] = pow(dist[i], 0.5);
-
-      if(max < dist[i]) max = dist[i];
+      (ibis->controlTrees)[control] = KDTREE_build(pts, ncontrols, ibis->xcnt);
+      free(pts);
    }
 
-   if(!includeThrowout)
-      for(i = 0; i < ncontrols; i++)
-         if(isThrowout(ibis, control, i)) dist[i] = max;
+   return (ibis->controlTrees)[control];
+}
+
+/*----------------*/
+typedef struct
+{
+   LsqIbis *ibis;
+   int control;
+}ThrowoutSkip;
+
+/*=========================================================*/
+int skipThrowout(void *arg, int rec)
+{
+   ThrowoutSkip *s;
+
+   s = (ThrowoutSkip*)arg;
+   return isThrowout(s->ibis, s->control, rec);
+}
+
+/*=========================================================*/
+/* Stores into pts the control records of the npts points  */
+/* of row's control nearest to row in the x columns,       */
+/* nearest first. Unless includeThrowout, thrown out       */
+/* points are only used (in record order) when there are   */
+/* not enough others.                                      */
+/*=========================================================*/
+void getClosestPts(LsqIbis *ibis, int *pts, int npts, int row, int includeThrowout)
+{
+   int i, cnt;
+   int control;
+   double *orig;
+   ThrowoutSkip skip;
 
-   getSelectionSortIndices(dist, pts, i, CART_DOUBLE);
+   orig = (double*)malloc(sizeof(double)*ibis->xcnt);
+   for(i = 0; i < ibis->xcnt; i++)
+      orig[i] = IBISHELPER_getDouble(ibis->ibisfile, (ibis->xcols)[i] - 1, row);
+   control = (ibis->IBIS2control)[row][0];
+
+   skip.ibis = ibis;
+   skip.control = control;
+   cnt = KDTREE_knn(getControlTree(ibis, control), orig, npts,
+                    includeThrowout ? NULL : skipThrowout, &skip, pts, NULL);
+
+   for(i = 0; cnt < npts && i < (ibis->controlIDCnts)[control]; i++)
+      if(isThrowout(ibis, control, i)) pts[cnt++] = i;
 
    free(orig);
-   free(dist);
 }
 
 /*=========================================================*/
@@ -493,7 +552,7 @@ int LSQIBIS_passesLocalFit(LsqIbis *ibis, int row, int npts, int includeThrowout
 {
    int i, j;
    int control, controlrec, controlcnt, *pts;
-   double *buf, *errs, error;
+   double *buf, *errs, error, *column;
    int **map;
    LsqEquation **eq;
    IBISStruct *ibisfile;
@@ -511,14 +570,15 @@ int LSQIBIS_passesLocalFit(LsqIbis *ibis, int row, int npts, int includeThrowout
 
    pts = (int*)calloc(controlcnt, sizeof(int));
    assert(pts);
-   getClosestPts(ibis, pts, row, includeThrowout);
+   getClosestPts(ibis, pts, npts, row, includeThrowout);
 
    buf = (double*)malloc(npts*sizeof(double));
    // set xpar
    for(i = 0; i < ibis->xcnt; i++)
    {
+      column = IBISHELPER_getDoubleColumn(ibisfile, (ibis->xcols)[i] - 1);
       for(j = 0; j < npts; j++)
-         buf[j] = IBISHELPER_getDouble(ibisfile, (ibis->xcols)[i] - 1, map[control][pts[j]]);
+         buf[j] = column[map[control][pts[j]]];
 
       for(j = 0; j < ibis->ycnt; j++)
          LSQEQUATION_setXPar(eq[j], buf, i, npts);
@@ -527,8 +587,9 @@ int LSQIBIS_passesLocalFit(LsqIbis *ibis, int row, int npts, int includeThrowout
    // set weights
    if(ibis->weightcol)
    {
+      column = IBISHELPER_getDoubleColumn(ibisfile, ibis->weightcol - 1);
       for(j = 0; j < npts; j++)
-         buf[j] = IBISHELPER_getDouble(ibisfile, ibis->weightcol - 1, map[control][pts[j]]);
+         buf[j] = column[map[control][pts[j]]];
 
       for(j = 0; j < ibis->ycnt; j++)
          LSQEQUATION_setWeightPar(eq[j], buf, npts);
@@ -537,8 +598,9 @@ int LSQIBIS_passesLocalFit(LsqIbis *ibis, int row, int npts, int includeThrowout
    // set ypar
    for(i = 0; i < ibis->ycnt; i++)
    {
+      column = IBISHELPER_getDoubleColumn(ibisfile, (ibis->ycols)[i] - 1);
       for(j = 0; j < npts; j++)
-         buf[j] = IBISHELPER_getDouble(ibisfile, (ibis->ycols)[i] - 1, map[control][pts[j]]);
+         buf[j] = column[map[control][pts[j]]];
       LSQEQUATION_setYPar(eq[i], buf, npts);
 
       LSQEQUATION_solve(eq[i]);
@@ -625,7 +687,10 @@ void setControlDistance(LsqIbis *ibis, LsqEquation **eqs, int icontrol, int incl
 }
 
 /*=========================================================*/
-void printControlSol(LsqIbis *ibis, LsqEquation **eq, int icontrol)
+/* sol holds ycnt*xcnt coefficients, sol[iy*xcnt+ix], and  */
+/* lsqErr the error flag of each of the ycnt equations     */
+/*=========================================================*/
+void printControlSolBuf(LsqIbis *ibis, double *sol, int *lsqErr, int icontrol)
 {
    int i, j;
 
@@ -633,10 +698,10 @@ void printControlSol(LsqIbis *ibis, LsqEquation **eq, int icontrol)
    for(i = 0; i < ibis->ycnt; i++)
    {
       for(j = 0; j < ibis->xcnt; j++)
-         if(!(eq[i]->lsqErr))
+         if(!(lsqErr[i]))
             printf("%3d %7.2f %7d %24.10f\n",
                    i+1, (ibis->controlID)[icontrol],
-                   (ibis->xcols)[j], ((eq[i])->sol)[j]);
+                   (ibis->xcols)[j], sol[i*ibis->xcnt+j]);
          else
             printf("%3d %7.2f %7d %24.10f\n",
                    i+1, (ibis->controlID)[icontrol],
@@ -646,16 +711,48 @@ void printControlSol(LsqIbis *ibis, LsqEquation **eq, int icontrol)
 }
 
 /*=========================================================*/
-void LSQIBIS_solveControl(LsqIbis *ibis, int icontrol, int includeThrowout)
+void getControlSolBuf(LsqIbis *ibis, LsqEquation **eq, double *sol, int *lsqErr)
+{
+   int i, j;
+
+   for(i = 0; i < ibis->ycnt; i++)
+   {
+      lsqErr[i] = eq[i]->lsqErr;
+      for(j = 0; j < ibis->xcnt; j++)
+         sol[i*ibis->xcnt+j] = ((eq[i])->sol)[j];
+   }
+}
+
+/*=========================================================*/
+void printControlSol(LsqIbis *ibis, LsqEquation **eq, int icontrol)
+{
+   double *sol;
+   int *lsqErr;
+
+   sol = (double*)malloc(sizeof(double)*ibis->ycnt*ibis->xcnt);
+   lsqErr = (int*)malloc(sizeof(int)*ibis->ycnt);
+
+   getControlSolBuf(ibis, eq, sol, lsqErr);
+   printControlSolBuf(ibis, sol, lsqErr, icontrol);
+
+   free(sol);
+   free(lsqErr);
+}
+
+/*=========================================================*/
+/* Solves control icontrol using the ycnt equations in eq  */
+/* as workspace and stores the solutions, residuals and    */
+/* distances in ibis. Only the rows of icontrol are        */
+/* written, so different controls can be solved at once.   */
+/*=========================================================*/
+void solveControlWithEquations(LsqIbis *ibis, LsqEquation **eq, double *buf, int icontrol, int includeThrowout)
 {
    int i, erroredOut;
-   LsqEquation **eq;
 
    erroredOut = 0;
-   eq = (LsqEquation**)malloc(sizeof(LsqEquation*)*ibis->ycnt);
    for(i = 0; i < ibis->ycnt; i++)
    {
-      eq[i] = LSQIBIS_getLsqEquation(ibis, icontrol, i, includeThrowout);
+      fillLsqEquation(ibis, eq[i], buf, icontrol, i, includeThrowout);
       LSQEQUATION_solve(eq[i]);
 
       if(eq[i]->lsqErr) erroredOut = 1;
@@ -676,12 +773,164 @@ void LSQIBIS_solveControl(LsqIbis *ibis, int icontrol, int includeThrowout)
 
    if(!erroredOut)
       setControlDistance(ibis, eq, icontrol, includeThrowout);
+}
+
+/*=========================================================*/
+void LSQIBIS_solveControl(LsqIbis *ibis, int icontrol, int includeThrowout)
+{
+   int i, nRecs;
+   double *buf;
+   LsqEquation **eq;
+
+   nRecs = getControlNRecs(ibis, icontrol, includeThrowout);
+   eq = (LsqEquation**)malloc(sizeof(LsqEquation*)*ibis->ycnt);
+   for(i = 0; i < ibis->ycnt; i++)
+      eq[i] = LSQEQUATION_getEquation(ibis->xcnt, nRecs, ibis->weightcol);
+   buf = (double*)malloc(sizeof(double)*nRecs);
+
+   solveControlWithEquations(ibis, eq, buf, icontrol, includeThrowout);
 
    /* printing if requested */
    if (!(ibis->noprint)) printControlSol(ibis, eq, icontrol);
 
    for(i = 0; i < ibis->ycnt; i++) LSQEQUATION_deleteEquation(eq[i]);
    free(eq);
+   free(buf);
+}
+
+/*=========================================================*/
+/* Reads the x and y values and the weight of IBIS row     */
+/* into x (xcnt), y (ycnt) and w                           */
+/*=========================================================*/
+void getRowValues(LsqIbis *ibis, int row, double *x, double *y, double *w)
+{
+   int i;
+
+   for(i = 0; i < ibis->xcnt; i++)
+      x[i] = IBISHELPER_getDouble(ibis->ibisfile, (ibis->xcols)[i] - 1, row);
+   for(i = 0; i < ibis->ycnt; i++)
+      y[i] = IBISHELPER_getDouble(ibis->ibisfile, (ibis->ycols)[i] - 1, row);
+   *w = 1.0;
+   if(ibis->weightcol)
+      *w = IBISHELPER_getDouble(ibis->ibisfile, ibis->weightcol - 1, row);
+}
+
+/*=========================================================*/
+/* Returns an incremental fit of all ycols of control      */
+/* icontrol, for use with LSQIBIS_throwoutIncremental and  */
+/* LSQIBIS_solveControlIncremental.                        */
+/*=========================================================*/
+LsqIncremental* LSQIBIS_getIncremental(LsqIbis *ibis, int icontrol, int includeThrowout)
+{
+   int i, row;
+   double *x, *y, w;
+   LsqIncremental *inc;
+
+   inc = LSQINCREMENTAL_get(ibis->xcnt, ibis->ycnt);
+   x = (double*)malloc(sizeof(double)*ibis->xcnt);
+   y = (double*)malloc(sizeof(double)*ibis->ycnt);
+
+   for(i = 0; i < (ibis->controlIDCnts)[icontrol]; i++)
+   {
+      if(!includeThrowout && isThrowout(ibis, icontrol, i)) continue;
+
+      row = (ibis->control2IBIS)[icontrol][i];
+      getRowValues(ibis, row, x, y, &w);
+      LSQINCREMENTAL_addRow(inc, x, y, w);
+   }
+
+   free(x);
+   free(y);
+
+   return inc;
+}
+
+/*=========================================================*/
+/* Marks IBIS row as thrown out and removes it from inc,   */
+/* the incremental fit of its control built with           */
+/* includeThrowout = 0. If the downdate breaks down, inc   */
+/* is rebuilt from the remaining rows.                     */
+/*=========================================================*/
+void LSQIBIS_throwoutIncremental(LsqIbis *ibis, LsqIncremental *inc, int row)
+{
+   int status;
+   double *x, *y, w;
+   LsqIncremental *fresh;
+
+   if((ibis->throwout)[row]) return;
+   (ibis->throwout)[row] = 1;
+
+   x = (double*)malloc(sizeof(double)*ibis->xcnt);
+   y = (double*)malloc(sizeof(double)*ibis->ycnt);
+   getRowValues(ibis, row, x, y, &w);
+   status = LSQINCREMENTAL_removeRow(inc, x, y, w);
+   free(x);
+   free(y);
+
+   if(status)
+   {
+      fresh = LSQIBIS_getIncremental(ibis, (ibis->IBIS2control)[row][0], 0);
+      memcpy(inc->r, fresh->r, sizeof(double)*inc->n*inc->n);
+      inc->nRecs = fresh->nRecs;
+      LSQINCREMENTAL_delete(fresh);
+   }
+}
+
+/*=========================================================*/
+/* Same as LSQIBIS_solveControl, but the solutions come    */
+/* from the incremental fit inc of control icontrol rather */
+/* than from a fresh LsqEquation. The residuals and        */
+/* distances are still computed for every row.             */
+/*=========================================================*/
+void LSQIBIS_solveControlIncremental(LsqIbis *ibis, LsqIncremental *inc, int icontrol, int includeThrowout)
+{
+   int i, j, k, row, erroredOut;
+   int *lsqErr;
+   double *sol, *x, *y, w, r;
+
+   sol = (double*)malloc(sizeof(double)*ibis->ycnt*ibis->xcnt);
+   lsqErr = (int*)malloc(sizeof(int)*ibis->ycnt);
+   x = (double*)malloc(sizeof(double)*ibis->xcnt);
+   y = (double*)malloc(sizeof(double)*ibis->ycnt);
+
+   erroredOut = 0;
+   for(i = 0; i < ibis->ycnt; i++)
+   {
+      lsqErr[i] = LSQINCREMENTAL_solve(inc, i, 1.e-7, sol + i*ibis->xcnt, NULL);
+      if(lsqErr[i]) erroredOut = 1;
+
+      for(j = 0; j < ibis->solcnt; j++)
+         if(lsqErr[i])
+            (ibis->controlSol)[icontrol][i][j] = -999.0;
+         else
+            (ibis->controlSol)[icontrol][i][j] = (j < ibis->xcnt) ? sol[i*ibis->xcnt+j] : 0.0;
+   }
+
+   for(k = 0; k < (ibis->controlIDCnts)[icontrol]; k++)
+   {
+      row = (ibis->control2IBIS)[icontrol][k];
+      if(!includeThrowout && (ibis->throwout)[row]) continue;
+
+      getRowValues(ibis, row, x, y, &w);
+      if(!erroredOut) (ibis->dist)[row] = 0.0;
+      for(i = 0; i < ibis->ycnt; i++)
+      {
+         r = y[i];
+         if(!lsqErr[i])
+            for(j = 0; j < ibis->xcnt; j++) r -= x[j]*sol[i*ibis->xcnt+j];
+         (ibis->res)[i][row] = r;
+         if(!erroredOut) (ibis->dist)[row] += r*r;
+      }
+      if(!erroredOut) (ibis->dist)[row] = sqrt((ibis->dist)[row]);
+   }
+
+   /* printing if requested */
+   if (!(ibis->noprint)) printControlSolBuf(ibis, sol, lsqErr, icontrol);
+
+   free(sol);
+   free(lsqErr);
+   free(x);
+   free(y);
 }
 
 /*=========================================================*/
@@ -693,6 +942,128 @@ void LSQIBIS_solveAll(LsqIbis *ibis, int includeThrowout)
       LSQIBIS_solveControl(ibis, i, includeThrowout);
 }
 
+/*----------------*/
+/* Shared state of the LSQIBIS_solveAllThreaded workers. */
+/* Controls are handed out one at a time through next so */
+/* that a few large controls do not hold up the rest.    */
+typedef struct
+{
+   LsqIbis *ibis;
+   int includeThrowout, maxRecs, next;
+   pthread_mutex_t lock;
+
+   // solutions and error flags saved for printing in
+   // control order, NULL if noprint
+   double *sol;
+   int *lsqErr;
+}SolveAllState;
+
+typedef struct
+{
+   SolveAllState *state;
+}SolveAllWorker;
+
+/*=========================================================*/
+void* solveAllWorker(void *arg)
+{
+   int i, icontrol, ycnt, xcnt;
+   double *buf;
+   LsqEquation **eq;
+   SolveAllState *state;
+   LsqIbis *ibis;
+
+   state = ((SolveAllWorker*)arg)->state;
+   ibis = state->ibis;
+   ycnt = ibis->ycnt;
+   xcnt = ibis->xcnt;
+
+   // per-thread workspace, sized for the largest control
+   eq = (LsqEquation**)malloc(sizeof(LsqEquation*)*ycnt);
+   for(i = 0; i < ycnt; i++)
+      eq[i] = LSQEQUATION_getEquation(xcnt, state->maxRecs, ibis->weightcol);
+   buf = (double*)malloc(sizeof(double)*state->maxRecs);
+
+   while(1)
+   {
+      pthread_mutex_lock(&(state->lock));
+      icontrol = (state->next)++;
+      pthread_mutex_unlock(&(state->lock));
+      if(icontrol >= ibis->controlCnt) break;
+
+      solveControlWithEquations(ibis, eq, buf, icontrol, state->includeThrowout);
+
+      if(state->sol)
+         getControlSolBuf(ibis, eq, state->sol + icontrol*ycnt*xcnt,
+                          state->lsqErr + icontrol*ycnt);
+   }
+
+   for(i = 0; i < ycnt; i++) LSQEQUATION_deleteEquation(eq[i]);
+   free(eq);
+   free(buf);
+
+   return NULL;
+}
+
+/*=========================================================*/
+/* Same as LSQIBIS_solveAll, but the controls are solved   */
+/* concurrently on nthreads threads (get_thread_count() if */
+/* nthreads <= 0). The results, and the printed output,    */
+/* are the same as for LSQIBIS_solveAll.                   */
+/*=========================================================*/
+void LSQIBIS_solveAllThreaded(LsqIbis *ibis, int includeThrowout, int nthreads)
+{
+   int i;
+   SolveAllState state;
+   SolveAllWorker *workers;
+
+   if(nthreads <= 0) nthreads = get_thread_count();
+   if(nthreads > ibis->controlCnt) nthreads = ibis->controlCnt;
+   if(nthreads < 1) nthreads = 1;
+
+   state.ibis = ibis;
+   state.includeThrowout = includeThrowout;
+   state.next = 0;
+   // eq->sol is sized by the record count and is read up to solcnt
+   state.maxRecs = (ibis->solcnt > ibis->xcnt) ? ibis->solcnt : ibis->xcnt;
+   for(i = 0; i < ibis->controlCnt; i++)
+      if((ibis->controlIDCnts)[i] > state.maxRecs) state.maxRecs = (ibis->controlIDCnts)[i];
+   pthread_mutex_init(&(state.lock), NULL);
+
+   state.sol = NULL;
+   state.lsqErr = NULL;
+   if(!(ibis->noprint))
+   {
+      state.sol = (double*)malloc(sizeof(double)*ibis->controlCnt*ibis->ycnt*ibis->xcnt);
+      state.lsqErr = (int*)malloc(sizeof(int)*ibis->controlCnt*ibis->ycnt);
+   }
+
+   // IBISHELPER_getDoubleColumn builds its views lazily and is
+   // not thread-safe, so build every view the workers read here
+   for(i = 0; i < ibis->xcnt; i++)
+      IBISHELPER_getDoubleColumn(ibis->ibisfile, (ibis->xcols)[i] - 1);
+   for(i = 0; i < ibis->ycnt; i++)
+      IBISHELPER_getDoubleColumn(ibis->ibisfile, (ibis->ycols)[i] - 1);
+   if(ibis->weightcol)
+      IBISHELPER_getDoubleColumn(ibis->ibisfile, ibis->weightcol - 1);
+
+   workers = (SolveAllWorker*)malloc(sizeof(SolveAllWorker)*nthreads);
+   for(i = 0; i < nthreads; i++) workers[i].state = &state;
+   run_threads(nthreads, solveAllWorker, (void*)workers, sizeof(SolveAllWorker));
+
+   /* printing if requested */
+   if(!(ibis->noprint))
+   {
+      for(i = 0; i < ibis->controlCnt; i++)
+         printControlSolBuf(ibis, state.sol + i*ibis->ycnt*ibis->xcnt,
+                            state.lsqErr + i*ibis->ycnt, i);
+      free(state.sol);
+      free(state.lsqErr);
+   }
+
+   pthread_mutex_destroy(&(state.lock));
+   free(workers);
+}
+
 /*=========================================================*/
 void writeIBIS(int unit, char *buf, char *format, int colNum, int sr, int nr)
 {
@@ -706,58 +1077,67 @@ void writeIBIS(int unit, char *buf, char *format, int colNum, int sr, int nr)
 }
 
 /*=========================================================*/
-void getSolfout(LsqIbis *ibis, double *buf, int isol)
+/* The get*fout functions fill buf with the n output rows  */
+/* made from input row row on, skipping thrown out rows    */
+/* unless includeThrowout is set, and return the input row */
+/* after the last one used.                                */
+/*=========================================================*/
+int getSolfout(LsqIbis *ibis, double *buf, int isol, int row, int n, int includeThrowout)
 {
-   int i, control, iy, bufind;
+   int control, iy, bufind;
 
    iy = isol/(ibis->xcnt);
    isol %= (ibis->xcnt);
 
-   bufind = 0;
-   for(i = 0; i < ibis->ibisfile->nr; i++)
-      if(!((ibis->throwout)[i]))
+   for(bufind = 0; bufind < n; row++)
+      if(includeThrowout || !((ibis->throwout)[row]))
       {
-         control = (ibis->IBIS2control)[i][0];
+         control = (ibis->IBIS2control)[row][0];
          buf[bufind++] = (ibis->controlSol)[control][iy][isol];
       }
 
-   assert(bufind == getOutfileNRecs(ibis, 0));
+   return row;
 }
 
 /*=========================================================*/
-void getResfout(LsqIbis *ibis, double *buf, int ires)
+int getResfout(LsqIbis *ibis, double *buf, int ires, int row, int n, int includeThrowout)
 {
-   int i, bufind;
+   int bufind;
 
-   bufind = 0;
-   for(i = 0; i < ibis->ibisfile->nr; i++)
-      if(!((ibis->throwout)[i]))
-         buf[bufind++] = (ibis->res)[ires][i];
+   for(bufind = 0; bufind < n; row++)
+      if(includeThrowout || !((ibis->throwout)[row]))
+         buf[bufind++] = (ibis->res)[ires][row];
 
-   assert(bufind == getOutfileNRecs(ibis, 0));
+   return row;
 }
 
 /*=========================================================*/
-void getColfout(LsqIbis *ibis, char *buf, int col)
+int getColfout(LsqIbis *ibis, char *buf, int col, int row, int n, int includeThrowout)
 {
-   int i, bufind, colLen;
+   int bufind, colLen;
    IBISStruct *ibisfile;
 
-   bufind = 0;
    ibisfile = ibis->ibisfile;
    colLen = (ibisfile->colLens)[col];
-   for(i = 0; i < ibisfile->nr; i++)
-      if(!(ibis->throwout[i]))
+   for(bufind = 0; bufind < n; row++)
+      if(includeThrowout || !(ibis->throwout[row]))
       {
-         memcpy(buf+bufind, IBISHELPER_getBufPtr(ibisfile, col, i), colLen);
-         bufind += colLen;
+         memcpy(buf+bufind*colLen, IBISHELPER_getBufPtr(ibisfile, col, row), colLen);
+         bufind++;
       }
+
+   return row;
 }
 
+/*=========================================================*/
+/* Writes every input row if includeThrowout is set, else  */
+/* only the rows not thrown out.  Each column is written   */
+/* IBISHELPER_CHUNK_ROWS rows at a time, so the buffer     */
+/* does not grow with the file.                            */
 /*=========================================================*/
 void LSQIBIS_writeToIBIS(LsqIbis *ibis, int includeThrowout)
 {
-   int i, nRecs;
+   int i, nRecs, chunkRows;
    int unit, handle, status, maxColLen;
    IBISStruct *ibisfile;
    double *buf;
@@ -770,38 +1150,47 @@ void LSQIBIS_writeToIBIS(LsqIbis *ibis, int includeThrowout)
    status = IBISFileOpen(unit, &handle, "write", ibisfile->nc, nRecs, (char*) ibisfile->formats, NULL);
    if(status!=1) IBISSignalU(handle, status, 1);
 
-   maxColLen = IBISHELPER_getMaxColLen(ibisfile);
+   chunkRows = IBISHELPER_CHUNK_ROWS;
+   if(chunkRows > nRecs) chunkRows = nRecs;
+   maxColLen = (ibisfile->colLens)[IBISHELPER_getMaxColLen(ibisfile)];
    if(maxColLen < sizeof(double)) maxColLen = sizeof(double);
-   buf = (double*)malloc(maxColLen*ibisfile->nr);
+   buf = (double*)malloc(maxColLen*(chunkRows > 0 ? chunkRows : 1));
    for(i = 0; i < ibisfile->nc; i++)
    {
-      int j, found;
+      int j, isol, ires, sr, n, row;
 
-      found = 0;
+      isol = ires = -1;
       for(j = 0; j < ibis->solcnt; j++)
          if(i + 1 == (ibis->solcols)[j])
          {
-            getSolfout(ibis, buf, j);
-            found = 1;
+            isol = j;
             break;
          }
-      for(j = 0; !found && j < ibis->rescnt; j++)
+      for(j = 0; isol < 0 && j < ibis->rescnt; j++)
          if(i + 1 == (ibis->rescols)[j])
          {
-            getResfout(ibis, buf, j);
-            found = 1;
+            ires = j;
             break;
          }
 
-      if(found)
+      row = 0;
+      for(sr = 0; sr < nRecs; sr += n)
       {
-         writeIBIS(handle, (char*)buf, "DOUB", i+1, 1, nRecs);
-         continue;
-      }
+         n = nRecs - sr;
+         if(n > chunkRows) n = chunkRows;
+
+         if(isol >= 0 || ires >= 0)
+         {
+            if(isol >= 0) row = getSolfout(ibis, buf, isol, row, n, includeThrowout);
+            else row = getResfout(ibis, buf, ires, row, n, includeThrowout);
+            writeIBIS(handle, (char*)buf, "DOUB", i+1, sr+1, n);
+            continue;
+         }
 
-      getColfout(ibis, (char*)buf, i);
-      status = IBISColumnWrite(handle, (char*)buf, i+1, 1, nRecs);
-      assert(status == 1);
+         row = getColfout(ibis, (char*)buf, i, row, n, includeThrowout);
+         status = IBISColumnWrite(handle, (char*)buf, i+1, sr+1, n);
+         assert(status == 1);
+      }
    }
 
    free(buf);
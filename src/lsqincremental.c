@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#include "carto/lsqincremental.h"
+
+/*=========================================================*/
+LsqIncremental* LSQINCREMENTAL_get(int xcnt, int ycnt)
+{
+   LsqIncremental *inc;
+
+   assert(xcnt > 0 && ycnt > 0);
+
+   inc = (LsqIncremental*)malloc(sizeof(LsqIncremental));
+   inc->xcnt = xcnt;
+   inc->ycnt = ycnt;
+   inc->n = xcnt + ycnt;
+   inc->nRecs = 0;
+   inc->r = (double*)calloc(inc->n*inc->n, sizeof(double));
+   inc->work = (double*)calloc(2*inc->n, sizeof(double));
+
+   return inc;
+}
+
+/*=========================================================*/
+void LSQINCREMENTAL_delete(LsqIncremental *inc)
+{
+   free(inc->r);
+   free(inc->work);
+   free(inc);
+}
+
+/*=========================================================*/
+/* v = sqrt(w) [x y]                                       */
+/*=========================================================*/
+void setIncrementalRow(LsqIncremental *inc, double *v, double *x, double *y, double w)
+{
+   int j;
+   double sw;
+
+   sw = sqrt(w);
+   for(j = 0; j < inc->xcnt; j++) v[j] = sw*x[j];
+   for(j = 0; j < inc->ycnt; j++) v[inc->xcnt+j] = sw*y[j];
+}
+
+/*=========================================================*/
+/* Givens rotations fold the row into r, keeping its       */
+/* diagonal non-negative.                                  */
+/*=========================================================*/
+void LSQINCREMENTAL_addRow(LsqIncremental *inc, double *x, double *y, double w)
+{
+   int j, k, n;
+   double *r, *v, c, s, t, rk;
+
+   n = inc->n;
+   r = inc->r;
+   v = inc->work;
+   setIncrementalRow(inc, v, x, y, w);
+
+   for(k = 0; k < n; k++)
+   {
+      if(v[k] == 0.0) continue;
+
+      t = hypot(r[k*n+k], v[k]);
+      c = r[k*n+k]/t;
+      s = v[k]/t;
+      r[k*n+k] = t;
+      for(j = k+1; j < n; j++)
+      {
+         rk = r[k*n+j];
+         r[k*n+j] = c*rk + s*v[j];
+         v[j] = c*v[j] - s*rk;
+      }
+   }
+
+   ++(inc->nRecs);
+}
+
+/*=========================================================*/
+/* The LINPACK dchdd downdate: solve r'a = v, then undo    */
+/* the row with the rotations that take (sqrt(1-|a|^2), a) */
+/* to (1, 0).                                              */
+/*=========================================================*/
+int LSQINCREMENTAL_removeRow(LsqIncremental *inc, double *x, double *y, double w)
+{
+   int i, j, n;
+   double *r, *a, *c, norm, alpha, scale, p, q, t, xx;
+
+   n = inc->n;
+   r = inc->r;
+   a = inc->work;
+   c = inc->work + n;
+   setIncrementalRow(inc, a, x, y, w);
+
+   norm = 0.0;
+   for(i = 0; i < n; i++)
+   {
+      t = a[i];
+      for(j = 0; j < i; j++) t -= r[j*n+i]*a[j];
+
+      if(r[i*n+i] == 0.0)
+      {
+         if(t != 0.0) return 1;
+         a[i] = 0.0;
+         continue;
+      }
+
+      a[i] = t/r[i*n+i];
+      norm += a[i]*a[i];
+   }
+   if(norm >= 1.0) return 1;
+
+   alpha = sqrt(1.0 - norm);
+   for(i = n-1; i >= 0; i--)
+   {
+      scale = alpha + fabs(a[i]);
+      p = alpha/scale;
+      q = a[i]/scale;
+      t = sqrt(p*p + q*q);
+      c[i] = p/t;
+      a[i] = q/t;
+      alpha = scale*t;
+   }
+
+   for(j = 0; j < n; j++)
+   {
+      xx = 0.0;
+      for(i = j; i >= 0; i--)
+      {
+         t = c[i]*xx + a[i]*r[i*n+j];
+         r[i*n+j] = c[i]*r[i*n+j] - a[i]*xx;
+         xx = t;
+      }
+   }
+
+   --(inc->nRecs);
+
+   return 0;
+}
+
+/*=========================================================*/
+int LSQINCREMENTAL_reweightRow(LsqIncremental *inc, double *x, double *y, double wOld, double wNew)
+{
+   if(wNew > wOld)
+   {
+      LSQINCREMENTAL_addRow(inc, x, y, wNew - wOld);
+      --(inc->nRecs);
+   }
+   else if(wNew < wOld)
+   {
+      if(LSQINCREMENTAL_removeRow(inc, x, y, wOld - wNew)) return 1;
+      ++(inc->nRecs);
+   }
+
+   return 0;
+}
+
+/*=========================================================*/
+int LSQINCREMENTAL_solve(LsqIncremental *inc, int iy, double eps, double *sol, double *chisq)
+{
+   int i, j, n, xcnt, col;
+   double *r, max, t;
+
+   assert(iy >= 0 && iy < inc->ycnt);
+
+   n = inc->n;
+   xcnt = inc->xcnt;
+   r = inc->r;
+   col = xcnt + iy;
+
+   if(chisq)
+   {
+      *chisq = 0.0;
+      for(i = xcnt; i <= col; i++) *chisq += r[i*n+col]*r[i*n+col];
+   }
+
+   max = 0.0;
+   for(i = 0; i < xcnt; i++)
+      if(fabs(r[i*n+i]) > max) max = fabs(r[i*n+i]);
+   if(max == 0.0) return 1;
+
+   for(i = xcnt-1; i >= 0; i--)
+   {
+      if(fabs(r[i*n+i]) <= eps*max) return 1;
+
+      t = r[i*n+col];
+      for(j = i+1; j < xcnt; j++) t -= r[i*n+j]*sol[j];
+      sol[i] = t/r[i*n+i];
+   }
+
+   return 0;
+}
@@ -6,11 +6,13 @@
 /*   2002/05/21 (MCB) Found and fixed a bug in mat33_transpose. */
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "carto/burl.h"
 #include "carto/mat33.h"
 
 #define EPS 1e-12
+#define MAT33_BLOCK 64
 
 int mat33_mat33_mult(double *A, double *B, double *C) {
 
@@ -303,3 +305,37 @@ int vec31_vec31_basis(double *A, double *B, double *C) {
 
   return(OK);
 }
+
+/* Multiply n vectors by the same matrix: B_i = A V_i. V and B are planar, */
+/*   with component k of vector i at V[k*n+i]; B may be the same array as V. */
+/*   Results go through a local buffer MAT33_BLOCK vectors at a time so the */
+/*   loop vectorizes without aliasing checks. */
+int mat33_vec31_mult_n(double *A, int n, double *V, double *B) {
+  int    i, i0, m, k;
+  double v0, v1, v2;
+  double *V0, *V1, *V2;
+  double Bb[3][MAT33_BLOCK];
+  double a0 = A[0], a1 = A[1], a2 = A[2];
+  double a3 = A[3], a4 = A[4], a5 = A[5];
+  double a6 = A[6], a7 = A[7], a8 = A[8];
+
+  for (i0 = 0; i0 < n; i0 += MAT33_BLOCK) {
+    m = MIN(n - i0, MAT33_BLOCK);
+    V0 = V + i0;
+    V1 = V + n + i0;
+    V2 = V + 2*n + i0;
+    for (i = 0; i < m; i++) {
+      v0 = V0[i];
+      v1 = V1[i];
+      v2 = V2[i];
+      Bb[0][i] = a0*v0 + a1*v1 + a2*v2;
+      Bb[1][i] = a3*v0 + a4*v1 + a5*v2;
+      Bb[2][i] = a6*v0 + a7*v1 + a8*v2;
+    }
+    for (k = 0; k < 3; k++) {
+      memcpy(B + k*n + i0, Bb[k], m*sizeof(double));
+    }
+  }
+
+  return(OK);
+}
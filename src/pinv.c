@@ -1,30 +1,50 @@
 /*******************************************************************************
 
   Title:    pinv
-  Author:   Mike Burl 
+  Author:   Mike Burl
   Function: Compute psuedoinverse of a matrix M.
             Allocate A as (mc x mr) (dimensions equal to M')
 
             M = USV'
             A = V * pinv(S) * U';
 
+  Notes:    The SVD comes from LAPACK dgesdd when the library is built
+              with HAVE_LAPACK (configure --with-lapack), and from csvd
+              otherwise. For tall matrices (mr >= PINV_QR_RATIO * mc) the
+              csvd path first reduces M = QR with Householder QR and takes
+              the SVD of the small (mc x mc) R, so that the O(mr mc^2)
+              work is done by the cheap factorization rather than by
+              csvd. The singular value threshold is the same in all
+              cases, so the results agree to rounding.
+
 *******************************************************************************/
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "carto/pinv.h"
 #include "carto/csvd.h"
+#include "carto/householder_qr.h"
 #include "carto/qmalloc.h"
 #include "carto/burl.h"
 
 #define  EPS  1e-08;
+#define  PINV_QR_RATIO 2
+
+#ifdef HAVE_LAPACK
+extern void dgesdd_(char *jobz, int *m, int *n, double *a, int *lda, double *s, double *u, int *ldu,
+                    double *vt, int *ldvt, double *work, int *lwork, int *iwork, int *info);
+static int pinv_svd_lapack(int mr, int mc, double *M, double *U, double *S, double *V);
+#endif
+static int pinv_assemble(int ar, int ac, int sr, double *U, double *S, double *V, double thr, double *A);
 
 int pinv(int mr, int mc, double *M, double *A)
 {
-  int    i, j, k, ind;
+  int    i, j;
   int    ur, uc, sr, vr, vc, ar, ac;
+  int    use_qr;
   double *U, *S, *V;
+  double *QR, *tau, *R, *B, *X;
   double Mnorm, thr;
-  double s;
   char   infunc[] = "pinv";
 
   ur = mr;
@@ -33,29 +53,195 @@ int pinv(int mr, int mc, double *M, double *A)
   vr = mc;
   vc = mc;
   mc = mc;
-
-  U = (double *) qmalloc(ur*uc, sizeof(double), 0, infunc, "U");
-  S = (double *) qmalloc(sr, sizeof(double), 0, infunc, "S");
-  V = (double *) qmalloc(vr*vc, sizeof(double), 0, infunc, "V");
-  csvd(M, mr, mc, U, S, V);
-  Mnorm = S[0];  /* Maximum singular value */
-  thr = Mnorm * MAX(mr, mc) * EPS;
-
   ar = mc;
   ac = mr;
+
+#ifdef HAVE_LAPACK
+  use_qr = 0;
+#else
+  use_qr = (mr >= PINV_QR_RATIO * mc);
+#endif
+
+  if (use_qr == 0) {
+    U = (double *) qmalloc(ur*uc, sizeof(double), 0, infunc, "U");
+    S = (double *) qmalloc(sr, sizeof(double), 0, infunc, "S");
+    V = (double *) qmalloc(vr*vc, sizeof(double), 0, infunc, "V");
+#ifdef HAVE_LAPACK
+    if (pinv_svd_lapack(mr, mc, M, U, S, V) == ERR) {
+      csvd(M, mr, mc, U, S, V);
+    }
+#else
+    csvd(M, mr, mc, U, S, V);
+#endif
+    Mnorm = S[0];  /* Maximum singular value */
+    thr = Mnorm * MAX(mr, mc) * EPS;
+
+    pinv_assemble(ar, ac, sr, U, S, V, thr, A);
+  }
+  else {
+    /* M = Q R, R = U_R S V', so pinv(M) = V pinv(S) U_R' Q' */
+    QR  = (double *) qmalloc(mr*mc, sizeof(double), 0, infunc, "QR");
+    tau = (double *) qmalloc(mc, sizeof(double), 0, infunc, "tau");
+    R   = (double *) qmalloc(mc*mc, sizeof(double), 0, infunc, "R");
+    householder_qr(mr, mc, M, QR, tau);
+    householder_qr_r_copy(mr, mc, QR, R);
+
+    U = (double *) qmalloc(mc*mc, sizeof(double), 0, infunc, "U");
+    S = (double *) qmalloc(mc, sizeof(double), 0, infunc, "S");
+    V = (double *) qmalloc(mc*mc, sizeof(double), 0, infunc, "V");
+    csvd(R, mc, mc, U, S, V);
+    Mnorm = S[0];  /* Maximum singular value (same as for M) */
+    thr = Mnorm * MAX(mr, mc) * EPS;
+
+    /* B = V pinv(S) U_R' is (mc x mc) */
+    B = (double *) qmalloc(mc*mc, sizeof(double), 0, infunc, "B");
+    pinv_assemble(mc, mc, mc, U, S, V, thr, B);
+
+    /* A' = Q [B'; 0]; the columns of X are the columns of A' */
+    X = (double *) qmalloc(mr*mc, sizeof(double), 1, infunc, "X");
+    for (j = 0; j < mc; j++) {
+      for (i = 0; i < mc; i++) {
+        X[j*mr+i] = B[j*mc+i];
+      }
+    }
+    householder_qr_apply_q(mr, mc, QR, tau, mc, X);
+    for (i = 0; i < ar*ac; i++) {
+      A[i] = X[i];
+    }
+
+    free((void *) QR);
+    free((void *) tau);
+    free((void *) R);
+    free((void *) B);
+    free((void *) X);
+  }
+
+  free((void *) U);
+  free((void *) S);
+  free((void *) V);
+
+  return(OK);
+}
+
+/*****************/
+/* PINV_ASSEMBLE */
+/*****************/
+/* A = V * pinv(S) * U', with V (ar x ar, first sr columns used) and U */
+/*   (ac x sr) laid out as csvd returns them. Singular values at or below */
+/*   thr are dropped. The kept columns of V are scaled once and U is */
+/*   transposed so that the inner loop runs with unit stride. */
+
+static int pinv_assemble(int ar, int ac, int sr, double *U, double *S, double *V, double thr, double *A)
+{
+  int    i, j, k, nk;
+  int    *keep;
+  double *Ut, *W;
+  double w, *a, *u;
+  char   infunc[] = "pinv_assemble";
+
+  keep = (int *) qmalloc(MAX(sr, 1), sizeof(int), 0, infunc, "keep");
+  nk = 0;
+  for (k = 0; k < sr; k++) {
+    if (S[k] > thr) {
+      keep[nk++] = k;
+    }
+  }
+
+  Ut = (double *) qmalloc(MAX(nk*ac, 1), sizeof(double), 0, infunc, "Ut");
+  W  = (double *) qmalloc(MAX(ar*nk, 1), sizeof(double), 0, infunc, "W");
+  for (k = 0; k < nk; k++) {
+    for (j = 0; j < ac; j++) {
+      Ut[k*ac+j] = U[j*sr+keep[k]];
+    }
+    for (i = 0; i < ar; i++) {
+      W[i*nk+k] = V[i*ar+keep[k]] / S[keep[k]];
+    }
+  }
+
   for (i = 0; i < ar; i++) {
+    a = A + i*ac;
     for (j = 0; j < ac; j++) {
-      ind = i*ac+j;
-      A[ind] = D_ZERO;
-      for (k = 0; k < sr; k++) {
-        s = S[k];
-        if (s > thr) {
-          A[ind] += V[i*vc+k] * 1/s * U[j*uc+k];
-	} 
+      a[j] = D_ZERO;
+    }
+    for (k = 0; k < nk; k++) {
+      w = W[i*nk+k];
+      u = Ut + k*ac;
+      for (j = 0; j < ac; j++) {
+        a[j] += w * u[j];
       }
     }
   }
 
+  free((void *) keep);
+  free((void *) Ut);
+  free((void *) W);
+
   return(OK);
 }
 
+#ifdef HAVE_LAPACK
+/*******************/
+/* PINV_SVD_LAPACK */
+/*******************/
+/* Thin SVD of M with LAPACK dgesdd, returning U (mr x sr), S (sr) and V */
+/*   (mc x mc, first sr columns filled) laid out as csvd returns them. */
+/*   LAPACK is column-major, so it is handed M' (which is M read column- */
+/*   major) and the roles of its U and V' are swapped on the way out. */
+
+static int pinv_svd_lapack(int mr, int mc, double *M, double *U, double *S, double *V)
+{
+  int    i, j, sr;
+  int    m, n, lda, ldu, ldvt, lwork, info;
+  int    *iwork;
+  double *a, *u, *vt, *work;
+  double wsize;
+  char   jobz = 'S';
+  char   infunc[] = "pinv_svd_lapack";
+
+  sr = MIN(mr, mc);
+  m = mc;     /* M' is (mc x mr) */
+  n = mr;
+  lda = m;
+  ldu = m;
+  ldvt = sr;
+
+  a  = (double *) qmalloc(mr*mc, sizeof(double), 0, infunc, "a");
+  u  = (double *) qmalloc(m*sr, sizeof(double), 0, infunc, "u");
+  vt = (double *) qmalloc(sr*n, sizeof(double), 0, infunc, "vt");
+  iwork = (int *) qmalloc(8*sr, sizeof(int), 0, infunc, "iwork");
+  for (i = 0; i < mr*mc; i++) {
+    a[i] = M[i];
+  }
+
+  lwork = -1;
+  dgesdd_(&jobz, &m, &n, a, &lda, S, u, &ldu, vt, &ldvt, &wsize, &lwork, iwork, &info);
+  lwork = (int) wsize;
+  work = (double *) qmalloc(MAX(lwork, 1), sizeof(double), 0, infunc, "work");
+  dgesdd_(&jobz, &m, &n, a, &lda, S, u, &ldu, vt, &ldvt, work, &lwork, iwork, &info);
+
+  if (info == 0) {
+    /* M' = u S vt  =>  M = vt' S u', so U = vt' and V = u */
+    for (i = 0; i < mr; i++) {
+      for (j = 0; j < sr; j++) {
+        U[i*sr+j] = vt[i*sr+j];
+      }
+    }
+    for (i = 0; i < mc; i++) {
+      for (j = 0; j < mc; j++) {
+        V[i*mc+j] = (j < sr) ? u[j*m+i] : D_ZERO;
+      }
+    }
+  }
+  else {
+    fprintf(stderr, "WARNING (%s): dgesdd failed with info = %d, using csvd\n", infunc, info);
+  }
+
+  free((void *) a);
+  free((void *) u);
+  free((void *) vt);
+  free((void *) iwork);
+  free((void *) work);
+
+  return((info == 0) ? OK : ERR);
+}
+#endif
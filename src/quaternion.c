@@ -25,6 +25,7 @@
 #include "carto/safe_sqrt.h"
 
 #define QUATERNION_EPS 1e-12
+#define QUATERNION_BLOCK 64
 
 /****************************/
 /* RODRIGUES_TO_QUATERNION  */
@@ -175,3 +176,100 @@ int mat_to_quaternion(double *R, double *q)
   }
   return(OK);
 }
+
+/************************/
+/* QUATERNION_TO_MAT_N  */
+/************************/
+/* Batched quaternion_to_mat for n quaternions. Arrays are planar: component */
+/*   k of item i is Q[k*n+i] (k = 0..3) and R[k*n+i] (k = 0..8). Results are */
+/*   formed QUATERNION_BLOCK items at a time in a local buffer, which lets */
+/*   the compiler vectorize the loop without aliasing checks; R may be the */
+/*   same array as Q if it has room for the result. */
+
+int quaternion_to_mat_n(int n, double *Q, double *R)
+
+{
+  int        i, i0, m, k;
+  double     a, b, c, d;
+  double     *Qa, *Qb, *Qc, *Qd;
+  double     Rb[9][QUATERNION_BLOCK];
+  /*  char       infunc[] = "quaternion_to_mat_n"; */
+
+  for (i0 = 0; i0 < n; i0 += QUATERNION_BLOCK) {
+    m = MIN(n - i0, QUATERNION_BLOCK);
+    Qa = Q + i0;
+    Qb = Q + n + i0;
+    Qc = Q + 2*n + i0;
+    Qd = Q + 3*n + i0;
+    for (i = 0; i < m; i++) {
+      a = Qa[i];
+      b = Qb[i];
+      c = Qc[i];
+      d = Qd[i];
+      Rb[0][i] = a*a + b*b - c*c - d*d;
+      Rb[1][i] = D_TWO * (-a*d + b*c);
+      Rb[2][i] = D_TWO * (a*c + b*d);
+      Rb[3][i] = D_TWO * (a*d + b*c);
+      Rb[4][i] = a*a - b*b + c*c - d*d;
+      Rb[5][i] = D_TWO * (-a*b + c*d);
+      Rb[6][i] = D_TWO * (-a*c + b*d);
+      Rb[7][i] = D_TWO * (a*b + c*d);
+      Rb[8][i] = a*a - b*b - c*c + d*d;
+    }
+    for (k = 0; k < 9; k++) {
+      memcpy(R + k*n + i0, Rb[k], m*sizeof(double));
+    }
+  }
+
+  return(OK);
+}
+
+/************************/
+/* MAT_TO_QUATERNION_N  */
+/************************/
+/* Batched mat_to_quaternion, with the planar layout and blocking of */
+/*   quaternion_to_mat_n. Negative radicands are clamped to zero without a */
+/*   warning. */
+
+int mat_to_quaternion_n(int n, double *R, double *Q)
+{
+  int        i, i0, m, k;
+  double     r0, r1, r2, r3, r4, r5, r6, r7, r8;
+  double     q0, q1, q2, q3, qm, f;
+  double     e0, e1, e2, e3;
+  double     Qb[4][QUATERNION_BLOCK];
+  /*  char       infunc[] = "mat_to_quaternion_n"; */
+
+  for (i0 = 0; i0 < n; i0 += QUATERNION_BLOCK) {
+    m = MIN(n - i0, QUATERNION_BLOCK);
+    for (i = 0; i < m; i++) {
+      r0 = R[i0+i]; r1 = R[n+i0+i]; r2 = R[2*n+i0+i];
+      r3 = R[3*n+i0+i]; r4 = R[4*n+i0+i]; r5 = R[5*n+i0+i];
+      r6 = R[6*n+i0+i]; r7 = R[7*n+i0+i]; r8 = R[8*n+i0+i];
+
+      q0 = sqrt(MAX(1 + r0 + r4 + r8, D_ZERO))/D_TWO;
+      q1 = sqrt(MAX(1 + r0 - r4 - r8, D_ZERO))/D_TWO;
+      q2 = sqrt(MAX(1 - r0 + r4 - r8, D_ZERO))/D_TWO;
+      q3 = sqrt(MAX(1 - r0 - r4 + r8, D_ZERO))/D_TWO;
+
+      /* Pick the largest as mat_to_quaternion does (first one on ties), */
+      /*   as 0/1 weights so that the loop has no control flow */
+      qm = MAX(MAX(q0, q1), MAX(q2, q3));
+      e0 = (q0 >= qm) ? D_ONE : D_ZERO;
+      e1 = (q1 >= qm) ? (D_ONE - e0) : D_ZERO;
+      e2 = (q2 >= qm) ? (D_ONE - e0 - e1) : D_ZERO;
+      e3 = D_ONE - e0 - e1 - e2;
+      f = D_ONE/(((double) 4.0) * qm);
+
+      Qb[0][i] = e0*q0 + (e1*(r7-r5) + e2*(r2-r6) + e3*(r3-r1))*f;
+      Qb[1][i] = e1*q1 + (e0*(r7-r5) + e2*(r1+r3) + e3*(r2+r6))*f;
+      Qb[2][i] = e2*q2 + (e0*(r2-r6) + e1*(r1+r3) + e3*(r5+r7))*f;
+      Qb[3][i] = e3*q3 + (e0*(r3-r1) + e1*(r2+r6) + e2*(r5+r7))*f;
+    }
+    for (k = 0; k < 4; k++) {
+      memcpy(Q + k*n + i0, Qb[k], m*sizeof(double));
+    }
+  }
+
+  return(OK);
+}
@@ -0,0 +1,519 @@
+/*******************************************************************************
+
+  Title:    ransac
+  Function: Robust model fitting by random sampling. Hypotheses are fit to
+              minimal samples, scored against all of the points, and the
+              best one is refined by least squares on its consensus set.
+
+  Notes:    Hypotheses are numbered, and hypothesis k always draws the same
+              sample for a given seed, so the work can be shared among
+              threads. Each thread takes the next number until the number
+              of hypotheses needed for the requested confidence (which
+              shrinks as better models are found) is reached. Ties go to
+              the lower number. With more than one thread a few hypotheses
+              past the serial stopping point may be scored, so the result
+              can differ from a serial run, but never has a higher cost.
+
+            Scoring is either the inlier count (RANSAC) or the MSAC cost,
+              where each point adds its squared residual, truncated at the
+              threshold. Scoring a hypothesis stops as soon as its cost
+              passes that of the best model so far.
+
+            ransac_affine_projection, ransac_lsqfit and ransac_wpp_camera
+              plug estimate_affine_projection, lsqfit and recover_wpp_camera
+              into the engine.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "carto/ransac.h"
+#include "carto/burl.h"
+#include "carto/qmalloc.h"
+#include "carto/thread_manager.h"
+#include "carto/estimate_affine_projection.h"
+#include "carto/estimate_wpp_camera.h"
+#include "carto/cartoLsqUtils.h"
+
+#define RANSAC_DEGENERATE_EPS 1e-12
+#define RANSAC_LSQFIT_EPS     1e-14
+
+/**************************************/
+/* GLOBAL DECLARATIONS                */
+/**************************************/
+typedef struct {
+  RANSAC_PROBLEM   *prob;
+  RANSAC_PARAMS    *par;
+  pthread_mutex_t  lock;
+  int              next;        /* next hypothesis to draw          */
+  int              n_needed;    /* hypotheses needed for confidence */
+  int              best_k;
+  double           best_cost;
+  double           *best_model;
+} RANSAC_STATE;
+
+typedef struct {
+  RANSAC_STATE     *state;
+} RANSAC_WORKER;
+
+typedef struct {
+  double  *xyz;
+  double  *uv;
+} RANSAC_AFFINE_DATA;
+
+typedef struct {
+  int     m;
+  int     n;
+  double  *a;
+  double  *r;
+} RANSAC_LSQFIT_DATA;
+
+static void ransac_sample(RANSAC_PROBLEM *prob, unsigned int seed, int k, int *idx);
+static double ransac_cost(RANSAC_PROBLEM *prob, RANSAC_PARAMS *par, double *model,
+                          double bound, int *n_inlier_adr, char *inlier);
+static int ransac_needed(RANSAC_PROBLEM *prob, RANSAC_PARAMS *par, int n_inlier);
+static void *ransac_worker(void *arg);
+
+/**************************************/
+/* ransac_default_params              */
+/**************************************/
+/* The threshold has no sensible default and must be set by the caller. */
+
+void ransac_default_params(RANSAC_PARAMS *par)
+
+{
+  par->threshold = D_ONE;
+  par->confidence = 0.99;
+  par->max_iter = 10000;
+  par->msac = 1;
+  par->refine_iter = 10;
+  par->seed = 1;
+  par->nthreads = 0;
+
+  return;
+}
+
+/**************************************/
+/* ransac                             */
+/**************************************/
+/* model should be preallocated to be (prob->model_size)         */
+/* inlier should be preallocated to be (prob->n_points), or NULL */
+/* Returns OK, or ERR if no hypothesis could be fit.             */
+
+int ransac(RANSAC_PROBLEM *prob, RANSAC_PARAMS *par, double *model,
+           char *inlier, int *n_inlier_adr, int *n_iter_adr)
+
+{
+  int            i, t, nthreads, n_in, n_trial, same, status;
+  int            *idx;
+  char           *flag, *trial_flag;
+  double         cost, trial_cost;
+  double         *trial;
+  RANSAC_STATE   state;
+  RANSAC_WORKER  *workers;
+  char           infunc[] = "ransac";
+
+  if (n_inlier_adr != NULL) *n_inlier_adr = 0;
+  if (n_iter_adr != NULL) *n_iter_adr = 0;
+  if ((prob->sample_size < 1) || (prob->n_points < prob->sample_size)) {
+    return(ERR);
+  }
+
+  nthreads = par->nthreads;
+  if (nthreads <= 0) nthreads = get_thread_count();
+  nthreads = MAX(MIN(nthreads, par->max_iter), 1);
+
+  state.prob = prob;
+  state.par = par;
+  state.next = 0;
+  state.n_needed = par->max_iter;
+  state.best_k = -1;
+  state.best_cost = HUGE_VAL;
+  state.best_model = model;
+  pthread_mutex_init(&(state.lock), NULL);
+
+  workers = (RANSAC_WORKER *) qmalloc(nthreads, sizeof(RANSAC_WORKER), 0, infunc, "workers");
+  for (t = 0; t < nthreads; t++) {
+    workers[t].state = &state;
+  }
+  run_threads(nthreads, ransac_worker, (void *) workers, sizeof(RANSAC_WORKER));
+  free((void *) workers);
+  pthread_mutex_destroy(&(state.lock));
+
+  if (n_iter_adr != NULL) *n_iter_adr = MIN(state.next, par->max_iter);
+  if (state.best_k < 0) {
+    return(ERR);
+  }
+
+  /* Refine: refit to the consensus set while that lowers the cost */
+  idx = (int *) qmalloc(prob->n_points, sizeof(int), 0, infunc, "idx");
+  flag = (char *) qmalloc(prob->n_points, sizeof(char), 0, infunc, "flag");
+  trial_flag = (char *) qmalloc(prob->n_points, sizeof(char), 0, infunc, "trial_flag");
+  trial = (double *) qmalloc(prob->model_size, sizeof(double), 0, infunc, "trial");
+
+  cost = ransac_cost(prob, par, model, HUGE_VAL, &n_in, flag);
+  for (t = 0; t < par->refine_iter; t++) {
+    if (n_in < prob->sample_size) break;
+    for (i = 0, n_trial = 0; i < prob->n_points; i++) {
+      if (flag[i]) idx[n_trial++] = i;
+    }
+    if (prob->fit(prob->data, n_trial, idx, trial) != OK) break;
+
+    trial_cost = ransac_cost(prob, par, trial, HUGE_VAL, &n_trial, trial_flag);
+    if (trial_cost > cost) break;
+
+    same = (memcmp(flag, trial_flag, prob->n_points) == 0);
+    memcpy(model, trial, prob->model_size * sizeof(double));
+    memcpy(flag, trial_flag, prob->n_points);
+    cost = trial_cost;
+    n_in = n_trial;
+    if (same) break;
+  }
+
+  if (inlier != NULL) memcpy(inlier, flag, prob->n_points);
+  if (n_inlier_adr != NULL) *n_inlier_adr = n_in;
+  status = (n_in >= prob->sample_size) ? OK : ERR;
+
+  free((void *) idx);
+  free((void *) flag);
+  free((void *) trial_flag);
+  free((void *) trial);
+
+  return(status);
+}
+
+/**************************************/
+/* ransac_worker                      */
+/**************************************/
+
+static void *ransac_worker(void *arg)
+
+{
+  int            k, n_in, needed, done;
+  int            *idx;
+  double         bound, cost;
+  double         *model;
+  RANSAC_STATE   *state;
+  RANSAC_PROBLEM *prob;
+  char           infunc[] = "ransac_worker";
+
+  state = ((RANSAC_WORKER *) arg)->state;
+  prob = state->prob;
+
+  idx = (int *) qmalloc(prob->sample_size, sizeof(int), 0, infunc, "idx");
+  model = (double *) qmalloc(prob->model_size, sizeof(double), 0, infunc, "model");
+
+  while (1) {
+    pthread_mutex_lock(&(state->lock));
+    k = state->next;
+    done = (k >= state->n_needed);
+    if (!done) {
+      (state->next)++;
+    }
+    bound = state->best_cost;
+    pthread_mutex_unlock(&(state->lock));
+    if (done) break;
+
+    ransac_sample(prob, state->par->seed, k, idx);
+    if (prob->fit(prob->data, prob->sample_size, idx, model) != OK) continue;
+
+    cost = ransac_cost(prob, state->par, model, bound, &n_in, NULL);
+    if (cost > bound) continue;
+
+    needed = ransac_needed(prob, state->par, n_in);
+    pthread_mutex_lock(&(state->lock));
+    if ((cost < state->best_cost) ||
+        ((cost == state->best_cost) && (k < state->best_k))) {
+      state->best_cost = cost;
+      state->best_k = k;
+      memcpy(state->best_model, model, prob->model_size * sizeof(double));
+      state->n_needed = MIN(state->n_needed, needed);
+    }
+    pthread_mutex_unlock(&(state->lock));
+  }
+
+  free((void *) idx);
+  free((void *) model);
+
+  return(NULL);
+}
+
+/**************************************/
+/* ransac_sample                      */
+/**************************************/
+/* Draw sample_size distinct points for hypothesis k, using a */
+/*   splitmix64 stream seeded from (seed, k).                 */
+
+static void ransac_sample(RANSAC_PROBLEM *prob, unsigned int seed, int k, int *idx)
+
+{
+  int       i, j, dup;
+  uint64_t  s, z;
+
+  s = ((uint64_t) seed << 32) ^ (uint64_t) k;
+  for (i = 0; i < prob->sample_size; ) {
+    s += 0x9E3779B97F4A7C15ULL;
+    z = s;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+
+    idx[i] = (int) (z % (uint64_t) prob->n_points);
+    for (j = 0, dup = 0; j < i; j++) {
+      if (idx[j] == idx[i]) dup = 1;
+    }
+    if (!dup) i++;
+  }
+
+  return;
+}
+
+/**************************************/
+/* ransac_cost                        */
+/**************************************/
+/* Cost of model over all points, giving up (and returning a value */
+/*   above bound) once it passes bound. inlier may be NULL.        */
+
+static double ransac_cost(RANSAC_PROBLEM *prob, RANSAC_PARAMS *par, double *model,
+                          double bound, int *n_inlier_adr, char *inlier)
+
+{
+  int     i, n_in;
+  double  r2, cost;
+
+  cost = D_ZERO;
+  n_in = 0;
+  for (i = 0; i < prob->n_points; i++) {
+    r2 = prob->residual(prob->data, i, model);
+    if (r2 < par->threshold) {
+      n_in++;
+      if (par->msac) cost += r2;
+      if (inlier != NULL) inlier[i] = 1;
+    }
+    else {
+      cost += par->threshold;
+      if (inlier != NULL) inlier[i] = 0;
+    }
+    if (cost > bound) break;
+  }
+
+  *n_inlier_adr = n_in;
+  return(cost);
+}
+
+/**************************************/
+/* ransac_needed                      */
+/**************************************/
+/* Hypotheses needed to draw an all-inlier sample with probability */
+/*   par->confidence when n_inlier of the points are inliers.      */
+
+static int ransac_needed(RANSAC_PROBLEM *prob, RANSAC_PARAMS *par, int n_inlier)
+
+{
+  double  w, ws, n;
+
+  w = ((double) n_inlier) / ((double) prob->n_points);
+  ws = pow(w, (double) prob->sample_size);
+  if (ws >= D_ONE) return(1);
+  if ((ws <= D_ZERO) || (par->confidence <= D_ZERO)) return(par->max_iter);
+  if (par->confidence >= D_ONE) return(par->max_iter);
+
+  n = ceil(log(D_ONE - par->confidence) / log(D_ONE - ws));
+  if (n >= (double) par->max_iter) return(par->max_iter);
+
+  return(MAX((int) n, 1));
+}
+
+/**************************************/
+/* ransac_affine_fit                  */
+/**************************************/
+
+static int ransac_affine_fit(void *data, int n, int *idx, double *model)
+
+{
+  int                 i, j;
+  double              *xyz, *uv, *p0;
+  double              d[3][3], det, scale;
+  RANSAC_AFFINE_DATA  *ad;
+  char                infunc[] = "ransac_affine_fit";
+
+  ad = (RANSAC_AFFINE_DATA *) data;
+
+  /* A minimal sample must not be coplanar */
+  if (n == 4) {
+    p0 = ad->xyz + 3*idx[0];
+    scale = D_ZERO;
+    for (i = 0; i < 3; i++) {
+      for (j = 0; j < 3; j++) {
+        d[i][j] = ad->xyz[3*idx[i+1]+j] - p0[j];
+        scale = MAX(scale, ABS(d[i][j]));
+      }
+    }
+    det = d[0][0] * (d[1][1]*d[2][2] - d[1][2]*d[2][1])
+        - d[0][1] * (d[1][0]*d[2][2] - d[1][2]*d[2][0])
+        + d[0][2] * (d[1][0]*d[2][1] - d[1][1]*d[2][0]);
+    if (ABS(det) <= RANSAC_DEGENERATE_EPS * scale*scale*scale) return(ERR);
+  }
+
+  xyz = (double *) qmalloc(3*n, sizeof(double), 0, infunc, "xyz");
+  uv = (double *) qmalloc(2*n, sizeof(double), 0, infunc, "uv");
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < 3; j++) xyz[3*i+j] = ad->xyz[3*idx[i]+j];
+    for (j = 0; j < 2; j++) uv[2*i+j] = ad->uv[2*idx[i]+j];
+  }
+
+  estimate_affine_projection(n, xyz, uv, model);
+
+  free((void *) xyz);
+  free((void *) uv);
+
+  return(OK);
+}
+
+/**************************************/
+/* ransac_affine_residual             */
+/**************************************/
+
+static double ransac_affine_residual(void *data, int i, double *P)
+
+{
+  double              *p, *q, du, dv;
+  RANSAC_AFFINE_DATA  *ad;
+
+  ad = (RANSAC_AFFINE_DATA *) data;
+  p = ad->xyz + 3*i;
+  q = ad->uv + 2*i;
+  du = P[0]*p[0] + P[1]*p[1] + P[2]*p[2] + P[3] - q[0];
+  dv = P[4]*p[0] + P[5]*p[1] + P[6]*p[2] + P[7] - q[1];
+
+  return(du*du + dv*dv);
+}
+
+/**************************************/
+/* ransac_affine_projection           */
+/**************************************/
+/* xyz should be preallocated to be (n X 3)                     */
+/* uv  should be preallocated to be (n X 2)                     */
+/* P   should be preallocated to be (2 X 4)                     */
+/* The threshold is on the squared image distance of a point.   */
+
+int ransac_affine_projection(int n, double *xyz, double *uv, RANSAC_PARAMS *par,
+           double *P, char *inlier, int *n_inlier_adr)
+
+{
+  RANSAC_AFFINE_DATA  ad;
+  RANSAC_PROBLEM      prob;
+
+  ad.xyz = xyz;
+  ad.uv = uv;
+
+  prob.data = (void *) &ad;
+  prob.n_points = n;
+  prob.sample_size = 4;
+  prob.model_size = 8;
+  prob.fit = ransac_affine_fit;
+  prob.residual = ransac_affine_residual;
+
+  return(ransac(&prob, par, P, inlier, n_inlier_adr, NULL));
+}
+
+/**************************************/
+/* ransac_wpp_camera                  */
+/**************************************/
+/* As ransac_affine_projection, followed by recover_wpp_camera */
+/*   on the refined P (as in rpc_to_wpp).                      */
+
+int ransac_wpp_camera(int n, double *xyz, double *uv, RANSAC_PARAMS *par,
+           double *P, double *m_adr, double *q_adr, double *tau_adr,
+           double *theta_adr, double *phi_adr, double *psi_adr,
+           double *bu_adr, double *bv_adr, char *inlier, int *n_inlier_adr)
+
+{
+  if (ransac_affine_projection(n, xyz, uv, par, P, inlier, n_inlier_adr) != OK) {
+    return(ERR);
+  }
+
+  return(recover_wpp_camera(P, m_adr, q_adr, tau_adr, theta_adr, phi_adr,
+                            psi_adr, bu_adr, bv_adr));
+}
+
+/**************************************/
+/* ransac_lsqfit_fit                  */
+/**************************************/
+
+static int ransac_lsqfit_fit(void *data, int n, int *idx, double *model)
+
+{
+  int                 i, j, ierror;
+  double              *a, *r;
+  RANSAC_LSQFIT_DATA  *ld;
+  char                infunc[] = "ransac_lsqfit_fit";
+
+  ld = (RANSAC_LSQFIT_DATA *) data;
+
+  /* lsqfit wants a by column and destroys it */
+  a = (double *) qmalloc(n * ld->n, sizeof(double), 0, infunc, "a");
+  r = (double *) qmalloc(n, sizeof(double), 0, infunc, "r");
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < ld->n; j++) a[j*n+i] = ld->a[j*(ld->m)+idx[i]];
+    r[i] = ld->r[idx[i]];
+  }
+
+  lsqfit(a, r, n, ld->n, model, RANSAC_LSQFIT_EPS, &ierror);
+
+  free((void *) a);
+  free((void *) r);
+
+  return((ierror == 0) ? OK : ERR);
+}
+
+/**************************************/
+/* ransac_lsqfit_residual             */
+/**************************************/
+
+static double ransac_lsqfit_residual(void *data, int i, double *x)
+
+{
+  int                 j;
+  double              d;
+  RANSAC_LSQFIT_DATA  *ld;
+
+  ld = (RANSAC_LSQFIT_DATA *) data;
+  d = -(ld->r[i]);
+  for (j = 0; j < ld->n; j++) d += ld->a[j*(ld->m)+i] * x[j];
+
+  return(d*d);
+}
+
+/**************************************/
+/* ransac_lsqfit                      */
+/**************************************/
+/* Robust version of lsqfit for ax=r. a is m by n, stored by */
+/*   column as for lsqfit, and is not changed.               */
+/* x should be preallocated to be (n)                        */
+/* The threshold is on the squared residual of an equation.  */
+
+int ransac_lsqfit(int m, int n, double *a, double *r, RANSAC_PARAMS *par,
+           double *x, char *inlier, int *n_inlier_adr)
+
+{
+  RANSAC_LSQFIT_DATA  ld;
+  RANSAC_PROBLEM      prob;
+
+  ld.m = m;
+  ld.n = n;
+  ld.a = a;
+  ld.r = r;
+
+  prob.data = (void *) &ld;
+  prob.n_points = m;
+  prob.sample_size = n;
+  prob.model_size = n;
+  prob.fit = ransac_lsqfit_fit;
+  prob.residual = ransac_lsqfit_residual;
+
+  return(ransac(&prob, par, x, inlier, n_inlier_adr, NULL));
+}
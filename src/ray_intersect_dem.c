@@ -0,0 +1,529 @@
+/*******************************************************************************
+
+  Title:    ray_intersect_dem
+  Function: Functions to intersect a ray with terrain described by a height
+              raster (DEM) on a regular latitude/longitude grid.
+
+            The DEM posts are heights (in meters) above the WGS1984 ellipsoid.
+              Between posts the surface is bilinear. When the DEM is defined,
+              a max-height pyramid is built over it: level 0 holds, for every
+              cell of 2 X 2 posts, the highest of its four posts, and each
+              coarser level holds the max of 2 X 2 cells of the level below.
+              The top level is a single cell holding the max of the DEM.
+
+            A ray is marched from where it enters the ellipsoid dilated by the
+              DEM max to where it enters the ellipsoid dilated by the DEM min.
+              At each point the largest step that provably cannot cross the
+              terrain is taken, using the coarsest pyramid cell that the ray
+              is still above. Once the ray is below the max of its level 0
+              cell, it advances by its height above the bilinear surface over
+              the steepest rate at which that height can shrink (from the max
+              slope of the nearby cells), so no crossing is stepped over, and
+              the crossing is then refined by bisection. Empty space (sky, and
+              terrain well below the ray) is therefore skipped in a few large
+              steps.
+
+            Longitudes are taken within 180 degrees of the middle of the DEM,
+              so a DEM may cross the +/-180 meridian.
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "carto/burl.h"
+#include "carto/qmalloc.h"
+#include "carto/mat33.h"
+#include "carto/earth_coordinates.h"
+#include "carto/ray_intersect_dem.h"
+
+/****************************/
+/* GLOBAL DECLARATIONS      */
+/****************************/
+
+#define DEM_MAX_STEPS      10000000
+#define DEM_BISECTIONS     60
+#define DEM_TOLERANCE      1.0e-3   /* meters along the ray */
+#define DEM_SAFETY         0.999
+
+static int dem_build_pyramid(dem_struct *dem);
+static int dem_build_slopes(dem_struct *dem);
+static double dem_col(dem_struct *dem, double lon);
+static double dem_meters_per_col(dem_struct *dem, double row);
+static int dem_ellipsoid_roots(double *t, double *d, double a, double b, double *z1, double *z2);
+static double dem_step(dem_struct *dem, double row, double col, double h, double rate);
+static double dem_surface_step(dem_struct *dem, double row, double col, double f, double rate);
+
+/****************************/
+/* DEFINE_DEM               */
+/****************************/
+/* Describe a DEM of nr X nc posts. Post (i, j) is at latitude lat0 + i*dlat
+   and longitude lon0 + j*dlon (decimal degrees; dlat is typically negative
+   for a north-up raster) and has height h[i*nc+j]. The heights are not
+   copied, so h must remain valid until free_dem is called. The max-height
+   pyramid and the slope bounds are built here. */
+
+int define_dem(int nr, int nc, double lat0, double lon0, double dlat, double dlon, float *h, dem_struct **dem_adr)
+{
+  dem_struct  *dem;
+  char        infunc[] = "define_dem";
+
+  *dem_adr = NULL;
+  if ((nr < 2) || (nc < 2) || (dlat == D_ZERO) || (dlon == D_ZERO) || (h == NULL)) {
+    fprintf(stderr, "ERROR (%s): DEM must be at least 2 X 2 with nonzero post spacing\n", infunc);
+    return(ERR);
+  }
+
+  dem = (dem_struct *) qmalloc(1, sizeof(dem_struct), 1, infunc, "dem");
+  if (dem == NULL) {
+    return(ERR);
+  }
+  dem->nr = nr;
+  dem->nc = nc;
+  dem->lat0 = lat0;
+  dem->lon0 = lon0;
+  dem->dlat = dlat;
+  dem->dlon = dlon;
+  dem->h = h;
+  define_ellipsoid("WGS1984", &(dem->ellipsoid));
+
+  if ((dem_build_pyramid(dem) != OK) || (dem_build_slopes(dem) != OK)) {
+    free_dem(dem);
+    return(ERR);
+  }
+
+  *dem_adr = dem;
+  return(OK);
+}
+
+/****************************/
+/* FREE_DEM                 */
+/****************************/
+int free_dem(dem_struct *dem)
+{
+  int  L;
+
+  if (dem != NULL) {
+    if (dem->hmax != NULL) {
+      for (L = 0; L < dem->nlevels; L++) {
+        free((void *) dem->hmax[L]);
+      }
+      free((void *) dem->hmax);
+    }
+    free((void *) dem->lnr);
+    free((void *) dem->slope);
+    free_ellipsoid(dem->ellipsoid);
+    free((void *) dem);
+  }
+
+  return(OK);
+}
+
+/****************************/
+/* DEM_HEIGHT               */
+/****************************/
+/* Bilinearly interpolated DEM height at (lat, lon). Positions outside the
+   DEM take the height of the nearest edge. */
+
+double dem_height(dem_struct *dem, double lat, double lon)
+{
+  double  row, col, fr, fc;
+  int     i, j, nc;
+  float   *h;
+
+  row = CLIP((lat - dem->lat0)/dem->dlat, D_ZERO, (double) (dem->nr-1));
+  col = CLIP(dem_col(dem, lon), D_ZERO, (double) (dem->nc-1));
+  i = MIN((int) row, dem->nr-2);
+  j = MIN((int) col, dem->nc-2);
+  fr = row - i;
+  fc = col - j;
+
+  nc = dem->nc;
+  h = dem->h + i*nc + j;
+  return((D_ONE-fr)*((D_ONE-fc)*h[0]  + fc*h[1]) +
+         fr        *((D_ONE-fc)*h[nc] + fc*h[nc+1]));
+}
+
+/****************************/
+/* RAY_INTERSECT_DEM        */
+/****************************/
+/* Intersect the ray starting at ECEF point t with direction d (need not be
+   unit length) with the terrain. If an intersection is found, the ECEF point
+   is placed in p, its geodetic (lat, lon, height) in LLH (if LLH is not
+   NULL) and the return value is OK. Otherwise the return value is ERR. */
+
+int ray_intersect_dem(dem_struct *dem, double *t, double *d, double *p, double *LLH)
+{
+  double   u[3], pt[3], llh[3], up[3];
+  double   len, z, z_in, z_out, z1, z2, zlo, zhi, zm;
+  double   row, col, rate, step, f;
+  double   slat, clat, slon, clon;
+  int      n, k;
+
+  len = vec31_norm(d);
+  if (len <= D_ZERO) {
+    return(ERR);
+  }
+  vec31_scale(d, D_ONE/len, u);
+
+  /* The ray must reach the top of the terrain ... */
+  if (dem_ellipsoid_roots(t, u, dem->ellipsoid->a + dem->hmax_all, dem->ellipsoid->b + dem->hmax_all, &z1, &z2) != OK) {
+    return(ERR);
+  }
+  if (z2 < D_ZERO) {
+    return(ERR);
+  }
+  z_in = MAX(z1, D_ZERO);
+
+  /* ... and cannot get past the bottom of it */
+  if (dem_ellipsoid_roots(t, u, dem->ellipsoid->a + dem->hmin_all, dem->ellipsoid->b + dem->hmin_all, &z1, &z2) == OK &&
+      (z2 >= D_ZERO)) {
+    z_out = MAX(z1, D_ZERO);
+  }
+  else {
+    dem_ellipsoid_roots(t, u, dem->ellipsoid->a + dem->hmax_all, dem->ellipsoid->b + dem->hmax_all, &z1, &z2);
+    z_out = z2;
+  }
+
+  z = z_in;
+  zlo = -D_ONE;
+  for (n = 0; n < DEM_MAX_STEPS; n++) {
+    if (z > z_out) {
+      z = z_out;
+    }
+    vec31_axpy(z, u, t, pt);
+    geodetic_from_ecef_ellipsoid(dem->ellipsoid, llh, 1, pt);
+
+    f = llh[2] - dem_height(dem, llh[0], llh[1]);
+    if (f <= D_ZERO) {
+      break;
+    }
+    if (z >= z_out) {
+      /* Reached the bottom without touching the terrain (only possible */
+      /*   when the ray grazes the bottom ellipsoid) */
+      return(ERR);
+    }
+    zlo = z;
+
+    /* Local vertical, to tell how fast the ray is descending */
+    slat = sin(llh[0]*DEG2RAD);
+    clat = cos(llh[0]*DEG2RAD);
+    slon = sin(llh[1]*DEG2RAD);
+    clon = cos(llh[1]*DEG2RAD);
+    vec31_assign(up, clat*clon, clat*slon, slat);
+    rate = vec31_vec31_dot(u, up);
+    if ((rate >= D_ZERO) && (llh[2] > dem->hmax_all)) {
+      return(ERR); /* above everything and climbing */
+    }
+
+    row = (llh[0] - dem->lat0)/dem->dlat;
+    col = dem_col(dem, llh[1]);
+    step = MAX(dem_step(dem, row, col, llh[2], rate), dem_surface_step(dem, row, col, f, rate));
+    z += MAX(step, DEM_TOLERANCE);
+  }
+  if (n >= DEM_MAX_STEPS) {
+    return(ERR);
+  }
+
+  /* Refine the crossing bracketed by the last point above (zlo) and z */
+  if (zlo >= D_ZERO) {
+    zhi = z;
+    for (k = 0; (k < DEM_BISECTIONS) && (zhi - zlo > DEM_TOLERANCE); k++) {
+      zm = 0.5*(zlo + zhi);
+      vec31_axpy(zm, u, t, pt);
+      geodetic_from_ecef_ellipsoid(dem->ellipsoid, llh, 1, pt);
+      if (llh[2] - dem_height(dem, llh[0], llh[1]) > D_ZERO) {
+        zlo = zm;
+      }
+      else {
+        zhi = zm;
+      }
+    }
+    z = zhi;
+  }
+
+  vec31_axpy(z, u, t, p);
+  if (LLH != NULL) {
+    geodetic_from_ecef_ellipsoid(dem->ellipsoid, LLH, 1, p);
+  }
+
+  return(OK);
+}
+
+/****************************/
+/* DEM_STEP                 */
+/****************************/
+/* Largest distance the ray can advance from fractional post (row, col) at
+   height h, descending at rate (the cosine between the ray and the local
+   vertical), without being able to cross the terrain. Over all pyramid
+   levels whose cell max is below h, the ray can go until it either drops
+   to that max or leaves the cell horizontally; the best such step is
+   returned (0 if h is not above even the level 0 cell). */
+
+static double dem_step(dem_struct *dem, double row, double col, double h, double rate)
+{
+  double  best, sv, hs, r, rlo, rhi, clo, chi, span, mrow, mcol;
+  double  crow, ccol;
+  int     L, ci, cj, nr, nc;
+
+  /* Meters per post along rows and columns at this latitude */
+  mrow = fabs(dem->dlat) * DEG2RAD * dem->ellipsoid->b;
+  mcol = dem_meters_per_col(dem, row);
+  hs = sqrt(MAX(D_ONE - rate*rate, D_ZERO));
+
+  crow = CLIP(row, D_ZERO, (double) (dem->nr-1));
+  ccol = CLIP(col, D_ZERO, (double) (dem->nc-1));
+
+  best = D_ZERO;
+  for (L = dem->nlevels-1; L >= 0; L--) {
+    nr = dem->lnr[L];
+    nc = dem->lnc[L];
+    span = (double) (1 << L); /* posts per cell at this level */
+    ci = MIN((int) (crow/span), nr-1);
+    cj = MIN((int) (ccol/span), nc-1);
+    if (h <= dem->hmax[L][ci*nc+cj]) {
+      continue;
+    }
+
+    /* Vertical bound */
+    sv = (rate < D_ZERO) ? (h - dem->hmax[L][ci*nc+cj])/(-rate) : DBL_MAX;
+
+    /* Horizontal bound: distance to the nearest cell edge. Edge cells */
+    /*   extend outward, matching the clamping done by dem_height */
+    rlo = (ci == 0)    ? DBL_MAX : (row - ci*span) * mrow;
+    rhi = (ci == nr-1) ? DBL_MAX : ((ci+1)*span - row) * mrow;
+    clo = (cj == 0)    ? DBL_MAX : (col - cj*span) * mcol;
+    chi = (cj == nc-1) ? DBL_MAX : ((cj+1)*span - col) * mcol;
+    r = MIN(MIN(rlo, rhi), MIN(clo, chi));
+    if ((r < DBL_MAX) && (hs > D_ZERO)) {
+      r = DEM_SAFETY * r / hs;
+    }
+    else {
+      r = DBL_MAX;
+    }
+
+    best = MAX(best, MIN(sv, r));
+  }
+
+  return(best);
+}
+
+/****************************/
+/* DEM_SURFACE_STEP         */
+/****************************/
+/* Distance the ray can advance from fractional post (row, col), where it is
+   f meters above the surface, descending at rate, without being able to
+   cross the terrain. The height above the surface can shrink by at most
+   |rate| + (horizontal fraction of the ray) * slope per meter, with slope
+   the bound for the nearby cells; the step is kept to half a post of
+   horizontal travel so that the ray stays within those cells. */
+
+static double dem_surface_step(dem_struct *dem, double row, double col, double f, double rate)
+{
+  double  hs, s, rate_max, r;
+  int     i, j;
+
+  hs = sqrt(MAX(D_ONE - rate*rate, D_ZERO));
+  i = MIN((int) CLIP(row, D_ZERO, (double) (dem->nr-1)), dem->nr-2);
+  j = MIN((int) CLIP(col, D_ZERO, (double) (dem->nc-1)), dem->nc-2);
+  s = dem->slope[i*(dem->nc-1)+j];
+
+  rate_max = fabs(rate) + hs*s;
+  if (rate_max <= D_ZERO) {
+    return(DBL_MAX);
+  }
+
+  r = DBL_MAX;
+  if (hs > D_ZERO) {
+    r = 0.5 * MIN(fabs(dem->dlat) * DEG2RAD * dem->ellipsoid->b, dem_meters_per_col(dem, row)) / hs;
+  }
+
+  return(MIN(f/rate_max, r));
+}
+
+/****************************/
+/* DEM_COL                  */
+/****************************/
+/* Fractional column of longitude lon, taken within 180 degrees of the
+   middle of the DEM. */
+
+static double dem_col(dem_struct *dem, double lon)
+{
+  double  mid;
+
+  mid = dem->lon0 + 0.5*(dem->nc-1)*dem->dlon;
+  lon -= 360.0*floor((lon - mid + 180.0)/360.0);
+
+  return((lon - dem->lon0)/dem->dlon);
+}
+
+/****************************/
+/* DEM_METERS_PER_COL       */
+/****************************/
+/* Meters per post along a row at fractional row, never less than 1e-6 of
+   the meters per post along a column (so that it is nonzero at a pole). */
+
+static double dem_meters_per_col(dem_struct *dem, double row)
+{
+  double  mrow, mcol;
+
+  mrow = fabs(dem->dlat) * DEG2RAD * dem->ellipsoid->b;
+  mcol = fabs(dem->dlon) * DEG2RAD * dem->ellipsoid->a * fabs(cos((dem->lat0 + row*dem->dlat) * DEG2RAD));
+
+  return(MAX(mcol, 1.0e-6*mrow));
+}
+
+/****************************/
+/* DEM_BUILD_SLOPES         */
+/****************************/
+/* For each level 0 cell, a bound on the slope (meters of height per meter)
+   of the bilinear surface over the cell and its 8 neighbors. The gradient
+   of a bilinear cell is bounded by its largest post differences along rows
+   and columns, over the post spacing in meters at the cell's poleward
+   edge. */
+
+static int dem_build_slopes(dem_struct *dem)
+{
+  int     i, j, ii, jj, nr, nc;
+  float   *raw, *ph, v;
+  double  gr, gc, mrow, mcol;
+  char    infunc[] = "dem_build_slopes";
+
+  nr = dem->nr - 1;
+  nc = dem->nc - 1;
+  raw = (float *) qmalloc((size_t) nr*nc, sizeof(float), 0, infunc, "raw");
+  dem->slope = (float *) qmalloc((size_t) nr*nc, sizeof(float), 0, infunc, "slope");
+  if ((raw == NULL) || (dem->slope == NULL)) {
+    free((void *) raw);
+    return(ERR);
+  }
+
+  mrow = fabs(dem->dlat) * DEG2RAD * dem->ellipsoid->b;
+  for (i = 0; i < nr; i++) {
+    mcol = MIN(dem_meters_per_col(dem, (double) i), dem_meters_per_col(dem, (double) (i+1)));
+    for (j = 0; j < nc; j++) {
+      ph = dem->h + i*dem->nc + j;
+      gr = MAX(fabs(ph[dem->nc] - ph[0]), fabs(ph[dem->nc+1] - ph[1])) / mrow;
+      gc = MAX(fabs(ph[1] - ph[0]), fabs(ph[dem->nc+1] - ph[dem->nc])) / mcol;
+      raw[i*nc+j] = (float) sqrt(gr*gr + gc*gc);
+    }
+  }
+
+  for (i = 0; i < nr; i++) {
+    for (j = 0; j < nc; j++) {
+      v = 0.0f;
+      for (ii = MAX(i-1, 0); ii <= MIN(i+1, nr-1); ii++) {
+        for (jj = MAX(j-1, 0); jj <= MIN(j+1, nc-1); jj++) {
+          v = MAX(v, raw[ii*nc+jj]);
+        }
+      }
+      dem->slope[i*nc+j] = v;
+    }
+  }
+
+  free((void *) raw);
+  return(OK);
+}
+
+/****************************/
+/* DEM_BUILD_PYRAMID        */
+/****************************/
+static int dem_build_pyramid(dem_struct *dem)
+{
+  int     L, i, j, nr, nc, pnr, pnc, i2, j2;
+  float   *hm, *ph, v;
+  char    infunc[] = "dem_build_pyramid";
+
+  /* Count levels: level 0 has (nr-1) X (nc-1) cells, halved until 1 X 1 */
+  nr = dem->nr - 1;
+  nc = dem->nc - 1;
+  dem->nlevels = 1;
+  while ((nr > 1) || (nc > 1)) {
+    nr = (nr+1)/2;
+    nc = (nc+1)/2;
+    dem->nlevels++;
+  }
+
+  dem->lnr = (int *) qmalloc(2*dem->nlevels, sizeof(int), 0, infunc, "lnr");
+  dem->hmax = (float **) qmalloc(dem->nlevels, sizeof(float *), 1, infunc, "hmax");
+  if ((dem->lnr == NULL) || (dem->hmax == NULL)) {
+    return(ERR);
+  }
+  dem->lnc = dem->lnr + dem->nlevels;
+
+  /* Level 0 */
+  nr = dem->lnr[0] = dem->nr - 1;
+  nc = dem->lnc[0] = dem->nc - 1;
+  hm = dem->hmax[0] = (float *) qmalloc((size_t) nr*nc, sizeof(float), 0, infunc, "hmax[0]");
+  if (hm == NULL) {
+    return(ERR);
+  }
+  ph = dem->h;
+  dem->hmin_all = dem->hmax_all = ph[0];
+  for (i = 0; i < dem->nr; i++) {
+    for (j = 0; j < dem->nc; j++) {
+      v = ph[i*dem->nc+j];
+      dem->hmin_all = MIN(dem->hmin_all, v);
+      dem->hmax_all = MAX(dem->hmax_all, v);
+    }
+  }
+  for (i = 0; i < nr; i++) {
+    for (j = 0; j < nc; j++) {
+      v = MAX(ph[i*dem->nc+j], ph[i*dem->nc+j+1]);
+      v = MAX(v, ph[(i+1)*dem->nc+j]);
+      hm[i*nc+j] = MAX(v, ph[(i+1)*dem->nc+j+1]);
+    }
+  }
+
+  /* Coarser levels */
+  for (L = 1; L < dem->nlevels; L++) {
+    pnr = nr;
+    pnc = nc;
+    ph = hm;
+    nr = dem->lnr[L] = (pnr+1)/2;
+    nc = dem->lnc[L] = (pnc+1)/2;
+    hm = dem->hmax[L] = (float *) qmalloc((size_t) nr*nc, sizeof(float), 0, infunc, "hmax[L]");
+    if (hm == NULL) {
+      return(ERR);
+    }
+    for (i = 0; i < nr; i++) {
+      for (j = 0; j < nc; j++) {
+        i2 = MIN(2*i+1, pnr-1);
+        j2 = MIN(2*j+1, pnc-1);
+        v = MAX(ph[2*i*pnc+2*j], ph[2*i*pnc+j2]);
+        v = MAX(v, ph[i2*pnc+2*j]);
+        hm[i*nc+j] = MAX(v, ph[i2*pnc+j2]);
+      }
+    }
+  }
+
+  return(OK);
+}
+
+/****************************/
+/* DEM_ELLIPSOID_ROOTS      */
+/****************************/
+/* Both distances z1 <= z2 along the unit ray (t, d) at which it crosses the
+   centered ellipsoid with semi-axes (a, a, b). Returns ERR if it misses. */
+
+static int dem_ellipsoid_roots(double *t, double *d, double a, double b, double *z1, double *z2)
+{
+  double  l0, l2, A, B, C, D, R;
+
+  l0 = D_ONE/(a*a);
+  l2 = D_ONE/(b*b);
+  A = (d[0]*d[0] + d[1]*d[1])*l0 + d[2]*d[2]*l2;
+  B = D_TWO*((d[0]*t[0] + d[1]*t[1])*l0 + d[2]*t[2]*l2);
+  C = (t[0]*t[0] + t[1]*t[1])*l0 + t[2]*t[2]*l2 - D_ONE;
+  D = B*B - D_FOUR*A*C;
+  if (D < D_ZERO) {
+    return(ERR);
+  }
+  R = sqrt(D);
+  *z1 = (-B - R)/(D_TWO*A);
+  *z2 = (-B + R)/(D_TWO*A);
+
+  return(OK);
+}
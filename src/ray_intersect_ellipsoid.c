@@ -97,6 +97,62 @@ int ray_intersect_ca_ellipsoid(double *t, double *d, double *s, double *p)
   return(status);
 }
 
+/*********************************/
+/* RAY_INTERSECT_CA_ELLISPOID_N  */
+/*********************************/
+/* Batched form of ray_intersect_ca_ellipsoid for n rays sharing the common
+   origin t. Ray directions and intersection points are held as separate
+   X, Y, Z arrays (each of length n) so the loop below has no branches and
+   no pointer aliasing between iterations, letting the compiler vectorize it.
+
+   On return, status[k] is OK if ray k hit the ellipsoid (in which case
+   (px[k], py[k], pz[k]) holds the intersection), and ERR otherwise (in which
+   case px[k], py[k], pz[k] are undefined). The choice of root is the same as
+   in find_intersection_point. The function returns the number of hits.
+*/
+
+int ray_intersect_ca_ellipsoid_n(int n, double *t, double *dx, double *dy, double *dz, double *s,
+    double *px, double *py, double *pz, int *status)
+
+{
+  double     l0, l1, l2;
+  double     t0, t1, t2;
+  double     C;
+  double     A, B, D, R, z1, z2, z;
+  int        k, hit, nhit;
+  /*  char       infunc[] = "ray_intersect_ca_ellipsoid_n"; */
+
+  l0 = D_ONE/(s[0]*s[0]);
+  l1 = D_ONE/(s[1]*s[1]);
+  l2 = D_ONE/(s[2]*s[2]);
+  t0 = t[0];
+  t1 = t[1];
+  t2 = t[2];
+
+  /* C only depends on the ray origin, so it is shared by every ray */
+  C = t0*t0*l0 + t1*t1*l1 + t2*t2*l2 - D_ONE;
+
+  nhit = 0;
+  for (k = 0; k < n; k++) {
+    A = dx[k]*dx[k]*l0 + dy[k]*dy[k]*l1 + dz[k]*dz[k]*l2;
+    B = D_TWO*(dx[k]*t0*l0 + dy[k]*t1*l1 + dz[k]*t2*l2);
+    D = B*B - D_FOUR*A*C;
+    R = sqrt(D >= D_ZERO ? D : D_ZERO);
+    z1 = (-B - R)/(D_TWO*A);
+    z2 = (-B + R)/(D_TWO*A);
+    z = ((z1 >= D_ZERO) && (z1 <= z2)) ? z1 : z2;
+    hit = (D >= D_ZERO) && ((z1 >= D_ZERO) || (z2 >= D_ZERO));
+
+    px[k] = z*dx[k] + t0;
+    py[k] = z*dy[k] + t1;
+    pz[k] = z*dz[k] + t2;
+    status[k] = hit ? OK : ERR;
+    nhit += hit;
+  }
+
+  return(nhit);
+}
+
 /****************************/
 /* FIND_INTERSECTION_POINT  */
 /****************************/
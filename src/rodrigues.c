@@ -24,6 +24,7 @@
 #include "carto/rodrigues.h"
 
 #define RODRIGUES_EPS 1e-12
+#define RODRIGUES_BLOCK 64
 
 /**********************/
 /* RODRIGUES_VEC2MAT  */
@@ -164,3 +165,119 @@ int rodrigues_mat2vec(double *R, double *wrot)
 
   return(OK);
 }
+
+/************************/
+/* RODRIGUES_VEC2MAT_N  */
+/************************/
+/* Batched rodrigues_vec2mat for n rotation vectors. Arrays are planar: */
+/*   component k of item i is W[k*n+i] (k = 0..2) and R[k*n+i] (k = 0..8). */
+/*   Below RODRIGUES_EPS the axis is zeroed, which gives the identity */
+/*   exactly as the scalar version does, so the loop has no branches. */
+/*   Results go through a local buffer RODRIGUES_BLOCK items at a time so */
+/*   the compiler need not check for aliasing. */
+
+int rodrigues_vec2mat_n(int n, double *W, double *R)
+
+{
+  int        i, i0, m, k;
+  double     theta, f;
+  double     alpha, beta, gamma;
+  double     w0, w1, w2;
+  double     *W0, *W1, *W2;
+  double     Rb[9][RODRIGUES_BLOCK];
+  /*  char       infunc[] = "rodrigues_vec2mat_n"; */
+
+  for (i0 = 0; i0 < n; i0 += RODRIGUES_BLOCK) {
+    m = MIN(n - i0, RODRIGUES_BLOCK);
+    W0 = W + i0;
+    W1 = W + n + i0;
+    W2 = W + 2*n + i0;
+    for (i = 0; i < m; i++) {
+      w0 = W0[i];
+      w1 = W1[i];
+      w2 = W2[i];
+      theta = sqrt(w0*w0 + w1*w1 + w2*w2);
+      f = (theta < RODRIGUES_EPS) ? D_ZERO : D_ONE/theta;
+      alpha = cos(theta);
+      beta  = sin(theta);
+      gamma = 1-alpha;
+      w0 *= f;
+      w1 *= f;
+      w2 *= f;
+      Rb[0][i] = alpha            + gamma*w0*w0;
+      Rb[1][i] =         -beta*w2 + gamma*w0*w1;
+      Rb[2][i] =          beta*w1 + gamma*w0*w2;
+      Rb[3][i] =          beta*w2 + gamma*w1*w0;
+      Rb[4][i] = alpha            + gamma*w1*w1;
+      Rb[5][i] =         -beta*w0 + gamma*w1*w2;
+      Rb[6][i] =         -beta*w1 + gamma*w2*w0;
+      Rb[7][i] =          beta*w0 + gamma*w2*w1;
+      Rb[8][i] = alpha            + gamma*w2*w2;
+    }
+    for (k = 0; k < 9; k++) {
+      memcpy(R + k*n + i0, Rb[k], m*sizeof(double));
+    }
+  }
+
+  return(OK);
+}
+
+/************************/
+/* RODRIGUES_MAT2VEC_N  */
+/************************/
+/* Batched rodrigues_mat2vec, with the planar layout and blocking of */
+/*   rodrigues_vec2mat_n. The usual case is done in one branch-free pass; */
+/*   the rare rotations by (nearly) pi are then redone one at a time with */
+/*   rodrigues_mat2vec. W must not overlap R. */
+
+int rodrigues_mat2vec_n(int n, double *R, double *W)
+
+{
+  int        i, i0, m, k;
+  double     c, s, theta, fac;
+  int        n_pi;
+  double     Wb[3][RODRIGUES_BLOCK];
+  double     Ri[9], wi[3];
+  char       infunc[] = "rodrigues_mat2vec_n";
+
+  n_pi = 0;
+  for (i0 = 0; i0 < n; i0 += RODRIGUES_BLOCK) {
+    m = MIN(n - i0, RODRIGUES_BLOCK);
+    for (i = 0; i < m; i++) {
+      c = (R[i0+i] + R[4*n+i0+i] + R[8*n+i0+i] - D_ONE)/D_TWO;
+      theta = acos(c);
+      s = sin(theta);
+      fac = (fabs(theta) < RODRIGUES_EPS) ? D_ZERO : theta/(D_TWO*s);
+      n_pi += (fabs(theta-M_PI) < RODRIGUES_EPS);
+      Wb[0][i] = fac * (R[7*n+i0+i] - R[5*n+i0+i]);
+      Wb[1][i] = fac * (R[2*n+i0+i] - R[6*n+i0+i]);
+      Wb[2][i] = fac * (R[3*n+i0+i] - R[n+i0+i]);
+    }
+    for (k = 0; k < 3; k++) {
+      memcpy(W + k*n + i0, Wb[k], m*sizeof(double));
+    }
+  }
+  if (n_pi == 0) {
+    return(OK);
+  }
+
+  /* Redo the rotations by pi */
+  for (i = 0; (i < n) && (n_pi > 0); i++) {
+    c = (R[i] + R[4*n+i] + R[8*n+i] - D_ONE)/D_TWO;
+    if (fabs(acos(c)-M_PI) < RODRIGUES_EPS) {
+      for (k = 0; k < 9; k++) {
+        Ri[k] = R[k*n+i];
+      }
+      if (rodrigues_mat2vec(Ri, wi) == ERR) {
+        fprintf(stderr, "ERROR (%s): failed on matrix %d\n", infunc, i);
+        return(ERR);
+      }
+      W[i]     = wi[0];
+      W[n+i]   = wi[1];
+      W[2*n+i] = wi[2];
+      n_pi--;
+    }
+  }
+
+  return(OK);
+}
@@ -23,6 +23,7 @@
 
 #define DOT_THRESHOLD (1-0.5e-12)
 #define SLERP_EPS 1e-12
+#define SLERP_BLOCK 64
 
 /****************************/
 /* QSLERP                   */
@@ -135,3 +136,75 @@ int slerp(int n, double *a, double *b, double t, double *c)
 
   return(OK);
 }
+
+/****************************/
+/* QSLERP_N                 */
+/****************************/
+/* Batched qslerp: C_i = qslerp(A_i, B_i, t[i]) for i = 0..n-1. Arrays are */
+/*   planar: component k of quaternion i is A[k*n+i] (k = 0..3), likewise for */
+/*   B and C. The sign flip and the choice between slerp and normalized */
+/*   linear interpolation are made with selects, and results are formed */
+/*   SLERP_BLOCK items at a time in a local buffer, so the loop can be */
+/*   vectorized. The whole batch is computed; ERR is returned if any pair */
+/*   was not made of unit quaternions. */
+
+int qslerp_n(int n, double *A, double *B, double *t, double *C)
+
+{
+  int           i, i0, m, k;
+  double        a0, a1, a2, a3;
+  double        b0, b1, b2, b3;
+  double        c0, c1, c2, c3;
+  double        dab, sgn, dab_max, ti;
+  double        Omega, s1, alpha, beta, fac;
+  double        *Ak[4], *Bk[4];
+  double        Cb[4][SLERP_BLOCK];
+  char          infunc[] = "qslerp_n";
+
+  dab_max = D_ZERO;
+  for (i0 = 0; i0 < n; i0 += SLERP_BLOCK) {
+    m = MIN(n - i0, SLERP_BLOCK);
+    for (k = 0; k < 4; k++) {
+      Ak[k] = A + k*n + i0;
+      Bk[k] = B + k*n + i0;
+    }
+    for (i = 0; i < m; i++) {
+      a0 = Ak[0][i]; a1 = Ak[1][i]; a2 = Ak[2][i]; a3 = Ak[3][i];
+      b0 = Bk[0][i]; b1 = Bk[1][i]; b2 = Bk[2][i]; b3 = Bk[3][i];
+      ti = t[i0+i];
+
+      dab = a0*b0 + a1*b1 + a2*b2 + a3*b3;
+      sgn = (dab < 0) ? -D_ONE : D_ONE;
+      dab = fabs(dab);
+      dab_max = MAX(dab_max, dab);
+      dab = MIN(dab, D_ONE);
+
+      Omega = acos(dab);
+      s1 = sin(Omega);
+      s1 = (dab >= DOT_THRESHOLD) ? D_ONE : s1;
+      alpha = (dab >= DOT_THRESHOLD) ? (D_ONE - ti) : sin((D_ONE - ti)*Omega)/s1;
+      beta  = (dab >= DOT_THRESHOLD) ? ti : sin(ti*Omega)/s1;
+      beta *= sgn;
+
+      c0 = a0*alpha + b0*beta;
+      c1 = a1*alpha + b1*beta;
+      c2 = a2*alpha + b2*beta;
+      c3 = a3*alpha + b3*beta;
+      fac = D_ONE/sqrt(c0*c0 + c1*c1 + c2*c2 + c3*c3);
+      Cb[0][i] = c0*fac;
+      Cb[1][i] = c1*fac;
+      Cb[2][i] = c2*fac;
+      Cb[3][i] = c3*fac;
+    }
+    for (k = 0; k < 4; k++) {
+      memcpy(C + k*n + i0, Cb[k], m*sizeof(double));
+    }
+  }
+
+  if (dab_max > (D_ONE + SLERP_EPS)) {
+    fprintf(stderr, "ERROR (%s): dot product out of range = %.15f\n", infunc, dab_max);
+    return(ERR);
+  }
+
+  return(OK);
+}
@@ -0,0 +1,102 @@
+/*******************************************************************************
+
+  Title:    thread_manager
+  Function: Functions to set and get the number of worker threads used by the
+              multi-threaded routines in this library. A thread count of 0
+              (the default) means use one thread per online processor.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "carto/thread_manager.h"
+
+/*******************************/
+/* GLOBAL DECLARATIONS         */
+/*******************************/
+static int thread_count = 0;
+
+/**************************************/
+/* get_thread_count                   */
+/**************************************/
+/* Returns the number of threads a parallel routine should use. If the
+   caller never set a count, the number of online processors is used. The
+   result is always at least 1 and at most THREAD_MANAGER_MAX_THREADS. */
+
+int get_thread_count(void)
+
+{
+  long  n;
+
+  n = thread_count;
+  if (n <= 0) {
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (n < 1) {
+    n = 1;
+  }
+  if (n > THREAD_MANAGER_MAX_THREADS) {
+    n = THREAD_MANAGER_MAX_THREADS;
+  }
+
+  return((int) n);
+}
+
+/**************************************/
+/* set_thread_count                   */
+/**************************************/
+void set_thread_count(int count)
+
+{
+  thread_count = count;
+
+  return;
+}
+
+/**************************************/
+/* run_threads                        */
+/**************************************/
+/* Call func once for each of the nthreads work items in args (an array of
+   elements of size argsize), each on its own thread, and wait for all of
+   them to finish. With a single item, or if a thread cannot be started,
+   the work is done on the calling thread instead, so the results never
+   depend on whether threads were available. */
+
+void run_threads(int nthreads, void *(*func)(void *), void *args, size_t argsize)
+
+{
+  pthread_t      *threads;
+  char           *started;
+  char           *item;
+  int            t;
+
+  if (nthreads <= 1) {
+    if (nthreads == 1) {
+      func(args);
+    }
+    return;
+  }
+
+  threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+  started = (char *) calloc(nthreads, sizeof(char));
+  for (t = 0; t < nthreads; t++) {
+    item = ((char *) args) + t*argsize;
+    if ((threads != NULL) && (started != NULL) &&
+        (pthread_create(&threads[t], NULL, func, (void *) item) == 0)) {
+      started[t] = 1;
+    }
+    else {
+      func((void *) item);
+    }
+  }
+  for (t = 0; t < nthreads; t++) {
+    if ((started != NULL) && started[t]) {
+      pthread_join(threads[t], NULL);
+    }
+  }
+  free((void *) threads);
+  free((void *) started);
+
+  return;
+}
@@ -80,8 +80,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <strings.h>
+#include <pthread.h>
 #include "carto/burl.h"
 #include "carto/strsel.h"
 #include "carto/time_utils.h"
@@ -106,6 +108,32 @@ int    LEAP_TABLE_M[MAX_N_LEAPS];   /* minute */
 double LEAP_TABLE_S[MAX_N_LEAPS];   /* second */
 double LEAP_TABLE_ADJ[MAX_N_LEAPS]; /* adjustment */
 
+/* Each leap instant as a day number and seconds into that day, so lookups */
+/*   can binary search the table rather than compare component by component */
+static double LEAP_TABLE_DAY[MAX_N_LEAPS];
+static double LEAP_TABLE_SOD[MAX_N_LEAPS];
+
+/* Each leap instant as ACS time (apparent UTC seconds since 2000-01-01T12:00:00 UTC) */
+static double LEAP_TABLE_ACS[MAX_N_LEAPS];
+
+/* The leap second table is written by initialize_leap_second_table and */
+/*   read by every conversion; this lock makes that safe across threads */
+static pthread_rwlock_t LEAP_TABLE_LOCK = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Delta_UT1 table, read once from DUT1_TABLE_FNAME by */
+/*   initialize_delta_ut1_table and searched in memory from then on */
+static char   *DUT1_TABLE_FNAME = NULL;
+static int    DUT1_TABLE_N = 0;
+static int    *DUT1_TABLE_DATE = NULL;   /* yyyymmdd, increasing */
+static double *DUT1_TABLE_DAY = NULL;    /* julian day number of each date */
+static double *DUT1_TABLE_VALUE = NULL;  /* Delta_UT1 (seconds) */
+static pthread_rwlock_t DUT1_TABLE_LOCK = PTHREAD_RWLOCK_INITIALIZER;
+
+static int leap_table_index(int y0, int t0, int d0, int h0, int m0, double s0, int *k_adr);
+static int acs_leap_table_index(double ACS_time, int *k_adr);
+static int read_leap_second_table(char *filename);
+static int dut1_table_acquire(char *fname);
+
 /************************************/
 /* General Notes on Time References */
 /************************************/
@@ -333,12 +361,15 @@ int utc_time_components_to_leapsec_count(int y0, int t0, int d0, int h0, int m0,
   int        k;
   char       infunc[] = "utc_time_components_to_leapsec_count";
 
-  if (utc_time_components_to_leap_table_index(y0, t0, d0, h0, m0, s0, &k) == ERR) {
+  pthread_rwlock_rdlock(&LEAP_TABLE_LOCK);
+  if (leap_table_index(y0, t0, d0, h0, m0, s0, &k) == ERR) {
+    pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
     fprintf(stderr, "ERROR (%s): unable to determine leap table index\n", infunc);
     return(ERR);
   }
 
   *leapsec_count_adr = LEAP_TABLE_ADJ[k];
+  pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
 
   return(OK);
 }
@@ -355,59 +386,56 @@ int utc_time_components_to_leapsec_count(int y0, int t0, int d0, int h0, int m0,
 
 int utc_time_components_to_leap_table_index(int y0, int t0, int d0, int h0, int m0, double s0, int *k_adr)
 {
-  int        yi, ti, di, hi, mi;
-  double     si;
-  int        i, k;
+  int        status;
+  /*  char       infunc[] = "utc_time_components_to_leap_table_index"; */
+
+  pthread_rwlock_rdlock(&LEAP_TABLE_LOCK);
+  status = leap_table_index(y0, t0, d0, h0, m0, s0, k_adr);
+  pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
+
+  return(status);
+}
+
+/********************/
+/* LEAP_TABLE_INDEX */
+/********************/
+/* Body of utc_time_components_to_leap_table_index; the caller must hold */
+/*   LEAP_TABLE_LOCK. The answer is the last leap instant at or before the */
+/*   given time, found by binary search on (day number, second of day).    */
+
+static int leap_table_index(int y0, int t0, int d0, int h0, int m0, double s0, int *k_adr)
+{
+  double     day, sod;
+  int        lo, hi, mid;
   char       infunc[] = "utc_time_components_to_leap_table_index";
 
   if (N_LEAPS == 0) {
     fprintf(stderr, "ERROR (%s): leap second table not properly initialized\n", infunc);
     return(ERR);
   }
-  k = N_LEAPS-1;
-  for (i = 0; i < N_LEAPS; i++) {
-    yi = LEAP_TABLE_Y[i];
-    ti = LEAP_TABLE_T[i];
-    di = LEAP_TABLE_D[i];
-    hi = LEAP_TABLE_H[i];
-    mi = LEAP_TABLE_M[i];
-    si = LEAP_TABLE_S[i];
-    if (y0 < yi) {
-      k = i-1;
-      break;
+
+  julian_date(y0, t0, d0, 12, 0, D_ZERO, &day);
+  sod = h0*3600.0 + m0*60.0 + s0;
+
+  /* Count the entries at or before (day, sod) */
+  lo = 0;
+  hi = N_LEAPS;
+  while (lo < hi) {
+    mid = (lo + hi)/2;
+    if ((LEAP_TABLE_DAY[mid] < day) || ((LEAP_TABLE_DAY[mid] == day) && (LEAP_TABLE_SOD[mid] <= sod))) {
+      lo = mid+1;
     }
-    else if (y0 == yi) {
-      if (t0 < ti) {
-        k = i-1;
-        break;
-      }
-      else if (t0 == ti) {
-        if (h0 < hi) {
-          k = i-1;
-           break;
-        }
-        else if (h0 == hi) {
-          if (m0 < mi) {
-            k = i-1;
-            break;
-          }
-          else if (m0 == mi) {
-            if (s0 < si) {
-              k = i-1;
-              break;
-            }
-          }
-	}
-      }
+    else {
+      hi = mid;
     }
   }
 
-  if (k == -1) {
+  if (lo == 0) {
     fprintf(stderr, "ERROR (%s): cannot handle UTC times before 1972-01-01T00:00:00\n", infunc);
     return(ERR);
   }
 
-  *k_adr = k;
+  *k_adr = lo-1;
 
   return(OK);
 }
@@ -490,6 +518,97 @@ int acs_to_utc_iso_time_string(double ACS_time, char **UTC_string_adr)
   return(OK);
 }
 
+/***********************/
+/* ACS_TO_TT_AND_UT1_N */
+/***********************/
+/* Array form of acs_to_tt_and_ut1 for n ACS times, with one Delta_UT1 for */
+/*   all of them. */
+
+int acs_to_tt_and_ut1_n(int n, double *ACS_time, double Delta_UT1, double *TT, double *UT1)
+{
+  int      i;
+  /*  char     infunc[] = "acs_to_tt_and_ut1_n"; */
+
+  if (acs_to_tt_n(n, ACS_time, TT) == ERR) {
+    return(ERR);
+  }
+  for (i = 0; i < n; i++) {
+    UT1[i] = ACS_time[i] + Delta_UT1;
+  }
+
+  return(OK);
+}
+
+/***************/
+/* ACS_TO_TT_N */
+/***************/
+/* Array form of acs_to_tt. Rather than going through a UTC string for each */
+/*   time, the leap table row is found once for each run of times lying */
+/*   between the same two leap instants, and the offset for the run is then */
+/*   applied in a plain loop. Times need not be sorted, but sorted (or */
+/*   piecewise sorted) input needs only one search per leap interval. */
+
+int acs_to_tt_n(int n, double *ACS_time, double *TT)
+{
+  int      i, j, k;
+  double   lo, hi, offset;
+  char     infunc[] = "acs_to_tt_n";
+
+  pthread_rwlock_rdlock(&LEAP_TABLE_LOCK);
+  i = 0;
+  while (i < n) {
+    if (acs_leap_table_index(ACS_time[i], &k) == ERR) {
+      pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
+      fprintf(stderr, "ERROR (%s): unable to determine leap table index for ACS time %.6f\n", infunc, ACS_time[i]);
+      return(ERR);
+    }
+    lo = LEAP_TABLE_ACS[k];
+    hi = (k+1 < N_LEAPS) ? LEAP_TABLE_ACS[k+1] : HUGE_VAL;
+    offset = 64.184 + (LEAP_TABLE_ADJ[k] - 32); /* as in acs_to_tt */
+
+    /* Extent of the run sharing this leap interval */
+    j = i+1;
+    while ((j < n) && (ACS_time[j] >= lo) && (ACS_time[j] < hi)) {
+      j++;
+    }
+    for (; i < j; i++) {
+      TT[i] = ACS_time[i] + offset;
+    }
+  }
+  pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
+
+  return(OK);
+}
+
+/************************/
+/* ACS_LEAP_TABLE_INDEX */
+/************************/
+/* Last leap table row at or before the given ACS time; the caller must hold */
+/*   LEAP_TABLE_LOCK. */
+
+static int acs_leap_table_index(double ACS_time, int *k_adr)
+{
+  int      lo, hi, mid;
+
+  lo = 0;
+  hi = N_LEAPS;
+  while (lo < hi) {
+    mid = (lo + hi)/2;
+    if (LEAP_TABLE_ACS[mid] <= ACS_time) {
+      lo = mid+1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return(ERR);
+  }
+  *k_adr = lo-1;
+
+  return(OK);
+}
+
 
 /*=========================================================================================*/
 
@@ -533,6 +652,33 @@ int si_to_tt(double SI, double *TT_adr)
   return(OK);
 }
 
+/**************/
+/* SI_TO_TT_N */
+/**************/
+/* Array form of si_to_tt. */
+
+int si_to_tt_n(int n, double *SI, double *TT)
+{
+  int      i;
+  double   SI_min;
+  char     infunc[] = "si_to_tt_n";
+
+  SI_min = HUGE_VAL;
+  for (i = 0; i < n; i++) {
+    SI_min = MIN(SI_min, SI[i]);
+  }
+  if (SI_min < (-64.184 - 1e-07)) { /* Add an epsilon for numerical precision errors */
+    fprintf(stderr, "ERROR (%s): SI time must be >= -64.184\n", infunc);
+    return(ERR);
+  }
+
+  for (i = 0; i < n; i++) {
+    TT[i] = SI[i] + 64.184;
+  }
+
+  return(OK);
+}
+
 /**************/
 /* SI_TO_UT1  */
 /**************/
@@ -659,7 +805,11 @@ int tt_to_utc_iso_time_string(double TT, char **UTC_string_adr)
   julian_date(2000, 1, 1, 11, 58, (double) 55.816, &utc_jd0);
 
   /* Determine row in leap table for J2000 */ 
-  utc_time_components_to_leap_table_index(2000, 1, 1, 11, 58, (double) 55.816, &k);
+  pthread_rwlock_rdlock(&LEAP_TABLE_LOCK);
+  if (leap_table_index(2000, 1, 1, 11, 58, (double) 55.816, &k) == ERR) {
+    pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
+    return(ERR);
+  }
 
   inside_leap = 0;
   leapfix = LEAP_TABLE_ADJ[N_LEAPS-1] - LEAP_TABLE_ADJ[k]; /* If TT is past end of leap table */
@@ -699,9 +849,11 @@ int tt_to_utc_iso_time_string(double TT, char **UTC_string_adr)
     s0 = 55.816 + TT - leapfix;
     standardize_time_components(y0, t0, d0, h0, m0, s0, &y1, &t1, &d1, &h1, &m1, &s1);
     compose_iso_time_string(y1, t1, d1, h1, m1, s1, UTC_string_adr);
+    pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
   }
   else {
     compose_iso_time_string(LEAP_TABLE_Y[i], LEAP_TABLE_T[i], LEAP_TABLE_D[i], LEAP_TABLE_H[i], LEAP_TABLE_M[i], LEAP_TABLE_S[i], &UTC_tmp);
+    pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
     fprintf(stderr, "ERROR (%s): TT falls within a leap second (%s UTC)\n", infunc, UTC_tmp);
     free((void *) UTC_tmp);
     return(ERR);
@@ -780,6 +932,26 @@ int tt_to_tdb(double TT, double *TDB_adr)
   return(OK);
 }
 
+/***************/
+/* TT_TO_TDB_N */
+/***************/
+/* Array form of tt_to_tdb, evaluated the same way so that results are */
+/*   bit-identical. */
+
+int tt_to_tdb_n(int n, double *TT, double *TDB)
+{
+  int      i;
+  double   M_Earth_rad;
+  /*  char     infunc[] = "tt_to_tdb_n"; */
+
+  for (i = 0; i < n; i++) {
+    M_Earth_rad = (((double) 357.5277233) + ((double) 35999.05034) * (TT[i]/(86400.0 * 36525.0))) * DEG2RAD;
+    TDB[i] = TT[i] + 0.001658*sin(M_Earth_rad) + 0.00001385 * sin(2*M_Earth_rad);
+  }
+
+  return(OK);
+}
+
 /*=========================================================================================*/
 
 /********************/
@@ -789,9 +961,113 @@ int tt_to_tdb(double TT, double *TDB_adr)
 /*   value of Delta_UT1, the difference between UTC and UT1 for the date. */
 /*   The table is stored in a file named fname. Each line has a yyyymmdd date */
 /*   followed by a real value for Delta_UT1. Lines in file are sorted by increasing */
-/*   date. */
+/*   date. The file is read into memory on the first call (or when fname */
+/*   changes) and binary searched after that. */
 
 int lookup_delta_ut1(char *fname, int yyyymmdd, double *Delta_UT1_adr)
+{
+  int     lo, hi, mid;
+  char    infunc[] = "lookup_delta_ut1";
+
+  if (dut1_table_acquire(fname) == ERR) {
+    return(ERR);
+  }
+
+  lo = 0;
+  hi = DUT1_TABLE_N;
+  while (lo < hi) {
+    mid = (lo + hi)/2;
+    if (DUT1_TABLE_DATE[mid] < yyyymmdd) {
+      lo = mid+1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  if ((lo == DUT1_TABLE_N) || (DUT1_TABLE_DATE[lo] != yyyymmdd)) {
+    pthread_rwlock_unlock(&DUT1_TABLE_LOCK);
+    fprintf(stderr, "ERROR (%s): lookup failed for date %d in file %s\n", infunc, yyyymmdd, fname); 
+    return(ERR);
+  }
+  *Delta_UT1_adr = DUT1_TABLE_VALUE[lo];
+  pthread_rwlock_unlock(&DUT1_TABLE_LOCK);
+
+  return(OK);
+}
+
+/*************************/
+/* INTERPOLATE_DELTA_UT1 */
+/*************************/
+/* As lookup_delta_ut1, but for an instant day_fraction (0 <= day_fraction < 1) */
+/*   of the way through the UTC day yyyymmdd. Delta_UT1 is interpolated */
+/*   linearly between the bracketing table entries, except across a leap */
+/*   second (a jump of more than 0.5 s), where the earlier entry is held */
+/*   until the jump at the following midnight. */
+
+int interpolate_delta_ut1(char *fname, int yyyymmdd, double day_fraction, double *Delta_UT1_adr)
+{
+  int     y, t, d;
+  double  day;
+  double  w, v0, v1;
+  int     lo, hi, mid;
+  char    infunc[] = "interpolate_delta_ut1";
+
+  parse_yyyymmdd(yyyymmdd, &y, &t, &d);
+  julian_date(y, t, d, 12, 0, D_ZERO, &day);
+  day += day_fraction;
+
+  if (dut1_table_acquire(fname) == ERR) {
+    return(ERR);
+  }
+
+  if ((DUT1_TABLE_N == 0) || (day < DUT1_TABLE_DAY[0]) || (day > DUT1_TABLE_DAY[DUT1_TABLE_N-1])) {
+    pthread_rwlock_unlock(&DUT1_TABLE_LOCK);
+    fprintf(stderr, "ERROR (%s): date %d is outside the range of file %s\n", infunc, yyyymmdd, fname); 
+    return(ERR);
+  }
+
+  /* Last entry at or before day */
+  lo = 0;
+  hi = DUT1_TABLE_N;
+  while (lo < hi) {
+    mid = (lo + hi)/2;
+    if (DUT1_TABLE_DAY[mid] <= day) {
+      lo = mid+1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  lo--;
+
+  v0 = DUT1_TABLE_VALUE[lo];
+  if (lo == DUT1_TABLE_N-1) {
+    *Delta_UT1_adr = v0;
+  }
+  else {
+    v1 = DUT1_TABLE_VALUE[lo+1];
+    if (fabs(v1 - v0) > 0.5) {
+      *Delta_UT1_adr = v0;
+    }
+    else {
+      w = (day - DUT1_TABLE_DAY[lo]) / (DUT1_TABLE_DAY[lo+1] - DUT1_TABLE_DAY[lo]);
+      *Delta_UT1_adr = v0 + w*(v1 - v0);
+    }
+  }
+  pthread_rwlock_unlock(&DUT1_TABLE_LOCK);
+
+  return(OK);
+}
+
+/******************************/
+/* INITIALIZE_DELTA_UT1_TABLE */
+/******************************/
+/* Read the Delta_UT1 table in fname (format as for lookup_delta_ut1) into */
+/*   memory, replacing any table read earlier. Calling this is optional; */
+/*   the lookup functions load the table themselves on first use. */
+
+int initialize_delta_ut1_table(char *fname)
 {
   FILE    *fp;
   int     i;
@@ -801,54 +1077,125 @@ int lookup_delta_ut1(char *fname, int yyyymmdd, double *Delta_UT1_adr)
   char    tok0[64];
   char    tok1[64];
   int     L;
-  int     yyyymmdd_i;
-  int     found;
-  double  Delta_UT1;
+  int     y, t, d;
+  int     *date, *old_date;
+  double  *day, *old_day;
+  double  *value, *old_value;
+  char    *name, *old_name;
   char    line[MAXSTRING];
-  char    infunc[] = "lookup_delta_ut1";
+  char    infunc[] = "initialize_delta_ut1_table";
 
-  count_lines(fname, 2, &n_lines, &fp);
+  if (count_lines(fname, 2, &n_lines, &fp) == ERR) {
+    fprintf(stderr, "ERROR (%s): can't open %s\n", infunc, fname);
+    return(ERR);
+  }
+
+  date  = (int *) qmalloc(MAX(n_lines, 1), sizeof(int), 0, infunc, "date");
+  day   = (double *) qmalloc(MAX(n_lines, 1), sizeof(double), 0, infunc, "day");
+  value = (double *) qmalloc(MAX(n_lines, 1), sizeof(double), 0, infunc, "value");
+  name  = (char *) qmalloc(strlen(fname)+1, sizeof(char), 0, infunc, "name");
+  strcpy(name, fname);
 
-  found = 0;
   for (i = 0; i < n_lines; i++) {
     fgetl(line, MAXSTRING, fp);
     tokenize(line, " ", &n_tokens, &b, &e);
     if (n_tokens != 2) {
       fprintf(stderr, "ERROR (%s): expected 2 tokens on line |%s|, found %d\n", infunc, line, n_tokens);
-      return(ERR);
+      break;
     }
     L = get_max_token_length(n_tokens, b, e);
     if (L > 63) {
       fprintf(stderr, "ERROR (%s): token too long on line |%s|\n", infunc, line);
-      return(ERR);
+      break;
     }
     extract_token(tok0, line, b, e, 0);
     extract_token(tok1, line, b, e, 1);
     free((void *) b);
     free((void *) e);
 
-    yyyymmdd_i  = (int) atoi(tok0);
-    if (yyyymmdd == yyyymmdd_i) {
-      found = 1;
-      Delta_UT1 = (double) atof(tok1);
+    date[i]  = (int) atoi(tok0);
+    value[i] = (double) atof(tok1);
+    parse_yyyymmdd(date[i], &y, &t, &d);
+    julian_date(y, t, d, 12, 0, D_ZERO, &day[i]);
+    if ((i > 0) && (date[i] <= date[i-1])) {
+      fprintf(stderr, "ERROR (%s): dates in %s not strictly increasing at line |%s|\n", infunc, fname, line);
       break;
     }
   }
   fclose(fp);
 
-  if (found == 0) {
-    fprintf(stderr, "ERROR (%s): lookup failed for date %d in file %s\n", infunc, yyyymmdd, fname); 
+  if (i < n_lines) {
+    free((void *) date);
+    free((void *) day);
+    free((void *) value);
+    free((void *) name);
     return(ERR);
   }
-  *Delta_UT1_adr = Delta_UT1;
+
+  pthread_rwlock_wrlock(&DUT1_TABLE_LOCK);
+  old_date  = DUT1_TABLE_DATE;
+  old_day   = DUT1_TABLE_DAY;
+  old_value = DUT1_TABLE_VALUE;
+  old_name  = DUT1_TABLE_FNAME;
+  DUT1_TABLE_DATE  = date;
+  DUT1_TABLE_DAY   = day;
+  DUT1_TABLE_VALUE = value;
+  DUT1_TABLE_FNAME = name;
+  DUT1_TABLE_N     = n_lines;
+  pthread_rwlock_unlock(&DUT1_TABLE_LOCK);
+
+  if (old_name != NULL) {
+    free((void *) old_date);
+    free((void *) old_day);
+    free((void *) old_value);
+    free((void *) old_name);
+  }
 
   return(OK);
 }
 
+/**********************/
+/* DUT1_TABLE_ACQUIRE */
+/**********************/
+/* Return with DUT1_TABLE_LOCK held for reading and the table for fname */
+/*   loaded, reading the file first if a different one (or none) is loaded. */
+/*   The caller releases the lock. */
+
+static int dut1_table_acquire(char *fname)
+{
+  for (;;) {
+    pthread_rwlock_rdlock(&DUT1_TABLE_LOCK);
+    if ((DUT1_TABLE_FNAME != NULL) && (strcmp(DUT1_TABLE_FNAME, fname) == 0)) {
+      return(OK);
+    }
+    pthread_rwlock_unlock(&DUT1_TABLE_LOCK);
+    if (initialize_delta_ut1_table(fname) == ERR) {
+      return(ERR);
+    }
+  }
+}
+
 /********************************/
 /* INITIALIZE_LEAP_SECOND_TABLE */
 /********************************/
 int initialize_leap_second_table(char *filename)
+{
+  int     status;
+
+  pthread_rwlock_wrlock(&LEAP_TABLE_LOCK);
+  status = read_leap_second_table(filename);
+  pthread_rwlock_unlock(&LEAP_TABLE_LOCK);
+
+  return(status);
+}
+
+/**************************/
+/* READ_LEAP_SECOND_TABLE */
+/**************************/
+/* Body of initialize_leap_second_table; the caller must hold LEAP_TABLE_LOCK */
+/*   for writing. */
+
+static int read_leap_second_table(char *filename)
 {
   FILE    *fp;
   char    tok0[64], tok1[64], tok2[64], tok3[64], tok4[64], tok5[64], tok6[64];
@@ -859,9 +1206,12 @@ int initialize_leap_second_table(char *filename)
   int     yf, tf, df, hf, mf;
   double  sf;
   double  jd0, jd1, offset;
+  double  jd2000;
   char    line[MAXSTRING];
   char    infunc[] = "initialize_leap_second_table";
 
+  julian_date(2000, 1, 1, 12, 0, D_ZERO, &jd2000);
+
   if (count_lines(filename, 2, &n_lines, &fp) == ERR) {
     fprintf(stderr, "ERROR (%s): can't open %s\n", infunc, filename);
     return(ERR);
@@ -933,6 +1283,9 @@ int initialize_leap_second_table(char *filename)
       LEAP_TABLE_M[nn] = mf;
       LEAP_TABLE_S[nn] = sf;
       LEAP_TABLE_ADJ[nn] = L;
+      julian_date(yf, tf, df, 12, 0, D_ZERO, &LEAP_TABLE_DAY[nn]);
+      LEAP_TABLE_SOD[nn] = hf*3600.0 + mf*60.0 + sf;
+      LEAP_TABLE_ACS[nn] = (LEAP_TABLE_DAY[nn] - jd2000)*86400.0 + LEAP_TABLE_SOD[nn] - 43200.0;
       /* printf("nn = %d, yf = %d, tf = %d, df = %d, hf = %d, mf = %d, sf = %.15f\n", nn, yf, tf, df, hf, mf, sf);*/
       nn++;
     }